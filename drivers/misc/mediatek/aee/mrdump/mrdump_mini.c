@@ -442,6 +442,89 @@ int mrdump_modules_info(unsigned char *buffer, size_t sz_buf)
 #endif
 }
 
+/*
+ * The loader copies every misc region at reboot, so their total size sets
+ * the panic-to-reboot time. With mini_budget set, regions are dropped from
+ * the lowest priority up until the rest fits; MUST regions are never
+ * dropped. A dropped region keeps its note with a zero size so the note
+ * layout seen by the loader and aed does not change.
+ */
+enum mrdump_mini_prio {
+	MRDUMP_MINI_PRIO_MUST,
+	MRDUMP_MINI_PRIO_HIGH,
+	MRDUMP_MINI_PRIO_NORMAL,
+	MRDUMP_MINI_PRIO_LOW,
+};
+
+static const struct {
+	const char *prefix;
+	enum mrdump_mini_prio prio;
+} mrdump_mini_prio_tbl[] = {
+	{MRDUMP_MINI_MISC_LOAD, MRDUMP_MINI_PRIO_MUST},
+	{"PROC_CUR_TSK", MRDUMP_MINI_PRIO_MUST},
+	{"_KERNEL_LOG_", MRDUMP_MINI_PRIO_MUST},
+	{"_HANG_DETECT_", MRDUMP_MINI_PRIO_MUST},
+	{"_RR_DESC_", MRDUMP_MINI_PRIO_HIGH},
+	{"_LAST_KMSG", MRDUMP_MINI_PRIO_HIGH},
+	{"_VERSION_BR", MRDUMP_MINI_PRIO_HIGH},
+	{"SYS_MODULES_INFO", MRDUMP_MINI_PRIO_HIGH},
+	{"_DISP_", MRDUMP_MINI_PRIO_LOW},
+	{"_EXTRA_", MRDUMP_MINI_PRIO_LOW},
+};
+
+static unsigned long mrdump_mini_budget;
+module_param_named(mini_budget, mrdump_mini_budget, ulong, 0644);
+
+static enum mrdump_mini_prio mrdump_mini_misc_prio(const char *name)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(mrdump_mini_prio_tbl); i++)
+		if (!strncmp(name, mrdump_mini_prio_tbl[i].prefix,
+			     strlen(mrdump_mini_prio_tbl[i].prefix)))
+			return mrdump_mini_prio_tbl[i].prio;
+
+	return MRDUMP_MINI_PRIO_NORMAL;
+}
+
+static void mrdump_mini_apply_budget(void)
+{
+	struct mrdump_mini_elf_note *misc;
+	unsigned long total = 0, dropped = 0;
+	int i, prio, nr_drop = 0;
+
+	if (!mrdump_mini_ehdr || !mrdump_mini_budget)
+		return;
+
+	for (i = 0; i < MRDUMP_MINI_NR_MISC; i++) {
+		misc = &mrdump_mini_ehdr->misc[i];
+		if (misc->note.n_type == NT_IPANIC_MISC)
+			total += misc->data.size;
+	}
+
+	/* latest added first within a priority */
+	for (prio = MRDUMP_MINI_PRIO_LOW;
+	     prio > MRDUMP_MINI_PRIO_MUST && total > mrdump_mini_budget;
+	     prio--) {
+		for (i = MRDUMP_MINI_NR_MISC - 1;
+		     i >= 0 && total > mrdump_mini_budget; i--) {
+			misc = &mrdump_mini_ehdr->misc[i];
+			if (misc->note.n_type != NT_IPANIC_MISC ||
+			    !misc->data.size ||
+			    mrdump_mini_misc_prio(misc->name) != prio)
+				continue;
+			total -= misc->data.size;
+			dropped += misc->data.size;
+			nr_drop++;
+			misc->data.size = 0;
+		}
+	}
+
+	if (nr_drop)
+		pr_notice("mrdump: mini budget 0x%lx, dropped %d regions 0x%lx, keep 0x%lx\n",
+			  mrdump_mini_budget, nr_drop, dropped, total);
+}
+
 #define EXTRA_MISC(func, name, max_size) \
 	__weak void func(unsigned long *vaddr, unsigned long *size) \
 	{ \
@@ -504,6 +587,7 @@ void mrdump_mini_add_extra_misc(void)
 					vaddr, size);
 		}
 	}
+	mrdump_mini_apply_budget();
 }
 EXPORT_SYMBOL(mrdump_mini_add_extra_misc);
 
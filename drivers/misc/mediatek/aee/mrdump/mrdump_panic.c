@@ -90,6 +90,7 @@ int mrdump_common_die(u8 fiq_step, int reboot_reason, const char *msg,
 {
 	int last_step;
 	int next_step;
+	u64 t_die = sched_clock();
 
 	num_die++;
 
@@ -166,6 +167,8 @@ int mrdump_common_die(u8 fiq_step, int reboot_reason, const char *msg,
 		aee_nested_printf("num_die-%d, fiq_step-%d, last_step-%d, next_step-%d\n",
 				  num_die, fiq_step,
 				  last_step, next_step);
+		aee_nested_printf("die steps took %llu us\n",
+				  div_u64(sched_clock() - t_die, NSEC_PER_USEC));
 		aee_exception_reboot();
 		break;
 	}
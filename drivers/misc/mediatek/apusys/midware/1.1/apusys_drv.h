@@ -106,6 +106,40 @@ struct apusys_ioctl_cmd {
 	unsigned int size;
 };
 
+/* for APUSYS_IOCTL_RUN_CMD_TMPL */
+enum {
+	APUSYS_RUN_FLAG_CMPL_RING = 1 << 0,
+};
+
+/*
+ * -EFAULT means the run was submitted but cmd_id couldn't be written back;
+ * the run can't be waited and is aborted when the fd is released.
+ */
+struct apusys_ioctl_tmpl {
+	unsigned long long handle; // from APUSYS_IOCTL_CMD_REGISTER
+	unsigned long long cookie; // echoed by completion ring entry
+	unsigned int flags;
+	unsigned int reserved;
+
+	unsigned long long cmd_id; // for APUSYS_IOCTL_WAIT_CMD w/o ring
+};
+
+/* completion ring, mmap from apusys device */
+struct apusys_cmpl_entry {
+	unsigned long long cookie;
+	int status;
+	unsigned int total_time; // us
+};
+
+struct apusys_cmpl_ring {
+	unsigned int head; // produced by driver
+	unsigned int tail; // consumed by user
+	unsigned int num; // entry number
+	unsigned int reserved;
+
+	struct apusys_cmpl_entry entry[0];
+};
+
 /* for APUSYS_IOCTL_SET_POWER */
 struct apusys_ioctl_power {
 	int dev_type;
@@ -193,6 +227,12 @@ struct apusys_ioctl_sec {
 	_IOWR(APUSYS_MAGICNO, 15, struct apusys_mem)
 #define APUSYS_IOCTL_MEM_UNMAP \
 	_IOWR(APUSYS_MAGICNO, 16, struct apusys_mem)
+#define APUSYS_IOCTL_CMD_REGISTER \
+	_IOWR(APUSYS_MAGICNO, 17, struct apusys_ioctl_cmd)
+#define APUSYS_IOCTL_CMD_UNREGISTER \
+	_IOW(APUSYS_MAGICNO, 18, struct apusys_ioctl_cmd)
+#define APUSYS_IOCTL_RUN_CMD_TMPL \
+	_IOWR(APUSYS_MAGICNO, 19, struct apusys_ioctl_tmpl)
 
 #define APUSYS_IOCTL_SEC_DEVICE_LOCK \
 	_IOW(APUSYS_MAGICNO, 60, int)
@@ -25,6 +25,9 @@
 #define MDW_CMD_SCR_BMP_ERR 0xffffffffffffffff
 #define MDW_CMD_EMPTY_NUM 0xff
 
+static struct kmem_cache *mdw_cmd_cache;
+static struct kmem_cache *mdw_sc_cache;
+
 /* parse apu cmd related functions */
 static void mdw_cmd_show_cmd(struct mdw_apu_cmd *c)
 {
@@ -310,6 +313,15 @@ static inline int mdw_cmd_sc_valid(struct mdw_apu_sc *sc)
 			c->kid, sc->idx, sc->hdr->pack_id);
 		return -EINVAL;
 	}
+	/* ctx/pack counts were taken from the user hdr before this copy */
+	if (sc->hdr->mem_ctx != c->sc_ctx[sc->idx] ||
+		sc->hdr->pack_id != c->sc_pack[sc->idx]) {
+		mdw_drv_err("sc(0x%llx-#%d) ctx/pack changed(%u/%u->%u/%u)\n",
+			c->kid, sc->idx, c->sc_ctx[sc->idx],
+			c->sc_pack[sc->idx], sc->hdr->mem_ctx,
+			sc->hdr->pack_id);
+		return -EINVAL;
+	}
 	/* check successor bitmap */
 	if (sc->scr_bmp == MDW_CMD_SCR_BMP_ERR) {
 		mdw_drv_err("sc(0x%llx-#%d) invalid scr bmp\n",
@@ -344,6 +356,9 @@ static int mdw_cmd_get_pack_ctx(struct mdw_apu_cmd *c)
 	struct apu_sc_hdr_cmn *h = NULL;
 
 	memset(c->ctx_repo, MDW_CMD_EMPTY_NUM, sizeof(c->ctx_repo));
+	/* an sc not counted here never passes mdw_cmd_sc_valid() */
+	memset(c->sc_ctx, MDW_CMD_EMPTY_NUM, sizeof(c->sc_ctx));
+	memset(c->sc_pack, MDW_CMD_EMPTY_NUM, sizeof(c->sc_pack));
 
 	for (i = 0; i < c->hdr->num_sc; i++) {
 		h = mdw_cmd_get_sc_hdr(c, i);
@@ -358,6 +373,8 @@ static int mdw_cmd_get_pack_ctx(struct mdw_apu_cmd *c)
 		}
 		c->ctx_cnt[h->mem_ctx]++;
 		c->pack_cnt[h->pack_id]++;
+		c->sc_ctx[i] = h->mem_ctx;
+		c->sc_pack[i] = h->pack_id;
 	}
 
 	return 0;
@@ -370,6 +387,38 @@ static bool mdw_cmd_is_deadline(struct mdw_apu_sc *sc)
 	return false;
 }
 
+static int mdw_cmd_setup_cmd(struct mdw_apu_cmd *c, struct mdw_usr *u)
+{
+	c->kid = (uint64_t)c;
+	refcount_set(&c->ref.refcount, c->hdr->num_sc);
+	c->usr = u;
+
+	/* init cmd completion */
+	init_completion(&c->cmplt);
+	INIT_LIST_HEAD(&c->ring_item);
+
+	if (mdw_cmd_parse_flags(c))
+		return -EINVAL;
+
+	/* init sc list */
+	INIT_LIST_HEAD(&c->sc_list);
+	INIT_LIST_HEAD(&c->di_list);
+
+	/* init mutex*/
+	mutex_init(&c->mtx);
+	getnstimeofday(&c->ts_create);
+
+	ktime_get_ts64(&c->start_ts);
+
+	/* init sc state bmp */
+	c->sc_status_bmp = (1ULL << c->hdr->num_sc) - 1;
+	mdw_drv_debug("cmd(0x%llx/0x%llx) create\n", c->hdr->uid, c->kid);
+	mdw_cmd_debug("cmd sc status bitmap = 0x%llx\n", c->sc_status_bmp);
+	mdw_cmd_show_cmd(c);
+
+	return 0;
+}
+
 static struct mdw_apu_cmd *mdw_cmd_create_cmd(int fd,
 	uint32_t size, uint32_t ofs, struct mdw_usr *u)
 {
@@ -382,80 +431,167 @@ static struct mdw_apu_cmd *mdw_cmd_create_cmd(int fd,
 	}
 
 	/* create cmd */
-	c = vzalloc(sizeof(struct mdw_apu_cmd));
+	c = kmem_cache_zalloc(mdw_cmd_cache, GFP_KERNEL);
 	if (!c)
 		goto fail_alloc_cmd;
 
 	/* mapping */
-	c->cmdbuf = vzalloc(sizeof(struct apusys_kmem));
-	if (!c->cmdbuf)
-		goto fail_alloc_km;
-
+	c->cmdbuf = &c->km;
 	c->cmdbuf->fd = fd;
 	c->cmdbuf->size = size;
 	if (mdw_mem_map_kva(c->cmdbuf))
 		goto fail_map_kva;
 
 	/* setup hdr */
-	c->hdr = vzalloc(sizeof(struct apu_cmd_hdr));
-	if (!c->hdr)
-		goto fail_alloc_hdr;
-
+	c->hdr = &c->hdr_buf;
 	c->u_hdr = (struct apu_cmd_hdr *)(c->cmdbuf->kva + ofs);
 	memcpy(c->hdr, c->u_hdr, sizeof(struct apu_cmd_hdr));
 	c->size = size;
-	c->kid = (uint64_t)c;
-	refcount_set(&c->ref.refcount, c->hdr->num_sc);
-	c->usr = u;
-
-	/* init cmd completion */
-	init_completion(&c->cmplt);
 
 	/* check basic information */
 	if (mdw_cmd_valid(c))
 		goto fail_cmd_invalid;
 
-	if (mdw_cmd_parse_flags(c))
-		goto fail_parse_flags;
-
 	if (mdw_cmd_get_pack_ctx(c))
 		goto fail_get_pack_ctx;
 
-	/* init sc list */
-	INIT_LIST_HEAD(&c->sc_list);
-	INIT_LIST_HEAD(&c->di_list);
-
-	/* init mutex*/
-	mutex_init(&c->mtx);
-	getnstimeofday(&c->ts_create);
-
-	ktime_get_ts64(&c->start_ts);
-
-	/* init sc state bmp */
-	c->sc_status_bmp = (1ULL << c->hdr->num_sc) - 1;
-	mdw_drv_debug("cmd(0x%llx/0x%llx) create\n", c->hdr->uid, c->kid);
-	mdw_cmd_debug("cmd sc status bitmap = 0x%llx\n", c->sc_status_bmp);
-	mdw_cmd_show_cmd(c);
+	if (mdw_cmd_setup_cmd(c, u))
+		goto fail_setup_cmd;
 
 	return c;
 
+fail_setup_cmd:
 fail_get_pack_ctx:
-fail_parse_flags:
 fail_cmd_invalid:
-	vfree(c->hdr);
-fail_alloc_hdr:
 	mdw_mem_unmap_kva(c->cmdbuf);
 fail_map_kva:
-	vfree(c->cmdbuf);
-fail_alloc_km:
-	vfree(c);
+	kmem_cache_free(mdw_cmd_cache, c);
 fail_alloc_cmd:
 out:
 	return NULL;
 }
 
+static void mdw_cmd_release_tmpl(struct kref *ref)
+{
+	struct mdw_cmd_tmpl *t =
+			container_of(ref, struct mdw_cmd_tmpl, ref);
+
+	mdw_drv_debug("tmpl(%d) destroy\n", t->id);
+	mdw_mem_unmap_kva(&t->cmdbuf);
+	kfree(t);
+}
+
+static void mdw_cmd_put_tmpl(struct mdw_cmd_tmpl *t)
+{
+	kref_put(&t->ref, mdw_cmd_release_tmpl);
+}
+
+static struct mdw_cmd_tmpl *mdw_cmd_create_tmpl(int fd,
+	uint32_t size, uint32_t ofs)
+{
+	struct mdw_cmd_tmpl *t;
+	struct mdw_apu_cmd *c;
+	int i = 0;
+
+	/* tmpl runs always start at cmdbuf head */
+	if (ofs || size < sizeof(struct apu_cmd_hdr)) {
+		mdw_drv_err("invalid tmpl ofs/size(%u/%u)\n", ofs, size);
+		return NULL;
+	}
+
+	t = kzalloc(sizeof(*t), GFP_KERNEL);
+	if (!t)
+		return NULL;
+
+	/* validate cmdbuf layout with a scratch cmd */
+	c = kmem_cache_zalloc(mdw_cmd_cache, GFP_KERNEL);
+	if (!c)
+		goto fail_alloc_cmd;
+
+	t->cmdbuf.fd = fd;
+	t->cmdbuf.size = size;
+	t->size = size;
+	if (mdw_mem_map_kva(&t->cmdbuf))
+		goto fail_map_kva;
+
+	c->hdr = &c->hdr_buf;
+	c->u_hdr = (struct apu_cmd_hdr *)t->cmdbuf.kva;
+	memcpy(c->hdr, c->u_hdr, sizeof(struct apu_cmd_hdr));
+	c->size = size;
+	c->kid = (uint64_t)c;
+
+	if (mdw_cmd_valid(c))
+		goto fail_cmd_invalid;
+
+	/* every sc hdr must be reachable */
+	for (i = 0; i < c->hdr->num_sc; i++) {
+		if (!mdw_cmd_get_sc_hdr(c, i))
+			goto fail_cmd_invalid;
+	}
+
+	if (mdw_cmd_get_pack_ctx(c))
+		goto fail_cmd_invalid;
+
+	memcpy(&t->hdr, c->hdr, sizeof(t->hdr));
+	atomic_set(&t->busy, 0);
+	kref_init(&t->ref);
+	kmem_cache_free(mdw_cmd_cache, c);
+
+	mdw_drv_debug("tmpl(0x%llx) create, sc(%u) size(%u)\n",
+		t->hdr.uid, t->hdr.num_sc, t->size);
+
+	return t;
+
+fail_cmd_invalid:
+	mdw_mem_unmap_kva(&t->cmdbuf);
+fail_map_kva:
+	kmem_cache_free(mdw_cmd_cache, c);
+fail_alloc_cmd:
+	kfree(t);
+	return NULL;
+}
+
+static struct mdw_apu_cmd *mdw_cmd_create_cmd_tmpl(struct mdw_cmd_tmpl *t,
+	struct mdw_usr *u)
+{
+	struct mdw_apu_cmd *c;
+
+	c = kmem_cache_zalloc(mdw_cmd_cache, GFP_KERNEL);
+	if (!c)
+		return NULL;
+
+	/* reuse mapping and validated hdr of tmpl */
+	kref_get(&t->ref);
+	c->tmpl = t;
+	c->cmdbuf = &t->cmdbuf;
+	c->hdr = &c->hdr_buf;
+	c->u_hdr = (struct apu_cmd_hdr *)t->cmdbuf.kva;
+	memcpy(c->hdr, &t->hdr, sizeof(struct apu_cmd_hdr));
+	c->size = t->size;
+
+	/* sc hdrs are user-writable between runs, count them again */
+	if (mdw_cmd_get_pack_ctx(c))
+		goto fail;
+
+	/* clear status left by last run */
+	mdw_cmd_hdr_set_status(c, HDR_FLAG_EXEC_STATUS_OK);
+
+	if (mdw_cmd_setup_cmd(c, u))
+		goto fail;
+
+	return c;
+
+fail:
+	c->tmpl = NULL;
+	mdw_cmd_put_tmpl(t);
+	kmem_cache_free(mdw_cmd_cache, c);
+	return NULL;
+}
+
 static int mdw_cmd_delete_cmd(struct mdw_apu_cmd *c)
 {
+	struct mdw_usr *ring_usr = NULL;
+
 	if (kref_read(&c->ref) != 0) {
 		mdw_drv_err("cmd(0x%llx/0x%llx) can't destroy\n",
 			c->hdr->uid, c->kid);
@@ -469,10 +605,20 @@ static int mdw_cmd_delete_cmd(struct mdw_apu_cmd *c)
 	mdw_cmd_hdr_update_time(c);
 	mdw_cmd_show_cmd_perf(c);
 
-	mdw_mem_unmap_kva(c->cmdbuf);
-	vfree(c->cmdbuf);
-	vfree(c->hdr);
-	vfree(c);
+	if (c->tmpl) {
+		atomic_set(&c->tmpl->busy, 0);
+		mdw_cmd_put_tmpl(c->tmpl);
+	} else {
+		mdw_mem_unmap_kva(c->cmdbuf);
+	}
+
+	if (c->ring)
+		ring_usr = c->usr;
+	kmem_cache_free(mdw_cmd_cache, c);
+
+	/* release ring slot after cmd gone */
+	if (ring_usr)
+		mdw_usr_cmpl_put(ring_usr);
 
 	return 0;
 }
@@ -525,12 +671,30 @@ static void mdw_cmd_done(struct kref *ref)
 	/* abort, delete cmd direct */
 	if (c->sc_status_bmp || c->state == MDW_CMD_STATE_ABORT) {
 		mdw_drv_warn("abort, delete c(0x%llx) directly\n", c->kid);
+		/* ring cmd has no waiter, post error to ring */
+		if (c->ring)
+			mdw_usr_cmpl_post(c);
+		mdw_cmd_delete_cmd(c);
+	} else if (c->ring) {
+		/* nobody waits ring cmd, post and delete here */
+		mdw_usr_cmpl_post(c);
 		mdw_cmd_delete_cmd(c);
 	} else {
 		complete(&c->cmplt);
 	}
 }
 
+/* extra ref to keep cmd alive while aborting it from outside */
+static bool mdw_cmd_get_cmd(struct mdw_apu_cmd *c)
+{
+	return kref_get_unless_zero(&c->ref);
+}
+
+static void mdw_cmd_put_cmd(struct mdw_apu_cmd *c)
+{
+	kref_put(&c->ref, mdw_cmd_done);
+}
+
 static void mdw_cmd_delete_sc(struct mdw_apu_sc *sc)
 {
 	struct mdw_queue *mq = NULL;
@@ -553,8 +717,7 @@ static void mdw_cmd_delete_sc(struct mdw_apu_sc *sc)
 	mdw_cmd_set_sc_hdr(sc);
 	mdw_cmd_release_codebuf_info(sc);
 	mutex_unlock(&sc->mtx);
-	vfree(sc->hdr);
-	vfree(sc);
+	kmem_cache_free(mdw_sc_cache, sc);
 }
 
 static struct mdw_apu_sc *mdw_cmd_create_sc(struct mdw_apu_cmd *c)
@@ -562,7 +725,7 @@ static struct mdw_apu_sc *mdw_cmd_create_sc(struct mdw_apu_cmd *c)
 	struct mdw_apu_sc *sc = NULL;
 	struct mdw_queue *mq = NULL;
 
-	sc = vzalloc(sizeof(struct mdw_apu_sc));
+	sc = kmem_cache_zalloc(mdw_sc_cache, GFP_KERNEL);
 	if (!sc)
 		return NULL;
 
@@ -570,9 +733,7 @@ static struct mdw_apu_sc *mdw_cmd_create_sc(struct mdw_apu_cmd *c)
 	sc->u_hdr = mdw_cmd_get_sc_hdr(c, c->parsed_sc_num);
 	if (!sc->u_hdr)
 		goto fail_get_sc_hdr;
-	sc->hdr = vzalloc(sizeof(struct apu_sc_hdr_cmn));
-	if (!sc->hdr)
-		goto fail_alloc_hdr;
+	sc->hdr = &sc->hdr_buf;
 
 	memcpy(sc->hdr, sc->u_hdr, sizeof(struct apu_sc_hdr_cmn));
 	mutex_init(&sc->mtx);
@@ -623,11 +784,9 @@ static struct mdw_apu_sc *mdw_cmd_create_sc(struct mdw_apu_cmd *c)
 fail_sc_invalid:
 fail_get_mq:
 fail_get_codebuf_info:
-	vfree(sc->hdr);
-fail_alloc_hdr:
 fail_get_sc_hdr:
 	mdw_flw_debug("\n");
-	vfree(sc);
+	kmem_cache_free(mdw_sc_cache, sc);
 	return NULL;
 }
 
@@ -958,6 +1117,11 @@ struct mdw_cmd_parser mdw_cmd_parser = {
 	.set_hnd = mdw_cmd_sc_set_hnd,
 	.clr_hnd = mdw_cmd_sc_clr_hnd,
 	.is_deadline = mdw_cmd_is_deadline,
+	.create_tmpl = mdw_cmd_create_tmpl,
+	.put_tmpl = mdw_cmd_put_tmpl,
+	.create_cmd_tmpl = mdw_cmd_create_cmd_tmpl,
+	.get_cmd = mdw_cmd_get_cmd,
+	.put_cmd = mdw_cmd_put_cmd,
 };
 
 struct mdw_cmd_parser *mdw_cmd_get_parser(void)
@@ -974,3 +1138,27 @@ uint32_t mdw_cmd_get_ver(void)
 {
 	return APUSYS_CMD_VERSION;
 }
+
+int mdw_cmd_init(void)
+{
+	mdw_cmd_cache = kmem_cache_create("apusys_cmd",
+		sizeof(struct mdw_apu_cmd), 0, 0, NULL);
+	if (!mdw_cmd_cache)
+		return -ENOMEM;
+
+	mdw_sc_cache = kmem_cache_create("apusys_sc",
+		sizeof(struct mdw_apu_sc), 0, 0, NULL);
+	if (!mdw_sc_cache) {
+		kmem_cache_destroy(mdw_cmd_cache);
+		mdw_cmd_cache = NULL;
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+void mdw_cmd_exit(void)
+{
+	kmem_cache_destroy(mdw_sc_cache);
+	kmem_cache_destroy(mdw_cmd_cache);
+}
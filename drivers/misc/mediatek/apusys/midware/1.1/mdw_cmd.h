@@ -20,9 +20,28 @@ enum {
 	MDW_CMD_STATE_ABORT,
 };
 
+/*
+ * pre-registered cmd, the cmdbuf is mapped and its layout validated
+ * once, then each run only copies the validated hdr. Parameters are
+ * patched by user directly in the shared cmdbuf between runs.
+ */
+struct mdw_cmd_tmpl {
+	int id;
+	struct apusys_kmem cmdbuf;
+	uint32_t size;
+
+	struct apu_cmd_hdr hdr; // validated copy
+
+	atomic_t busy; // one run in flight, cleared at cmd delete
+	struct kref ref;
+};
+
 struct mdw_apu_cmd {
 	struct apu_cmd_hdr *u_hdr; // from user
 	struct apu_cmd_hdr *hdr; // copied
+	struct apu_cmd_hdr hdr_buf; // storage of hdr
+	struct apusys_kmem km; // storage of cmdbuf
+	struct mdw_cmd_tmpl *tmpl; // run from template
 	struct apu_fence_hdr *uf_hdr; // from user
 	struct file *file; // Fence sync file
 	uint32_t size;
@@ -44,6 +63,8 @@ struct mdw_apu_cmd {
 	uint8_t ctx_cnt[MDW_CMD_SC_MAX]; // ctx count
 	uint8_t ctx_repo[MDW_CMD_SC_MAX]; // ctx tmp storage
 	uint8_t pack_cnt[MDW_CMD_SC_MAX]; // pack count
+	uint8_t sc_ctx[MDW_CMD_SC_MAX]; // mem_ctx of each sc when counted
+	uint8_t sc_pack[MDW_CMD_SC_MAX]; // pack_id of each sc when counted
 	struct list_head di_list; //for dispr item
 
 	struct timespec64 start_ts;
@@ -56,6 +77,14 @@ struct mdw_apu_cmd {
 	struct mutex mtx;
 	struct completion cmplt;
 
+	/* completion ring */
+	bool ring;
+	uint64_t cookie;
+	struct list_head ring_item; // to usr ring list, del at post
+	struct list_head tmo_item; // to abort list of ring timeout
+	unsigned long ring_deadline; // jiffies
+	int ring_err; // set when aborted by usr
+
 	/* perf info */
 	struct timespec ts_create;
 	struct timespec ts_delete;
@@ -64,6 +93,7 @@ struct mdw_apu_cmd {
 struct mdw_apu_sc {
 	struct apu_sc_hdr_cmn *u_hdr; // from user
 	struct apu_sc_hdr_cmn *hdr; // copied
+	struct apu_sc_hdr_cmn hdr_buf; // storage of hdr
 	void *d_hdr;
 	struct mdw_apu_cmd *parent;
 	uint64_t kva;
@@ -127,9 +157,19 @@ struct mdw_cmd_parser {
 	int (*set_hnd)(struct mdw_apu_sc *sc, int d_idx, void *h);
 	void (*clr_hnd)(struct mdw_apu_sc *sc, void *h);
 	bool (*is_deadline)(struct mdw_apu_sc *sc);
+	struct mdw_cmd_tmpl *(*create_tmpl)(int fd, uint32_t size,
+			uint32_t ofs);
+	void (*put_tmpl)(struct mdw_cmd_tmpl *t);
+	struct mdw_apu_cmd *(*create_cmd_tmpl)(struct mdw_cmd_tmpl *t,
+			struct mdw_usr *u);
+	bool (*get_cmd)(struct mdw_apu_cmd *c);
+	void (*put_cmd)(struct mdw_apu_cmd *c);
 };
 struct mdw_cmd_parser *mdw_cmd_get_parser(void);
 
+int mdw_cmd_init(void);
+void mdw_cmd_exit(void);
+
 uint64_t mdw_cmd_get_magic(void);
 uint32_t mdw_cmd_get_ver(void);
 int mdw_wait_cmd(struct mdw_usr *u, struct mdw_apu_cmd *c);
@@ -34,11 +34,15 @@ static int mdw_open(struct inode *, struct file *);
 static int mdw_release(struct inode *, struct file *);
 static long mdw_ioctl(struct file *, unsigned int, unsigned long);
 static long mdw_compat_ioctl(struct file *, unsigned int, unsigned long);
+static int mdw_mmap(struct file *, struct vm_area_struct *);
+static unsigned int mdw_poll(struct file *, poll_table *);
 
 static const struct file_operations mdw_fops = {
 	.open = mdw_open,
 	.unlocked_ioctl = mdw_ioctl,
 	.compat_ioctl = mdw_compat_ioctl,
+	.mmap = mdw_mmap,
+	.poll = mdw_poll,
 	.release = mdw_release,
 };
 
@@ -60,11 +64,31 @@ static int mdw_release(struct inode *inode, struct file *filp)
 	struct mdw_usr *u;
 
 	u = filp->private_data;
+	/* nobody reads the ring anymore */
+	mdw_usr_ring_cancel(u);
 	mdw_usr_put(u);
 
 	return 0;
 }
 
+static int mdw_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	struct mdw_usr *u;
+
+	u = filp->private_data;
+
+	return mdw_usr_cmpl_mmap(u, vma);
+}
+
+static unsigned int mdw_poll(struct file *filp, poll_table *wait)
+{
+	struct mdw_usr *u;
+
+	u = filp->private_data;
+
+	return mdw_usr_cmpl_poll(u, filp, wait);
+}
+
 static int mdw_probe(struct platform_device *pdev)
 {
 	int ret = 0;
@@ -94,10 +118,23 @@ static int mdw_probe(struct platform_device *pdev)
 	mdw_sysfs_init(mdw_miscdev.this_device);
 	mdw_tag_init();
 	mdw_mem_init();
+	ret = mdw_cmd_init();
+	if (ret) {
+		mdw_drv_err("init cmd fail(%d)\n", ret);
+		goto fail_cmd_init;
+	}
 	mdw_rsc_init();
 	mdw_usr_init();
 	mdw_drv_info("-\n");
+	goto out;
 
+fail_cmd_init:
+	mdw_mem_exit();
+	mdw_tag_exit();
+	mdw_sysfs_exit();
+	mdw_dbg_exit();
+	misc_deregister(&mdw_miscdev);
+	mdw_device = NULL;
 out:
 	return ret;
 }
@@ -108,6 +145,7 @@ static int mdw_remove(struct platform_device *pdev)
 
 	mdw_usr_exit();
 	mdw_rsc_exit();
+	mdw_cmd_exit();
 	mdw_mem_exit();
 	mdw_tag_exit();
 	mdw_sysfs_exit();
@@ -184,6 +222,7 @@ static long mdw_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 	struct apusys_ioctl_power upwr;
 	struct apusys_ioctl_ucmd uc;
 	struct apusys_ioctl_sec us;
+	struct apusys_ioctl_tmpl ut;
 
 	u = (struct mdw_usr *)filp->private_data;
 
@@ -303,6 +342,59 @@ static long mdw_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 		ret = mdw_usr_wait_cmd(u, &ucmd);
 		break;
 
+	case APUSYS_IOCTL_CMD_REGISTER:
+		if (copy_from_user(&ucmd, (void *)arg,
+			sizeof(struct apusys_ioctl_cmd))) {
+			mdw_drv_err("copy cmd struct fail\n");
+			ret = -EINVAL;
+			goto out;
+		}
+
+		ret = mdw_usr_cmd_register(u, &ucmd);
+		if (ret)
+			goto out;
+
+		if (copy_to_user((void *)arg, &ucmd,
+			sizeof(struct apusys_ioctl_cmd))) {
+			mdw_drv_err("copy cmd struct to u fail\n");
+			mdw_usr_cmd_unregister(u, &ucmd);
+			ret = -EINVAL;
+		}
+		break;
+
+	case APUSYS_IOCTL_CMD_UNREGISTER:
+		if (copy_from_user(&ucmd, (void *)arg,
+			sizeof(struct apusys_ioctl_cmd))) {
+			mdw_drv_err("copy cmd struct fail\n");
+			ret = -EINVAL;
+			goto out;
+		}
+
+		ret = mdw_usr_cmd_unregister(u, &ucmd);
+		break;
+
+	case APUSYS_IOCTL_RUN_CMD_TMPL:
+		if (copy_from_user(&ut, (void *)arg,
+			sizeof(struct apusys_ioctl_tmpl))) {
+			mdw_drv_err("copy tmpl struct fail\n");
+			ret = -EINVAL;
+			goto out;
+		}
+
+		ret = mdw_usr_run_cmd_tmpl(u, &ut);
+		/* ring run has no id, its cookie comes back from the ring */
+		if (ret || (ut.flags & APUSYS_RUN_FLAG_CMPL_RING))
+			break;
+
+		/* run is submitted already, it's aborted at release w/o id */
+		if (copy_to_user(
+			&((struct apusys_ioctl_tmpl __user *)arg)->cmd_id,
+			&ut.cmd_id, sizeof(ut.cmd_id))) {
+			mdw_drv_err("copy tmpl cmd id to u fail\n");
+			ret = -EFAULT;
+		}
+		break;
+
 	case APUSYS_IOCTL_SET_POWER:
 		ret = copy_from_user(&upwr, (void *)arg,
 			sizeof(struct apusys_ioctl_power));
@@ -404,6 +496,9 @@ static long mdw_compat_ioctl(struct file *flip, unsigned int cmd,
 	case APUSYS_IOCTL_SEC_DEVICE_UNLOCK:
 	case APUSYS_IOCTL_MEM_MAP:
 	case APUSYS_IOCTL_MEM_UNMAP:
+	case APUSYS_IOCTL_CMD_REGISTER:
+	case APUSYS_IOCTL_CMD_UNREGISTER:
+	case APUSYS_IOCTL_RUN_CMD_TMPL:
 	{
 		return flip->f_op->unlocked_ioctl(flip, cmd,
 					(unsigned long)compat_ptr(arg));
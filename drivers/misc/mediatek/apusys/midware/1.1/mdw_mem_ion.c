@@ -13,10 +13,16 @@
 
 #include <linux/dma-buf.h>
 #include <linux/dma-mapping.h>
+#include <linux/fs.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/workqueue.h>
+#include <linux/debugfs.h>
 #include <asm/mman.h>
 
 #include "mdw_cmn.h"
 #include "mdw_mem_cmn.h"
+#include "mdw_queue.h"
 
 #define APUSYS_ION_PAGE_SIZE PAGE_SIZE
 
@@ -59,32 +65,200 @@ static int mdw_mem_ion_check(struct apusys_kmem *mem)
 
 	return ret;
 }
-#endif
 
-static uint32_t mdw_mem_ion_get_size(struct apusys_kmem *mem)
+#define MDW_MEM_CACHE_MAX (64)
+#define MDW_MEM_CACHE_REAP_MS (1000)
+
+/*
+ * imported buffer kept imported/mapped across cmds, keyed by dma-buf.
+ * ion client is shared by all users, so one buffer has one handle and
+ * one entry no matter which process imports it.
+ */
+struct mdw_mem_ion_ce {
+	struct dma_buf *dbuf; // ref held while cached
+	struct ion_handle *hnd; // import ref held while cached
+	void *kva;
+	uint32_t iova;
+	uint32_t iova_size;
+	bool iova_valid;
+
+	uint32_t kva_ref;
+	uint32_t iova_ref;
+	struct list_head item; // to lru, most recent first
+};
+
+struct mdw_mem_ion_cache {
+	struct list_head lru;
+	struct mutex mtx;
+	struct delayed_work reap;
+	uint32_t num;
+	uint32_t max;
+
+	/* stats */
+	uint64_t hit;
+	uint64_t miss;
+	uint64_t evict;
+	uint64_t release;
+	struct dentry *dbg_dir;
+};
+
+static struct mdw_mem_ion_cache ion_cache;
+
+static bool mdw_mem_ion_ce_idle(struct mdw_mem_ion_ce *ce)
 {
-	uint32_t size = 0;
-	struct dma_buf *db = NULL;
+	return !ce->kva_ref && !ce->iova_ref;
+}
+
+/* only cache holds the dma-buf, user has released it */
+static bool mdw_mem_ion_ce_stale(struct mdw_mem_ion_ce *ce)
+{
+	return file_count(ce->dbuf->file) == 1;
+}
+
+static void mdw_mem_ion_ce_destroy(struct mdw_mem_ion_ce *ce)
+{
+	mdw_mem_debug("ce(%p) destroy hnd(%p) kva(%p) iova(0x%x)\n",
+		ce, ce->hnd, ce->kva, ce->iova);
+
+	list_del(&ce->item);
+	ion_cache.num--;
+	if (ce->kva)
+		ion_unmap_kernel(ion_ma.client, ce->hnd);
+	ion_free(ion_ma.client, ce->hnd);
+	dma_buf_put(ce->dbuf);
+	kfree(ce);
+}
+
+/* drop idle entries released by user, then the lru ones over max */
+static void mdw_mem_ion_cache_shrink(void)
+{
+	struct mdw_mem_ion_ce *ce = NULL, *tmp = NULL;
+
+	list_for_each_entry_safe_reverse(ce, tmp, &ion_cache.lru, item) {
+		if (!mdw_mem_ion_ce_idle(ce))
+			continue;
+
+		if (mdw_mem_ion_ce_stale(ce)) {
+			ion_cache.release++;
+			mdw_mem_ion_ce_destroy(ce);
+		} else if (ion_cache.num > ion_cache.max) {
+			ion_cache.evict++;
+			mdw_mem_ion_ce_destroy(ce);
+		}
+	}
+}
+
+static void mdw_mem_ion_cache_reap(struct work_struct *work)
+{
+	mutex_lock(&ion_cache.mtx);
+	mdw_mem_ion_cache_shrink();
+	if (ion_cache.num)
+		schedule_delayed_work(&ion_cache.reap,
+			msecs_to_jiffies(MDW_MEM_CACHE_REAP_MS));
+	mutex_unlock(&ion_cache.mtx);
+}
+
+static struct mdw_mem_ion_ce *mdw_mem_ion_cache_get(int fd)
+{
+	struct mdw_mem_ion_ce *ce = NULL;
+	struct dma_buf *dbuf = NULL;
+
+	dbuf = dma_buf_get(fd);
+	if (IS_ERR(dbuf)) {
+		mdw_drv_err("get dmabuf from fd(%d) fail\n", fd);
+		return NULL;
+	}
+
+	list_for_each_entry(ce, &ion_cache.lru, item) {
+		if (ce->dbuf == dbuf) {
+			dma_buf_put(dbuf);
+			list_move(&ce->item, &ion_cache.lru);
+			ion_cache.hit++;
+			return ce;
+		}
+	}
+
+	ion_cache.miss++;
+	ce = kzalloc(sizeof(*ce), GFP_KERNEL);
+	if (!ce)
+		goto fail_alloc_ce;
+
+	ce->hnd = ion_import_dma_buf_fd(ion_ma.client, fd);
+	if (IS_ERR_OR_NULL(ce->hnd))
+		goto fail_import;
+
+	ce->dbuf = dbuf;
+	list_add(&ce->item, &ion_cache.lru);
+	ion_cache.num++;
+
+	if (!delayed_work_pending(&ion_cache.reap))
+		schedule_delayed_work(&ion_cache.reap,
+			msecs_to_jiffies(MDW_MEM_CACHE_REAP_MS));
+
+	return ce;
+
+fail_import:
+	kfree(ce);
+fail_alloc_ce:
+	dma_buf_put(dbuf);
+	return NULL;
+}
+
+static struct mdw_mem_ion_ce *mdw_mem_ion_cache_find(uint64_t khandle)
+{
+	struct mdw_mem_ion_ce *ce = NULL;
 
-	db = dma_buf_get(mem->fd);
-	if (IS_ERR(db)) {
-		mdw_drv_err("get dmabuf from ion handle fail\n");
-		return 0;
+	list_for_each_entry(ce, &ion_cache.lru, item) {
+		if ((uint64_t)ce->hnd == khandle)
+			return ce;
 	}
 
-	size = db->size;
-	dma_buf_put(db);
+	return NULL;
+}
+
+static void mdw_mem_ion_cache_init(void)
+{
+	memset(&ion_cache, 0, sizeof(ion_cache));
+	INIT_LIST_HEAD(&ion_cache.lru);
+	mutex_init(&ion_cache.mtx);
+	INIT_DELAYED_WORK(&ion_cache.reap, mdw_mem_ion_cache_reap);
+	ion_cache.max = MDW_MEM_CACHE_MAX;
+
+	ion_cache.dbg_dir = debugfs_create_dir("mem_cache", mdw_dbg_root);
+	debugfs_create_u32("max", 0644, ion_cache.dbg_dir, &ion_cache.max);
+	debugfs_create_u32("num", 0444, ion_cache.dbg_dir, &ion_cache.num);
+	debugfs_create_u64("hit", 0444, ion_cache.dbg_dir, &ion_cache.hit);
+	debugfs_create_u64("miss", 0444, ion_cache.dbg_dir, &ion_cache.miss);
+	debugfs_create_u64("evict", 0444, ion_cache.dbg_dir,
+		&ion_cache.evict);
+	debugfs_create_u64("release", 0444, ion_cache.dbg_dir,
+		&ion_cache.release);
+}
+
+static void mdw_mem_ion_cache_destroy(void)
+{
+	struct mdw_mem_ion_ce *ce = NULL, *tmp = NULL;
+
+	cancel_delayed_work_sync(&ion_cache.reap);
+	debugfs_remove_recursive(ion_cache.dbg_dir);
 
-	return size;
+	mutex_lock(&ion_cache.mtx);
+	list_for_each_entry_safe(ce, tmp, &ion_cache.lru, item) {
+		if (!mdw_mem_ion_ce_idle(ce))
+			mdw_drv_warn("ce(%p) still used(%u/%u)\n",
+				ce, ce->kva_ref, ce->iova_ref);
+		mdw_mem_ion_ce_destroy(ce);
+	}
+	mutex_unlock(&ion_cache.mtx);
 }
+#endif
 
 static int mdw_mem_ion_map_kva(struct apusys_kmem *mem)
 {
 #if !defined(CONFIG_MTK_IOMMU_V2)
 	int ret = -ENODEV;
 #else
-	void *buffer = NULL;
-	struct ion_handle *ion_hnd = NULL;
+	struct mdw_mem_ion_ce *ce = NULL;
 	uint32_t size = 0;
 	int ret = 0;
 
@@ -94,13 +268,17 @@ static int mdw_mem_ion_map_kva(struct apusys_kmem *mem)
 		return -EINVAL;
 	}
 
+	mutex_lock(&ion_cache.mtx);
+
 	/* import fd */
-	ion_hnd = ion_import_dma_buf_fd(ion_ma.client, mem->fd);
-	if (IS_ERR_OR_NULL(ion_hnd))
-		return -EINVAL;
+	ce = mdw_mem_ion_cache_get(mem->fd);
+	if (!ce) {
+		ret = -EINVAL;
+		goto out;
+	}
 
 	/* check size */
-	size = mdw_mem_ion_get_size(mem);
+	size = ce->dbuf->size;
 	if (size < mem->size || !size) {
 		mdw_drv_err("buffer size invalid(%u/%u)\n", size, mem->size);
 		ret = -ENOMEM;
@@ -108,30 +286,36 @@ static int mdw_mem_ion_map_kva(struct apusys_kmem *mem)
 	}
 	mdw_mem_debug("mem check size(%u/%u)\n", size, mem->size);
 
-	/* map kernel va*/
-	buffer = ion_map_kernel(ion_ma.client, ion_hnd);
-	if (IS_ERR_OR_NULL(buffer)) {
-		mdw_drv_err("map kernel va fail(%p/%p)\n",
-			ion_ma.client, ion_hnd);
-		ret = -ENOMEM;
-		goto fail_map_kernel;
+	/* map kernel va, kept until entry evicted */
+	if (!ce->kva) {
+		ce->kva = ion_map_kernel(ion_ma.client, ce->hnd);
+		if (IS_ERR_OR_NULL(ce->kva)) {
+			mdw_drv_err("map kernel va fail(%p/%p)\n",
+				ion_ma.client, ce->hnd);
+			ce->kva = NULL;
+			ret = -ENOMEM;
+			goto fail_map_kernel;
+		}
 	}
+	ce->kva_ref++;
 
 	if (!mem->khandle)
-		mem->khandle = (uint64_t)ion_hnd;
-	mem->kva = (uint64_t)buffer;
+		mem->khandle = (uint64_t)ce->hnd;
+	mem->kva = (uint64_t)ce->kva;
 
 	mdw_mem_debug("mem(%d/0x%llx/0x%x/%d/0x%x/0x%llx/0x%llx)\n",
 			mem->fd, mem->uva, mem->iova, mem->size,
 			mem->iova_size, mem->khandle, mem->kva);
 
-	return 0;
+	goto out;
 
 fail_map_kernel:
 	mdw_drv_err("mem(%d/0x%llx/0x%x/%d/0x%x/0x%llx/0x%llx)\n",
 			mem->fd, mem->uva, mem->iova, mem->size,
 			mem->iova_size, mem->khandle, mem->kva);
-	ion_free(ion_ma.client, ion_hnd);
+out:
+	mdw_mem_ion_cache_shrink();
+	mutex_unlock(&ion_cache.mtx);
 #endif
 	return ret;
 }
@@ -142,23 +326,29 @@ static int mdw_mem_ion_map_iova(struct apusys_kmem *mem)
 	int ret = -ENODEV;
 #else
 	int ret = 0;
-	struct ion_handle *ion_hnd = NULL;
+	struct mdw_mem_ion_ce *ce = NULL;
 	struct ion_mm_data mm_data;
 
 	/* check argument */
 	if (mdw_mem_ion_check(mem))
 		return -EINVAL;
 
+	mutex_lock(&ion_cache.mtx);
+
 	/* import fd */
-	ion_hnd = ion_import_dma_buf_fd(ion_ma.client, mem->fd);
+	ce = mdw_mem_ion_cache_get(mem->fd);
+	if (!ce) {
+		ret = -EINVAL;
+		goto out;
+	}
 
-	if (IS_ERR_OR_NULL(ion_hnd))
-		return -EINVAL;
+	if (ce->iova_valid)
+		goto done;
 
 	/* use get_iova replace config_buffer & get_phys*/
 	memset((void *)&mm_data, 0, sizeof(struct ion_mm_data));
 	mm_data.mm_cmd = ION_MM_GET_IOVA;
-	mm_data.get_phys_param.kernel_handle = ion_hnd;
+	mm_data.get_phys_param.kernel_handle = ce->hnd;
 	mm_data.get_phys_param.module_id = APUSYS_IOMMU_PORT;
 	mm_data.get_phys_param.coherent = 1;
 	mm_data.get_phys_param.phy_addr =
@@ -168,26 +358,34 @@ static int mdw_mem_ion_map_iova(struct apusys_kmem *mem)
 			(unsigned long)&mm_data)) {
 		mdw_drv_err("ion_config_buffer: ION_CMD_MULTIMEDIA failed\n");
 		ret = -ENOMEM;
-		goto free_import;
+		goto fail_get_iova;
 	}
 
-	mem->iova = mm_data.get_phys_param.phy_addr;
-	mem->iova_size = mm_data.get_phys_param.len;
+	ce->iova = mm_data.get_phys_param.phy_addr;
+	ce->iova_size = mm_data.get_phys_param.len;
+	ce->iova_valid = true;
+
+done:
+	ce->iova_ref++;
+	mem->iova = ce->iova;
+	mem->iova_size = ce->iova_size;
 
 	if (!mem->khandle)
-		mem->khandle = (uint64_t)ion_hnd;
+		mem->khandle = (uint64_t)ce->hnd;
 
 	mdw_mem_debug("mem(%d/0x%llx/0x%x/%d/0x%x/0x%llx/0x%llx)\n",
 			mem->fd, mem->uva, mem->iova, mem->size,
 			mem->iova_size, mem->khandle, mem->kva);
 
-	return ret;
+	goto out;
 
-free_import:
+fail_get_iova:
 	mdw_drv_err("mem(%d/0x%llx/0x%x/%d/0x%x/0x%llx/0x%llx)\n",
 			mem->fd, mem->uva, mem->iova, mem->size,
 			mem->iova_size, mem->khandle, mem->kva);
-	ion_free(ion_ma.client, ion_hnd);
+out:
+	mdw_mem_ion_cache_shrink();
+	mutex_unlock(&ion_cache.mtx);
 #endif
 	return ret;
 }
@@ -198,7 +396,7 @@ static int mdw_mem_ion_unmap_iova(struct apusys_kmem *mem)
 		int ret = -ENODEV;
 #else
 	int ret = 0;
-	struct ion_handle *ion_hnd = NULL;
+	struct mdw_mem_ion_ce *ce = NULL;
 
 	/* check argument */
 	if (mdw_mem_ion_check(mem))
@@ -210,13 +408,21 @@ static int mdw_mem_ion_unmap_iova(struct apusys_kmem *mem)
 		return -EINVAL;
 	}
 
-	ion_hnd = (struct ion_handle *) mem->khandle;
-
 	mdw_mem_debug("mem(%d/0x%llx/0x%x/%d/0x%x/0x%llx/0x%llx)\n",
 			mem->fd, mem->uva, mem->iova, mem->size,
 			mem->iova_size, mem->khandle, mem->kva);
 
-	ion_free(ion_ma.client, ion_hnd);
+	/* iova stays mapped until entry evicted */
+	mutex_lock(&ion_cache.mtx);
+	ce = mdw_mem_ion_cache_find(mem->khandle);
+	if (!ce || !ce->iova_ref) {
+		mdw_drv_err("no iova ref of handle(0x%llx)\n", mem->khandle);
+		ret = -EINVAL;
+	} else {
+		ce->iova_ref--;
+		mdw_mem_ion_cache_shrink();
+	}
+	mutex_unlock(&ion_cache.mtx);
 #endif
 	return ret;
 }
@@ -226,7 +432,7 @@ static int mdw_mem_ion_unmap_kva(struct apusys_kmem *mem)
 #if !defined(CONFIG_MTK_IOMMU_V2)
 	int ret = -ENODEV;
 #else
-	struct ion_handle *ion_hnd = NULL;
+	struct mdw_mem_ion_ce *ce = NULL;
 	int ret = 0;
 
 	/* check argument */
@@ -243,11 +449,17 @@ static int mdw_mem_ion_unmap_kva(struct apusys_kmem *mem)
 			mem->fd, mem->uva, mem->iova, mem->size,
 			mem->iova_size, mem->khandle, mem->kva);
 
-	ion_hnd = (struct ion_handle *) mem->khandle;
-
-	ion_unmap_kernel(ion_ma.client, ion_hnd);
-
-	ion_free(ion_ma.client, ion_hnd);
+	/* kva stays mapped until entry evicted */
+	mutex_lock(&ion_cache.mtx);
+	ce = mdw_mem_ion_cache_find(mem->khandle);
+	if (!ce || !ce->kva_ref) {
+		mdw_drv_err("no kva ref of handle(0x%llx)\n", mem->khandle);
+		ret = -EINVAL;
+	} else {
+		ce->kva_ref--;
+		mdw_mem_ion_cache_shrink();
+	}
+	mutex_unlock(&ion_cache.mtx);
 #endif
 	return ret;
 }
@@ -271,6 +483,8 @@ static int mdw_mem_ion_flush(struct apusys_kmem *mem)
 	struct ion_sys_data sys_data;
 	void *va = NULL;
 	struct ion_handle *ion_hnd = NULL;
+	struct mdw_mem_ion_ce *ce = NULL;
+	bool cached = false;
 
 	mdw_mem_debug("\n");
 
@@ -280,9 +494,20 @@ static int mdw_mem_ion_flush(struct apusys_kmem *mem)
 	}
 	ion_hnd = (struct ion_handle *)mem->khandle;
 
-	va = ion_map_kernel(ion_ma.client, ion_hnd);
-	if (IS_ERR_OR_NULL(va))
-		return -ENOMEM;
+	/* reuse kva of cached entry if any */
+	mutex_lock(&ion_cache.mtx);
+	ce = mdw_mem_ion_cache_find(mem->khandle);
+	if (ce && ce->kva) {
+		va = ce->kva;
+		cached = true;
+	} else {
+		va = ion_map_kernel(ion_ma.client, ion_hnd);
+		if (IS_ERR_OR_NULL(va)) {
+			mutex_unlock(&ion_cache.mtx);
+			return -ENOMEM;
+		}
+	}
+
 	sys_data.sys_cmd = ION_SYS_CACHE_SYNC;
 	sys_data.cache_sync_param.kernel_handle = ion_hnd;
 	sys_data.cache_sync_param.sync_type = ION_CACHE_FLUSH_BY_RANGE;
@@ -293,7 +518,9 @@ static int mdw_mem_ion_flush(struct apusys_kmem *mem)
 		mdw_drv_err("ION_CACHE_FLUSH_BY_RANGE FAIL\n");
 		ret = -EINVAL;
 	}
-	ion_unmap_kernel(ion_ma.client, ion_hnd);
+	if (!cached)
+		ion_unmap_kernel(ion_ma.client, ion_hnd);
+	mutex_unlock(&ion_cache.mtx);
 #endif
 	return ret;
 }
@@ -307,6 +534,8 @@ static int mdw_mem_ion_invalidate(struct apusys_kmem *mem)
 	struct ion_sys_data sys_data;
 	void *va = NULL;
 	struct ion_handle *ion_hnd = NULL;
+	struct mdw_mem_ion_ce *ce = NULL;
+	bool cached = false;
 
 	if (mem->khandle == 0) {
 		mdw_drv_err("invalid argument\n");
@@ -314,9 +543,19 @@ static int mdw_mem_ion_invalidate(struct apusys_kmem *mem)
 	}
 	ion_hnd = (struct ion_handle *)mem->khandle;
 
-	va = ion_map_kernel(ion_ma.client, ion_hnd);
-	if (IS_ERR_OR_NULL(va))
-		return -ENOMEM;
+	/* reuse kva of cached entry if any */
+	mutex_lock(&ion_cache.mtx);
+	ce = mdw_mem_ion_cache_find(mem->khandle);
+	if (ce && ce->kva) {
+		va = ce->kva;
+		cached = true;
+	} else {
+		va = ion_map_kernel(ion_ma.client, ion_hnd);
+		if (IS_ERR_OR_NULL(va)) {
+			mutex_unlock(&ion_cache.mtx);
+			return -ENOMEM;
+		}
+	}
 
 	sys_data.sys_cmd = ION_SYS_CACHE_SYNC;
 	sys_data.cache_sync_param.kernel_handle = ion_hnd;
@@ -328,7 +567,9 @@ static int mdw_mem_ion_invalidate(struct apusys_kmem *mem)
 		mdw_drv_err("ION_CACHE_INVALID_BY_RANGE FAIL\n");
 		ret = -EINVAL;
 	}
-	ion_unmap_kernel(ion_ma.client, ion_hnd);
+	if (!cached)
+		ion_unmap_kernel(ion_ma.client, ion_hnd);
+	mutex_unlock(&ion_cache.mtx);
 #endif
 	return ret;
 }
@@ -336,6 +577,7 @@ static int mdw_mem_ion_invalidate(struct apusys_kmem *mem)
 static void mdw_mem_ion_destroy(void)
 {
 #if defined(CONFIG_MTK_IOMMU_V2)
+	mdw_mem_ion_cache_destroy();
 	ion_client_destroy(ion_ma.client);
 	memset(&ion_ma, 0, sizeof(ion_ma));
 #endif
@@ -352,6 +594,10 @@ struct mdw_mem_ops *mdw_mem_ion_init(void)
 	if (IS_ERR_OR_NULL(ion_ma.client))
 		return NULL;
 
+#if defined(CONFIG_MTK_IOMMU_V2)
+	mdw_mem_ion_cache_init();
+#endif
+
 	ion_ma.ops.alloc = mdw_mem_ion_alloc;
 	ion_ma.ops.free = mdw_mem_ion_free;
 	ion_ma.ops.flush = mdw_mem_ion_flush;
@@ -120,6 +120,21 @@ struct mdw_apu_sc *mdw_queue_pop(int type)
 	return sc;
 }
 
+int mdw_queue_peek_deadline(int type, uint64_t *deadline)
+{
+	struct mdw_queue *mq = NULL;
+
+	/* get queue */
+	mq = mdw_rsc_get_queue(type);
+	if (!mq)
+		return -ENODEV;
+
+	if (!mq->deadline.ops.len(&mq->deadline))
+		return -ENODATA;
+
+	return mq->deadline.ops.peek(&mq->deadline, deadline);
+}
+
 int mdw_queue_insert(struct mdw_apu_sc *sc, int is_front)
 {
 	struct mdw_queue *mq = NULL;
@@ -12,6 +12,7 @@ struct mdw_queue_ops {
 	int (*task_start)(struct mdw_apu_sc *sc, void *q);
 	int (*task_end)(struct mdw_apu_sc *sc, void *q);
 	struct mdw_apu_sc *(*pop)(void *q);
+	int (*peek)(void *q, uint64_t *deadline); //deadline queue only
 	int (*insert)(struct mdw_apu_sc *sc, void *q, int is_front);
 	int (*delete)(struct mdw_apu_sc *sc, void *q);
 	int (*len)(void *q);
@@ -62,6 +63,7 @@ struct mdw_queue {
 int mdw_queue_task_start(struct mdw_apu_sc *sc);
 int mdw_queue_task_end(struct mdw_apu_sc *sc);
 struct mdw_apu_sc *mdw_queue_pop(int type);
+int mdw_queue_peek_deadline(int type, uint64_t *deadline);
 int mdw_queue_insert(struct mdw_apu_sc *sc, int is_front);
 int mdw_queue_len(int type, int is_deadline);
 int mdw_queue_delete(struct mdw_apu_sc *sc);
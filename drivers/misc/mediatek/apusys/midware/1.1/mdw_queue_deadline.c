@@ -175,6 +175,23 @@ static struct mdw_apu_sc *mdw_queue_deadline_pop(void *q)
 	return entry;
 }
 
+static int mdw_queue_deadline_peek(void *q, uint64_t *deadline)
+{
+	struct rb_node *node;
+	struct deadline_root *root = (struct deadline_root *)q;
+	int ret = -ENODATA;
+
+	mutex_lock(&root->lock);
+	node = rb_first_cached(&root->root);
+	if (node) {
+		*deadline = rb_entry(node, struct mdw_apu_sc, node)->deadline;
+		ret = 0;
+	}
+	mutex_unlock(&root->lock);
+
+	return ret;
+}
+
 static int mdw_queue_deadline_insert(struct mdw_apu_sc *sc,
 	void *q, int is_front)
 {
@@ -272,6 +289,7 @@ int mdw_queue_deadline_init(struct deadline_root *root)
 	root->ops.task_start = mdw_queue_deadline_task_start;
 	root->ops.task_end = mdw_queue_deadline_task_end;
 	root->ops.pop = mdw_queue_deadline_pop;
+	root->ops.peek = mdw_queue_deadline_peek;
 	root->ops.insert = mdw_queue_deadline_insert;
 	root->ops.delete = mdw_queue_deadline_delete;
 	root->ops.len = mdw_queue_deadline_len;
@@ -11,6 +11,8 @@
 #include <linux/kthread.h>
 #include <linux/uaccess.h>
 #include <linux/atomic.h>
+#include <linux/jiffies.h>
+#include <linux/debugfs.h>
 
 #include "mdw_cmn.h"
 #include "mdw_queue.h"
@@ -25,6 +27,19 @@
 #define CREATE_TRACE_POINTS
 #include "mdw_events.h"
 
+/* max sc dispatched by one sched pass before yielding */
+#define MDW_SCHED_PASS_MAX (32)
+
+struct mdw_sched_stat {
+	uint64_t pass;
+	uint64_t dispatch;
+	uint64_t dispatch_fail;
+	uint64_t edf_pick;
+	uint64_t done;
+	uint64_t dl_done;
+	uint64_t dl_miss;
+};
+
 struct mdw_sched_mgr {
 	struct task_struct *task;
 	struct completion cmplt;
@@ -32,6 +47,9 @@ struct mdw_sched_mgr {
 	struct list_head ds_list; //done sc list
 	struct mutex mtx;
 
+	struct mdw_sched_stat stat;
+	struct dentry *dbg_dir;
+
 	bool pause;
 	bool stop;
 };
@@ -270,6 +288,12 @@ static void mdw_sched_enque_done_sc(struct kref *ref)
 
 	mutex_lock(&ms_mgr.mtx);
 	list_add_tail(&sc->ds_item, &ms_mgr.ds_list);
+	ms_mgr.stat.done++;
+	if (cmd_parser->is_deadline(sc)) {
+		ms_mgr.stat.dl_done++;
+		if (time_after(jiffies, (unsigned long)sc->deadline))
+			ms_mgr.stat.dl_miss++;
+	}
 	mutex_unlock(&ms_mgr.mtx);
 
 	mdw_sched(NULL);
@@ -411,42 +435,68 @@ static int mdw_sched_dispatch(struct mdw_apu_sc *sc)
 	return ret;
 }
 
-static int mdw_sched_routine(void *arg)
+/*
+ * Pick the type to serve next from the types which have both queued
+ * sc and idle devices. Deadline sc are served first, earliest deadline
+ * across all types; normal sc keep the highest-type-first order.
+ */
+static int mdw_sched_pick_type(uint64_t bmp)
 {
-	int ret = 0;
-	struct mdw_apu_sc *sc = NULL;
-	uint64_t bmp = 0;
-	int t = 0;
+	uint64_t dl = 0, min_dl = 0;
+	int t = 0, type = -1;
 
-	mdw_flw_debug("\n");
+	for (t = 0; t < APUSYS_DEVICE_MAX; t++) {
+		if (!(bmp & (1ULL << t)))
+			continue;
+		if (mdw_queue_peek_deadline(t, &dl))
+			continue;
+		if (type < 0 || time_before((unsigned long)dl,
+			(unsigned long)min_dl)) {
+			type = t;
+			min_dl = dl;
+		}
+	}
 
-	while (!kthread_should_stop() && !ms_mgr.stop) {
-		ret = wait_for_completion_interruptible(&ms_mgr.cmplt);
-		if (ret)
-			mdw_drv_warn("sched ret(%d)\n", ret);
+	if (type >= 0) {
+		ms_mgr.stat.edf_pick++;
+		return type;
+	}
 
-		if (ms_mgr.pause == true)
-			continue;
+	return mdw_sched_get_type(bmp);
+}
 
-		if (!mdw_sched_sc_done()) {
-			mdw_sched(NULL);
-			goto next;
-		}
+/*
+ * Work-conserving dispatch: keep dispatching until no type has both
+ * queued sc and an idle device, so ready sc of one cmd are spread over
+ * all idle device types in a single pass. A type whose dispatch fails
+ * (e.g. pack/multi waiting for more cores) is skipped for the rest of
+ * the pass, it's rescheduled when one of its devices is put back.
+ */
+static uint64_t mdw_sched_pass(void)
+{
+	struct mdw_apu_sc *sc = NULL;
+	uint64_t bmp = 0, skip = 0;
+	int t = 0, n = 0, ret = 0;
 
-		mdw_dispr_check();
+	ms_mgr.stat.pass++;
+
+	while (n < MDW_SCHED_PASS_MAX) {
+		bmp = mdw_rsc_get_avl_bmp() & ~skip;
+		if (!bmp)
+			break;
 
-		bmp = mdw_rsc_get_avl_bmp();
-		t = mdw_sched_get_type(bmp);
+		t = mdw_sched_pick_type(bmp);
 		if (t < 0 || t >= APUSYS_DEVICE_MAX) {
 			mdw_flw_debug("nothing to sched(%d)\n", t);
-			goto next;
+			break;
 		}
 
 		/* get queue */
 		sc = mdw_queue_pop(t);
 		if (!sc) {
 			mdw_drv_err("pop sc(%d) fail\n", t);
-			goto fail_pop_sc;
+			skip |= (1ULL << t);
+			continue;
 		}
 		mdw_flw_debug("pop sc(0x%llx-#%d/%d/%llu)\n",
 			sc->parent->kid, sc->idx, sc->type, sc->period);
@@ -456,20 +506,48 @@ static int mdw_sched_routine(void *arg)
 		if (ret) {
 			mdw_flw_debug("sc(0x%llx-#%d) dispatch fail",
 				sc->parent->kid, sc->idx);
-			goto fail_exec_sc;
+			ms_mgr.stat.dispatch_fail++;
+			if (mdw_queue_insert(sc, true)) {
+				mdw_drv_err("sc(0x%llx-#%d) insert fail\n",
+					sc->parent->kid, sc->idx);
+			}
+			skip |= (1ULL << t);
+			continue;
 		}
 
-		goto next;
-
-fail_exec_sc:
-	if (mdw_queue_insert(sc, true)) {
-		mdw_drv_err("sc(0x%llx-#%d) insert fail\n",
-			sc->parent->kid, sc->idx);
+		ms_mgr.stat.dispatch++;
+		n++;
 	}
-fail_pop_sc:
-next:
+
+	return skip;
+}
+
+static int mdw_sched_routine(void *arg)
+{
+	int ret = 0;
+	uint64_t skip = 0;
+
+	mdw_flw_debug("\n");
+
+	while (!kthread_should_stop() && !ms_mgr.stop) {
+		ret = wait_for_completion_interruptible(&ms_mgr.cmplt);
+		if (ret)
+			mdw_drv_warn("sched ret(%d)\n", ret);
+
+		if (ms_mgr.pause == true)
+			continue;
+
+		if (!mdw_sched_sc_done()) {
+			mdw_sched(NULL);
+			continue;
+		}
+
+		mdw_dispr_check();
+
+		skip = mdw_sched_pass();
+
 		mdw_flw_debug("\n");
-		if (mdw_rsc_get_avl_bmp())
+		if (mdw_rsc_get_avl_bmp() & ~skip)
 			mdw_sched(NULL);
 	}
 
@@ -629,6 +707,20 @@ int mdw_sched_init(void)
 	if (!cmd_parser)
 		return -ENODEV;
 
+	ms_mgr.dbg_dir = debugfs_create_dir("sched", mdw_dbg_root);
+	debugfs_create_u64("pass", 0444, ms_mgr.dbg_dir, &ms_mgr.stat.pass);
+	debugfs_create_u64("dispatch", 0444, ms_mgr.dbg_dir,
+		&ms_mgr.stat.dispatch);
+	debugfs_create_u64("dispatch_fail", 0444, ms_mgr.dbg_dir,
+		&ms_mgr.stat.dispatch_fail);
+	debugfs_create_u64("edf_pick", 0444, ms_mgr.dbg_dir,
+		&ms_mgr.stat.edf_pick);
+	debugfs_create_u64("done", 0444, ms_mgr.dbg_dir, &ms_mgr.stat.done);
+	debugfs_create_u64("deadline_done", 0444, ms_mgr.dbg_dir,
+		&ms_mgr.stat.dl_done);
+	debugfs_create_u64("deadline_miss", 0444, ms_mgr.dbg_dir,
+		&ms_mgr.stat.dl_miss);
+
 	ms_mgr.task = kthread_run(mdw_sched_routine,
 		NULL, "apusys_sched");
 	if (!ms_mgr.task) {
@@ -646,4 +738,5 @@ void mdw_sched_exit(void)
 	ms_mgr.stop = true;
 	mdw_sched(NULL);
 	mdw_dispr_exit();
+	debugfs_remove_recursive(ms_mgr.dbg_dir);
 }
@@ -10,6 +10,7 @@
 #include <linux/slab.h>
 #include <linux/list_sort.h>
 #include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 #ifdef CONFIG_PM_SLEEP
 #include <linux/device.h>
 #include <linux/pm_wakeup.h>
@@ -29,12 +30,22 @@
 
 #define MDW_CMD_DEFAULT_TIMEOUT (30*1000) //30s
 #define MDW_CMD_MAX (32)
+#define MDW_TMPL_MAX (64)
+#define MDW_CMPL_RING_SIZE_MAX (64 * 1024)
 
 struct mdw_usr_stat {
 	struct list_head list;
 	struct mutex mtx;
 };
 
+/* ring cmds have no waiter, timeout is checked here */
+struct mdw_usr_ring_tmo {
+	struct delayed_work work;
+	spinlock_t lock;
+	unsigned long expires;
+	bool armed;
+};
+
 #ifdef CONFIG_PM_SLEEP
 static struct wakeup_source *mdw_usr_ws;
 static uint32_t ws_cnt;
@@ -45,6 +56,7 @@ struct mdw_usr_mgr u_mgr;
 static struct mdw_cmd_parser *cmd_parser;
 static struct mdw_usr_stat u_stat;
 static struct mdw_usr_mem_aee u_mem_aee;
+static struct mdw_usr_ring_tmo ring_tmo;
 
 #define LINEBAR \
 	"|--------------------------------------------------------"\
@@ -844,30 +856,141 @@ static int mdw_usr_par_apu_cmd(struct mdw_apu_cmd *c)
 	return ret;
 }
 
-int mdw_usr_run_cmd_async(struct mdw_usr *u, struct apusys_ioctl_cmd *in)
+static void mdw_usr_ring_tmo_arm(unsigned long expires)
+{
+	unsigned long delay = 0;
+
+	spin_lock(&ring_tmo.lock);
+	if (!ring_tmo.armed || time_before(expires, ring_tmo.expires)) {
+		if (time_after(expires, jiffies))
+			delay = expires - jiffies;
+		ring_tmo.armed = true;
+		ring_tmo.expires = expires;
+		mod_delayed_work(system_wq, &ring_tmo.work, delay);
+	}
+	spin_unlock(&ring_tmo.lock);
+}
+
+/*
+ * Pick ring cmds to abort, all of them if next is NULL, else the expired
+ * ones with the earliest pending deadline returned in next.
+ */
+static void mdw_usr_ring_collect(struct mdw_usr *u, int err,
+	struct list_head *abort_list, unsigned long *next, bool *pending)
 {
-	int ret = 0;
 	struct mdw_apu_cmd *c = NULL;
 
-	/* check offset to avoid oob */
-	if (in->offset) {
-		mdw_drv_err("don't support offset(%u)\n", in->offset);
-		return -EINVAL;
+	spin_lock(&u->cmpl_lock);
+	list_for_each_entry(c, &u->ring_list, ring_item) {
+		if (c->ring_err)
+			continue;
+
+		if (next && time_before(jiffies, c->ring_deadline)) {
+			if (!*pending || time_before(c->ring_deadline, *next))
+				*next = c->ring_deadline;
+			*pending = true;
+			continue;
+		}
+
+		/* cmd is done and being posted */
+		if (!cmd_parser->get_cmd(c))
+			continue;
+
+		c->ring_err = err;
+		list_add_tail(&c->tmo_item, abort_list);
 	}
+	spin_unlock(&u->cmpl_lock);
+}
 
-	c = cmd_parser->create_cmd(in->mem_fd, in->size, in->offset, u);
-	if (!c) {
-		ret = -EINVAL;
-		goto create_cmd_fail;
+static void mdw_usr_ring_abort(struct list_head *abort_list)
+{
+	struct mdw_apu_cmd *c = NULL, *tmp = NULL;
+
+	list_for_each_entry_safe(c, tmp, abort_list, tmo_item) {
+		list_del(&c->tmo_item);
+		mdw_drv_warn("ring cmd(0x%llx) abort(%d)\n", c->kid, c->ring_err);
+		cmd_parser->abort_cmd(c);
+		/* error is posted to ring at last ref */
+		cmd_parser->put_cmd(c);
 	}
+}
+
+static void mdw_usr_ring_tmo_work(struct work_struct *work)
+{
+	LIST_HEAD(abort_list);
+	struct mdw_usr *u = NULL;
+	unsigned long next = 0;
+	bool pending = false;
+
+	spin_lock(&ring_tmo.lock);
+	ring_tmo.armed = false;
+	spin_unlock(&ring_tmo.lock);
+
+	mutex_lock(&u_mgr.mtx);
+	list_for_each_entry(u, &u_mgr.list, m_item)
+		mdw_usr_ring_collect(u, -ETIME, &abort_list, &next, &pending);
+	mutex_unlock(&u_mgr.mtx);
+
+	/* last ref of cmd may drop usr, abort out of u_mgr lock */
+	mdw_usr_ring_abort(&abort_list);
+
+	if (pending)
+		mdw_usr_ring_tmo_arm(next);
+}
+
+void mdw_usr_ring_cancel(struct mdw_usr *u)
+{
+	LIST_HEAD(abort_list);
+
+	mdw_usr_ring_collect(u, -ECANCELED, &abort_list, NULL, NULL);
+	mdw_usr_ring_abort(&abort_list);
+}
+
+static void mdw_usr_ring_add(struct mdw_usr *u, struct mdw_apu_cmd *c)
+{
+	unsigned long timeout = 0;
+
+	if (c->hdr->hard_limit)
+		timeout = msecs_to_jiffies(c->hdr->hard_limit);
+	else
+		timeout = msecs_to_jiffies(MDW_CMD_DEFAULT_TIMEOUT);
+	c->ring_deadline = jiffies + timeout;
+
+	spin_lock(&u->cmpl_lock);
+	list_add_tail(&c->ring_item, &u->ring_list);
+	spin_unlock(&u->cmpl_lock);
+
+	mdw_usr_ring_tmo_arm(c->ring_deadline);
+}
+
+static void mdw_usr_ring_del(struct mdw_usr *u, struct mdw_apu_cmd *c)
+{
+	spin_lock(&u->cmpl_lock);
+	list_del_init(&c->ring_item);
+	spin_unlock(&u->cmpl_lock);
+}
+
+static int mdw_usr_submit_cmd(struct mdw_usr *u, struct mdw_apu_cmd *c,
+	unsigned long long *cmd_id)
+{
+	int ret = 0;
+
 	c->pid = u->pid;
 	c->tgid = u->tgid;
 	c->usr = u;
 
+	/* ring cmd has no id to wait, track it before sc run */
+	if (!cmd_id)
+		mdw_usr_ring_add(u, c);
+
 	ret = mdw_usr_par_apu_cmd(c);
 	if (ret)
 		goto parse_cmd_fail;
 
+	/* ring cmd is deleted at done */
+	if (!cmd_id)
+		goto out;
+
 	mutex_lock(&u->mtx);
 	c->id = idr_alloc(&u->cmds_idr, c, 1, MDW_CMD_MAX, GFP_KERNEL);
 	if (c->id <= 0) {
@@ -880,17 +1003,276 @@ int mdw_usr_run_cmd_async(struct mdw_usr *u, struct apusys_ioctl_cmd *in)
 
 	mdw_flw_debug("cmd id(0x%llx/0x%llx/%d)\n",
 		c->hdr->uid, c->kid, c->id);
-	in->cmd_id = (unsigned long long)c->id;
+	*cmd_id = (unsigned long long)c->id;
 
 	goto out;
 
 parse_cmd_fail:
+	/* submit fail is returned by ioctl, not posted */
+	if (!cmd_id)
+		mdw_usr_ring_del(u, c);
 	cmd_parser->abort_cmd(c);
-create_cmd_fail:
 out:
 	return ret;
 }
 
+int mdw_usr_run_cmd_async(struct mdw_usr *u, struct apusys_ioctl_cmd *in)
+{
+	struct mdw_apu_cmd *c = NULL;
+
+	/* check offset to avoid oob */
+	if (in->offset) {
+		mdw_drv_err("don't support offset(%u)\n", in->offset);
+		return -EINVAL;
+	}
+
+	c = cmd_parser->create_cmd(in->mem_fd, in->size, in->offset, u);
+	if (!c)
+		return -EINVAL;
+
+	return mdw_usr_submit_cmd(u, c, &in->cmd_id);
+}
+
+int mdw_usr_cmd_register(struct mdw_usr *u, struct apusys_ioctl_cmd *in)
+{
+	struct mdw_cmd_tmpl *t = NULL;
+	int id = 0;
+
+	t = cmd_parser->create_tmpl(in->mem_fd, in->size, in->offset);
+	if (!t)
+		return -EINVAL;
+
+	mutex_lock(&u->mtx);
+	id = idr_alloc(&u->tmpls_idr, t, 1, MDW_TMPL_MAX, GFP_KERNEL);
+	if (id > 0)
+		t->id = id;
+	mutex_unlock(&u->mtx);
+
+	if (id <= 0) {
+		mdw_drv_err("alloc tmpl idr fail(%d)\n", id);
+		cmd_parser->put_tmpl(t);
+		return -ENOSPC;
+	}
+
+	in->cmd_id = (unsigned long long)id;
+	mdw_flw_debug("tmpl(%d) register\n", id);
+
+	return 0;
+}
+
+int mdw_usr_cmd_unregister(struct mdw_usr *u, struct apusys_ioctl_cmd *in)
+{
+	struct mdw_cmd_tmpl *t = NULL;
+
+	mutex_lock(&u->mtx);
+	t = idr_find(&u->tmpls_idr, in->cmd_id);
+	if (t)
+		idr_remove(&u->tmpls_idr, t->id);
+	mutex_unlock(&u->mtx);
+
+	if (!t) {
+		mdw_drv_err("no tmpl(0x%llx) to unregister\n", in->cmd_id);
+		return -EINVAL;
+	}
+
+	/* running cmd holds its own ref */
+	cmd_parser->put_tmpl(t);
+
+	return 0;
+}
+
+static int mdw_usr_cmpl_get(struct mdw_usr *u)
+{
+	struct apusys_cmpl_ring *r = NULL;
+	int ret = 0;
+
+	spin_lock(&u->cmpl_lock);
+	r = u->cmpl_ring;
+	if (!r) {
+		ret = -ENODEV;
+		goto out;
+	}
+	/* unread entries plus in-flight cmds must fit in ring */
+	if (u->cmpl_head - READ_ONCE(r->tail) + u->cmpl_inflight >=
+		u->cmpl_num) {
+		ret = -EBUSY;
+		goto out;
+	}
+	u->cmpl_inflight++;
+out:
+	spin_unlock(&u->cmpl_lock);
+	if (ret)
+		return ret;
+
+	mdw_usr_get(u);
+	mdw_usr_ws_lock();
+
+	return 0;
+}
+
+void mdw_usr_cmpl_put(struct mdw_usr *u)
+{
+	spin_lock(&u->cmpl_lock);
+	u->cmpl_inflight--;
+	spin_unlock(&u->cmpl_lock);
+
+	mdw_usr_ws_unlock();
+	mdw_usr_put(u);
+}
+
+void mdw_usr_cmpl_post(struct mdw_apu_cmd *c)
+{
+	struct mdw_usr *u = c->usr;
+	struct apusys_cmpl_entry *e = NULL;
+	struct timespec64 now;
+	uint64_t us = 0;
+
+	ktime_get_ts64(&now);
+	us = (now.tv_sec - c->start_ts.tv_sec) * 1000000;
+	us += (now.tv_nsec - c->start_ts.tv_nsec) / 1000;
+
+	spin_lock(&u->cmpl_lock);
+	/* not tracked, submit fail */
+	if (list_empty(&c->ring_item)) {
+		spin_unlock(&u->cmpl_lock);
+		return;
+	}
+	list_del_init(&c->ring_item);
+
+	/* use driver owned head/num, ring hdr is writable by user */
+	e = &u->cmpl_ring->entry[u->cmpl_head % u->cmpl_num];
+	e->cookie = c->cookie;
+	if (c->ring_err)
+		e->status = c->ring_err;
+	else if (c->sc_rets || c->sc_status_bmp)
+		e->status = -EIO;
+	else
+		e->status = 0;
+	e->total_time = (uint32_t)us;
+	u->cmpl_head++;
+	smp_store_release(&u->cmpl_ring->head, u->cmpl_head);
+	spin_unlock(&u->cmpl_lock);
+
+	mdw_flw_debug("cmd(0x%llx) post cookie(0x%llx) head(%u)\n",
+		c->kid, c->cookie, u->cmpl_head);
+	wake_up_interruptible(&u->cmpl_wq);
+}
+
+int mdw_usr_run_cmd_tmpl(struct mdw_usr *u, struct apusys_ioctl_tmpl *in)
+{
+	struct mdw_cmd_tmpl *t = NULL;
+	struct mdw_apu_cmd *c = NULL;
+	bool ring = false;
+	int ret = 0;
+
+	ring = in->flags & APUSYS_RUN_FLAG_CMPL_RING ? true : false;
+
+	mutex_lock(&u->mtx);
+	t = idr_find(&u->tmpls_idr, in->handle);
+	if (t)
+		kref_get(&t->ref);
+	mutex_unlock(&u->mtx);
+
+	if (!t) {
+		mdw_drv_err("no tmpl(0x%llx)\n", in->handle);
+		return -EINVAL;
+	}
+
+	/* cmdbuf is shared by runs, only one run in flight */
+	if (atomic_cmpxchg(&t->busy, 0, 1)) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	if (ring) {
+		/* fence fd has its own waiter, don't mix with ring */
+		if (t->hdr.flags & HDR_FLAG_MASK_FENCE_EXEC) {
+			ret = -EINVAL;
+			goto fail_cmpl_get;
+		}
+		ret = mdw_usr_cmpl_get(u);
+		if (ret)
+			goto fail_cmpl_get;
+	}
+
+	c = cmd_parser->create_cmd_tmpl(t, u);
+	if (!c) {
+		ret = -EINVAL;
+		goto fail_create_cmd;
+	}
+	c->cookie = in->cookie;
+	c->ring = ring;
+
+	/* busy and ring slot are released at cmd delete from here */
+	ret = mdw_usr_submit_cmd(u, c, ring ? NULL : &in->cmd_id);
+	goto out;
+
+fail_create_cmd:
+	if (ring)
+		mdw_usr_cmpl_put(u);
+fail_cmpl_get:
+	atomic_set(&t->busy, 0);
+out:
+	cmd_parser->put_tmpl(t);
+	return ret;
+}
+
+int mdw_usr_cmpl_mmap(struct mdw_usr *u, struct vm_area_struct *vma)
+{
+	unsigned long size = vma->vm_end - vma->vm_start;
+	struct apusys_cmpl_ring *r = NULL;
+	int ret = 0;
+
+	if (vma->vm_pgoff || size > MDW_CMPL_RING_SIZE_MAX) {
+		mdw_drv_err("invalid ring pgoff/size(%lu/%lu)\n",
+			vma->vm_pgoff, size);
+		return -EINVAL;
+	}
+
+	mutex_lock(&u->mtx);
+	if (u->cmpl_ring) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	r = vmalloc_user(size);
+	if (!r) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	ret = remap_vmalloc_range(vma, r, 0);
+	if (ret) {
+		vfree(r);
+		goto out;
+	}
+
+	r->num = (size - sizeof(*r)) / sizeof(struct apusys_cmpl_entry);
+	spin_lock(&u->cmpl_lock);
+	u->cmpl_num = r->num;
+	u->cmpl_head = 0;
+	u->cmpl_ring = r;
+	spin_unlock(&u->cmpl_lock);
+	mdw_drv_debug("usr(0x%llx) ring(%u)\n", u->id, u->cmpl_num);
+out:
+	mutex_unlock(&u->mtx);
+	return ret;
+}
+
+unsigned int mdw_usr_cmpl_poll(struct mdw_usr *u, struct file *filp,
+	poll_table *wait)
+{
+	struct apusys_cmpl_ring *r = NULL;
+
+	poll_wait(filp, &u->cmpl_wq, wait);
+
+	r = u->cmpl_ring;
+	if (r && u->cmpl_head != READ_ONCE(r->tail))
+		return POLLIN | POLLRDNORM;
+
+	return 0;
+}
+
 int mdw_wait_cmd(struct mdw_usr *u, struct mdw_apu_cmd *c)
 {
 	int ret = 0, retry = 100, retry_time = 50;
@@ -1007,6 +1389,10 @@ struct mdw_usr *mdw_usr_create(void)
 	INIT_LIST_HEAD(&u->mem_list);
 	mutex_init(&u->mtx);
 	idr_init(&u->cmds_idr);
+	idr_init(&u->tmpls_idr);
+	spin_lock_init(&u->cmpl_lock);
+	init_waitqueue_head(&u->cmpl_wq);
+	INIT_LIST_HEAD(&u->ring_list);
 	get_task_comm(u->comm, current);
 	u->pid = current->pid;
 	u->tgid = current->tgid;
@@ -1050,6 +1436,7 @@ void mdw_usr_destroy(struct kref *kref)
 	struct list_head *tmp = NULL, *list_ptr = NULL;
 	struct mdw_mem *mm = NULL;
 	struct mdw_apu_cmd *c = NULL;
+	struct mdw_cmd_tmpl *t = NULL;
 	struct mdw_dev_info *d = NULL;
 	uint64_t sbmp = 0;
 	int nd_type = 0, id = 0;
@@ -1063,6 +1450,12 @@ void mdw_usr_destroy(struct kref *kref)
 		cmd_parser->abort_cmd(c);
 	}
 
+	idr_for_each_entry(&u->tmpls_idr, t, id) {
+		idr_remove(&u->tmpls_idr, id);
+		cmd_parser->put_tmpl(t);
+	}
+	idr_destroy(&u->tmpls_idr);
+
 	list_for_each_safe(list_ptr, tmp, &u->mem_list) {
 		mm = list_entry(list_ptr, struct mdw_mem, u_item);
 		list_del(&mm->u_item);
@@ -1094,6 +1487,8 @@ void mdw_usr_destroy(struct kref *kref)
 	list_del(&u->m_item);
 	mutex_unlock(&u_mgr.mtx);
 
+	/* ring cmds hold usr ref, nothing posts from here */
+	vfree(u->cmpl_ring);
 	vfree(u);
 }
 
@@ -1110,6 +1505,9 @@ int mdw_usr_init(void)
 	memset(&u_mgr, 0, sizeof(u_mgr));
 	INIT_LIST_HEAD(&u_mgr.list);
 	mutex_init(&u_mgr.mtx);
+	/*ring timeout init*/
+	spin_lock_init(&ring_tmo.lock);
+	INIT_DELAYED_WORK(&ring_tmo.work, mdw_usr_ring_tmo_work);
 	mdw_usr_ws_init();
 
 	cmd_parser = mdw_cmd_get_parser();
@@ -1121,5 +1519,6 @@ int mdw_usr_init(void)
 
 void mdw_usr_exit(void)
 {
+	cancel_delayed_work_sync(&ring_tmo.work);
 	mdw_usr_ws_destroy();
 }
@@ -11,6 +11,12 @@
 #include "mdw_cmd.h"
 #include <linux/kref.h>
 #include <linux/idr.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/mm_types.h>
+
+struct mdw_apu_cmd;
 
 struct mdw_usr_mgr {
 	struct list_head list;
@@ -31,8 +37,18 @@ struct mdw_usr {
 	struct kref	kref;
 
 	struct idr cmds_idr;
+	struct idr tmpls_idr; // registered cmds
 	struct list_head mem_list; // for mem
 	struct list_head sdev_list; // for sec dev
+
+	/* completion ring */
+	struct apusys_cmpl_ring *cmpl_ring;
+	uint32_t cmpl_num;
+	uint32_t cmpl_head;
+	uint32_t cmpl_inflight;
+	spinlock_t cmpl_lock;
+	wait_queue_head_t cmpl_wq;
+	struct list_head ring_list; // submitted ring cmds
 };
 
 void mdw_usr_dump(struct seq_file *s);
@@ -55,6 +71,16 @@ void mdw_usr_destroy(struct kref *kref);
 int mdw_usr_run_cmd_async(struct mdw_usr *u, struct apusys_ioctl_cmd *in);
 int mdw_usr_wait_cmd(struct mdw_usr *u, struct apusys_ioctl_cmd *in);
 int mdw_usr_run_cmd_sync(struct mdw_usr *u, struct apusys_ioctl_cmd *in);
+int mdw_usr_cmd_register(struct mdw_usr *u, struct apusys_ioctl_cmd *in);
+int mdw_usr_cmd_unregister(struct mdw_usr *u, struct apusys_ioctl_cmd *in);
+int mdw_usr_run_cmd_tmpl(struct mdw_usr *u, struct apusys_ioctl_tmpl *in);
+
+int mdw_usr_cmpl_mmap(struct mdw_usr *u, struct vm_area_struct *vma);
+unsigned int mdw_usr_cmpl_poll(struct mdw_usr *u, struct file *filp,
+	poll_table *wait);
+void mdw_usr_cmpl_post(struct mdw_apu_cmd *c);
+void mdw_usr_cmpl_put(struct mdw_usr *u);
+void mdw_usr_ring_cancel(struct mdw_usr *u);
 
 int mdw_usr_init(void);
 void mdw_usr_exit(void);
@@ -3,6 +3,7 @@
  * Copyright (c) 2020 MediaTek Inc.
  */
 
+#include <linux/module.h>
 #include <linux/errno.h>
 #include <linux/slab.h>
 #include <linux/delay.h>
@@ -15,6 +16,7 @@
 #include "sample_drv.h"
 
 #define SAMPLE_DEVICE_NUM 2
+#define SAMPLE_DEVICE_MAX 8
 
 #define SAMPLE_BOOST_MAGIC 87
 #define SAMPLE_OPP_MAGIC 7
@@ -53,7 +55,19 @@ struct sample_usercmd {
 	int u_write;
 };
 
-static struct sample_dev_info *sample_private[SAMPLE_DEVICE_NUM];
+static struct sample_dev_info *sample_private[SAMPLE_DEVICE_MAX];
+
+/*
+ * software-only backend for scheduler tests: number of cores to
+ * register, and execution time of requests which carry no delay_ms
+ */
+static unsigned int dev_num = SAMPLE_DEVICE_NUM;
+module_param(dev_num, uint, 0444);
+MODULE_PARM_DESC(dev_num, "number of sample cores");
+
+static unsigned int exec_us;
+module_param(exec_us, uint, 0644);
+MODULE_PARM_DESC(exec_us, "default execute time(us) of sample request");
 #if 0
 void _print_private(void *private)
 {
@@ -291,6 +305,9 @@ static int _sample_execute(struct apusys_cmd_hnd *hnd,
 	if (req->delay_ms) {
 		spl_drv_dbg("delay %d ms\n", req->delay_ms);
 		msleep(req->delay_ms);
+	} else if (exec_us) {
+		spl_drv_dbg("exec %u us\n", exec_us);
+		usleep_range(exec_us, exec_us + exec_us / 16 + 1);
 	}
 
 	tdiff = _get_time_diff_from_system(&duration);
@@ -472,7 +489,13 @@ int sample_device_init(void)
 {
 	int ret = 0, i = 0;
 
-	for (i = 0; i < SAMPLE_DEVICE_NUM; i++) {
+	if (dev_num == 0 || dev_num > SAMPLE_DEVICE_MAX) {
+		spl_drv_warn("invalid dev num(%u), use %d\n",
+			dev_num, SAMPLE_DEVICE_NUM);
+		dev_num = SAMPLE_DEVICE_NUM;
+	}
+
+	for (i = 0; i < dev_num; i++) {
 		/* allocate private info */
 		sample_private[i] =
 			kzalloc(sizeof(struct sample_dev_info), GFP_KERNEL);
@@ -536,7 +559,7 @@ int sample_device_destroy(void)
 {
 	int i = 0;
 
-	for (i = SAMPLE_DEVICE_NUM - 1; i >= 0 ; i--) {
+	for (i = dev_num - 1; i >= 0 ; i--) {
 		if (apusys_unregister_device(sample_private[i]->dev)) {
 			spl_drv_err("unregister sample dev fail\n");
 			return -EINVAL;
@@ -442,6 +442,81 @@ enum IMGSENSOR_RETURN imgsensor_i2c_write(
 	return ret;
 }
 
+enum IMGSENSOR_RETURN imgsensor_i2c_write_seg(
+		struct IMGSENSOR_I2C_CFG *pi2c_cfg,
+		u8 *pwrite_data,
+		u16 *pseg_len,
+		u32 seg_cnt,
+		u16 id,
+		int speed)
+{
+	struct IMGSENSOR_I2C_INST *pinst = pi2c_cfg->pinst;
+	enum   IMGSENSOR_RETURN    ret   = IMGSENSOR_RETURN_SUCCESS;
+	struct i2c_msg     *pmsg;
+	u8                 *pdata = pwrite_data;
+	u32 seg = 0;
+	u32 bytes;
+	u16 len;
+	int i;
+	int i2c_ret = 0;
+
+	if (pinst->pi2c_client == NULL) {
+		PK_PR_ERR("pi2c_client is NULL!\n");
+		return IMGSENSOR_RETURN_ERROR;
+	}
+
+	mutex_lock(&pi2c_cfg->i2c_mutex);
+
+	/*
+	 * Each segment is one auto-increment message: two address bytes
+	 * followed by the data. Every transfer packs a run of segments of
+	 * the same length, the batch shape write_per_cycle callers use.
+	 */
+	while (seg < seg_cnt) {
+		pmsg  = pi2c_cfg->msg;
+		bytes = 0;
+		i     = 0;
+		len   = pseg_len[seg];
+
+		while (seg < seg_cnt && i < IMGSENSOR_I2C_CMD_LENGTH_MAX &&
+		       pseg_len[seg] == len &&
+		       (i == 0 || bytes + len <= IMGSENSOR_I2C_SEG_XFER_MAX)) {
+			pmsg->addr  = id >> 1;
+			pmsg->flags = 0;
+			pmsg->len   = pseg_len[seg];
+			pmsg->buf   = pdata;
+
+			bytes += pseg_len[seg];
+			pdata += pseg_len[seg];
+			i++;
+			seg++;
+			pmsg++;
+		}
+
+		i2c_ret = mtk_i2c_transfer(
+				pinst->pi2c_client->adapter,
+				pi2c_cfg->msg,
+				i,
+				(pi2c_cfg->pinst->status.filter_msg)
+					? I2C_A_FILTER_MSG : 0,
+				((speed > 0) && (speed <= 1000))
+					? speed * 1000 : IMGSENSOR_I2C_SPEED * 1000);
+		if (i2c_ret != i) {
+			static DEFINE_RATELIMIT_STATE(ratelimit, 1 * HZ, 30);
+
+			if (__ratelimit(&ratelimit))
+				pr_info("NOTICE: I2C id %d seg write failed (%d)! speed(0=%d) (0x%x)\n",
+					id, i2c_ret, speed, *pi2c_cfg->msg[0].buf);
+			ret = IMGSENSOR_RETURN_ERROR;
+			break;
+		}
+	}
+
+	mutex_unlock(&pi2c_cfg->i2c_mutex);
+
+	return ret;
+}
+
 void imgsensor_i2c_filter_msg(struct IMGSENSOR_I2C_CFG *pi2c_cfg, bool en)
 {
 	pi2c_cfg->pinst->status.filter_msg = en;
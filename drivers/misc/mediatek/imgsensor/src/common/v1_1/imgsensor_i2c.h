@@ -92,6 +92,7 @@ struct mt_i2c {
 #define IMGSENSOR_I2C_MSG_SIZE_READ      2
 #define IMGSENSOR_I2C_BURST_WRITE_LENGTH MAX_DMA_TRANS_SIZE
 #define IMGSENSOR_I2C_CMD_LENGTH_MAX     255
+#define IMGSENSOR_I2C_SEG_XFER_MAX       765
 
 #define IMGSENSOR_I2C_BUFF_MODE_DEV      IMGSENSOR_I2C_DEV_2
 
@@ -143,6 +144,13 @@ enum IMGSENSOR_RETURN imgsensor_i2c_write(
 	u16 write_per_cycle,
 	u16 id,
 	int speed);
+enum IMGSENSOR_RETURN imgsensor_i2c_write_seg(
+	struct IMGSENSOR_I2C_CFG *pi2c_cfg,
+	u8 *pwrite_data,
+	u16 *pseg_len,
+	u32 seg_cnt,
+	u16 id,
+	int speed);
 
 void imgsensor_i2c_filter_msg(struct IMGSENSOR_I2C_CFG *pi2c_cfg, bool en);
 
@@ -0,0 +1,262 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (c) 2019 MediaTek Inc.
+ */
+
+#include <linux/bitmap.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#include "imgsensor_common.h"
+#include "imgsensor_i2c.h"
+#include "imgsensor_regseq.h"
+
+struct imgsensor_regseq_page {
+	u8 val[IMGSENSOR_REGSEQ_PAGE_SIZE];
+	DECLARE_BITMAP(valid, IMGSENSOR_REGSEQ_PAGE_SIZE);
+};
+
+int imgsensor_regseq_compile(struct imgsensor_regseq *seq,
+	const u16 *table, u32 len)
+{
+	u32 i, reg_cnt, seg_cnt = 0, run = 0;
+	u32 prev = 0, off = 0, seg = 0;
+	u8 *p;
+
+	memset(seq, 0, sizeof(*seq));
+
+	if (table == NULL || len == 0 || (len & 1)) {
+		PK_PR_ERR("[%s] invalid table, len %u\n", __func__, len);
+		return -EINVAL;
+	}
+
+	reg_cnt = len >> 1;
+
+	/* first pass, count segments */
+	for (i = 0; i < reg_cnt; i++) {
+		u32 addr = table[i << 1];
+
+		if (i == 0 || addr != prev + 1 ||
+		    run == IMGSENSOR_REGSEQ_SEG_MAX) {
+			seg_cnt++;
+			run = 0;
+		}
+		run++;
+		prev = addr;
+	}
+
+	seq->buf_len = reg_cnt + (seg_cnt << 1);
+	seq->buf = kvmalloc(seq->buf_len, GFP_KERNEL);
+	seq->seg_len = kvmalloc_array(seg_cnt, sizeof(u16), GFP_KERNEL);
+	/* worst case every register ends up in its own diff segment */
+	seq->dbuf = kvmalloc_array(reg_cnt, 3, GFP_KERNEL);
+	seq->dseg_len = kvmalloc_array(reg_cnt, sizeof(u16), GFP_KERNEL);
+	if (!seq->buf || !seq->seg_len || !seq->dbuf || !seq->dseg_len) {
+		imgsensor_regseq_free(seq);
+		return -ENOMEM;
+	}
+
+	/* second pass, emit segments */
+	run = 0;
+	p = NULL;
+	for (i = 0; i < reg_cnt; i++) {
+		u32 addr = table[i << 1];
+
+		if (i == 0 || addr != prev + 1 ||
+		    run == IMGSENSOR_REGSEQ_SEG_MAX) {
+			if (p != NULL)
+				seq->seg_len[seg++] = run + 2;
+			p = seq->buf + off;
+			*p++ = (u8)(addr >> 8);
+			*p++ = (u8)(addr & 0xFF);
+			off += 2;
+			run = 0;
+		}
+		*p++ = (u8)(table[(i << 1) + 1] & 0xFF);
+		off++;
+		run++;
+		prev = addr;
+	}
+	seq->seg_len[seg] = run + 2;
+
+	seq->seg_cnt = seg_cnt;
+	seq->reg_cnt = reg_cnt;
+
+	PK_DBG("[%s] %u regs -> %u segs, %u bytes\n",
+		__func__, reg_cnt, seg_cnt, seq->buf_len);
+
+	return 0;
+}
+
+void imgsensor_regseq_free(struct imgsensor_regseq *seq)
+{
+	kvfree(seq->buf);
+	kvfree(seq->seg_len);
+	kvfree(seq->dbuf);
+	kvfree(seq->dseg_len);
+	memset(seq, 0, sizeof(*seq));
+}
+
+static struct imgsensor_regseq_page *imgsensor_regseq_page(
+	struct imgsensor_regseq_shadow *shadow, u16 addr)
+{
+	struct imgsensor_regseq_page **ppage =
+		&shadow->page[addr >> IMGSENSOR_REGSEQ_PAGE_SHIFT];
+
+	/* an unallocated page just means the register is always written */
+	if (*ppage == NULL)
+		*ppage = kzalloc(sizeof(**ppage), GFP_KERNEL);
+
+	return *ppage;
+}
+
+static bool imgsensor_regseq_always(
+	struct imgsensor_regseq_shadow *shadow, u16 addr)
+{
+	u32 i;
+
+	for (i = 0; i < shadow->always_cnt; i++)
+		if (shadow->always[i] == addr)
+			return true;
+
+	return false;
+}
+
+/* returns true if the sensor is not known to already hold @val */
+static bool imgsensor_regseq_shadow_update(
+	struct imgsensor_regseq_shadow *shadow, u16 addr, u8 val)
+{
+	struct imgsensor_regseq_page *page;
+	u32 idx = addr & (IMGSENSOR_REGSEQ_PAGE_SIZE - 1);
+
+	if (imgsensor_regseq_always(shadow, addr))
+		return true;
+
+	page = imgsensor_regseq_page(shadow, addr);
+	if (page == NULL)
+		return true;
+
+	if (test_bit(idx, page->valid) && page->val[idx] == val)
+		return false;
+
+	page->val[idx] = val;
+	set_bit(idx, page->valid);
+
+	return true;
+}
+
+static u32 imgsensor_regseq_emit(struct imgsensor_regseq *seq,
+	u32 dseg, u32 *doff, const u8 *data, u16 addr, u32 cnt)
+{
+	u8 *p = seq->dbuf + *doff;
+
+	*p++ = (u8)(addr >> 8);
+	*p++ = (u8)(addr & 0xFF);
+	memcpy(p, data, cnt);
+
+	seq->dseg_len[dseg] = cnt + 2;
+	*doff += cnt + 2;
+
+	return cnt;
+}
+
+int imgsensor_regseq_write(struct imgsensor_regseq *seq,
+	struct imgsensor_regseq_shadow *shadow, u16 i2c_id, int speed)
+{
+	struct IMGSENSOR_I2C_CFG *pi2c_cfg = imgsensor_i2c_get_device();
+	u32 s, k, off = 0, doff = 0, dseg = 0, sent = 0;
+	int ret;
+
+	if (pi2c_cfg == NULL || seq->buf == NULL)
+		return -EINVAL;
+
+	if (shadow == NULL) {
+		ret = imgsensor_i2c_write_seg(pi2c_cfg, seq->buf,
+			seq->seg_len, seq->seg_cnt, i2c_id, speed);
+		return (ret == IMGSENSOR_RETURN_SUCCESS) ? 0 : -EIO;
+	}
+
+	/*
+	 * Split every compiled segment into runs of dirty registers. Short
+	 * clean gaps are written through, which is cheaper than starting
+	 * another message with its own address bytes. Runs keep table order,
+	 * so runs of different lengths go out in separate transfers.
+	 */
+	for (s = 0; s < seq->seg_cnt; s++) {
+		const u8 *data = seq->buf + off + 2;
+		u16 base = (seq->buf[off] << 8) | seq->buf[off + 1];
+		u32 cnt = seq->seg_len[s] - 2;
+		int start = -1, last = -1;
+
+		for (k = 0; k < cnt; k++) {
+			if (!imgsensor_regseq_shadow_update(shadow,
+					base + k, data[k]))
+				continue;
+
+			if (start >= 0 &&
+			    k - last - 1 > IMGSENSOR_REGSEQ_GAP_MAX) {
+				sent += imgsensor_regseq_emit(seq, dseg++,
+					&doff, data + start, base + start,
+					last - start + 1);
+				start = -1;
+			}
+			if (start < 0)
+				start = k;
+			last = k;
+		}
+		if (start >= 0)
+			sent += imgsensor_regseq_emit(seq, dseg++, &doff,
+				data + start, base + start, last - start + 1);
+
+		off += seq->seg_len[s];
+	}
+
+	shadow->reg_write += sent;
+	shadow->reg_skip += seq->reg_cnt - sent;
+	shadow->msg_write += dseg;
+
+	if (dseg == 0)
+		return 0;
+
+	ret = imgsensor_i2c_write_seg(pi2c_cfg, seq->dbuf,
+		seq->dseg_len, dseg, i2c_id, speed);
+	if (ret != IMGSENSOR_RETURN_SUCCESS) {
+		/* the sensor state is unknown now, resend everything */
+		imgsensor_regseq_shadow_reset(shadow);
+		return -EIO;
+	}
+
+	return 0;
+}
+
+void imgsensor_regseq_shadow_invalidate(
+	struct imgsensor_regseq_shadow *shadow, u16 addr)
+{
+	struct imgsensor_regseq_page *page =
+		shadow->page[addr >> IMGSENSOR_REGSEQ_PAGE_SHIFT];
+
+	if (page != NULL)
+		clear_bit(addr & (IMGSENSOR_REGSEQ_PAGE_SIZE - 1),
+			page->valid);
+}
+
+void imgsensor_regseq_shadow_reset(struct imgsensor_regseq_shadow *shadow)
+{
+	int i;
+
+	for (i = 0; i < IMGSENSOR_REGSEQ_PAGE_NUM; i++)
+		if (shadow->page[i] != NULL)
+			bitmap_zero(shadow->page[i]->valid,
+				IMGSENSOR_REGSEQ_PAGE_SIZE);
+}
+
+void imgsensor_regseq_shadow_free(struct imgsensor_regseq_shadow *shadow)
+{
+	int i;
+
+	for (i = 0; i < IMGSENSOR_REGSEQ_PAGE_NUM; i++) {
+		kfree(shadow->page[i]);
+		shadow->page[i] = NULL;
+	}
+}
@@ -0,0 +1,79 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Copyright (c) 2019 MediaTek Inc.
+ */
+
+#ifndef __IMGSENSOR_REGSEQ_H__
+#define __IMGSENSOR_REGSEQ_H__
+
+#include <linux/types.h>
+
+/*
+ * Register-sequence compiler for 16-bit address / 8-bit data sensor
+ * tables laid out as {addr, data, addr, data, ...}.
+ *
+ * A table is compiled once into auto-increment segments: runs of
+ * consecutive addresses become one I2C message carrying the start
+ * address and all data bytes. Table order is kept as is.
+ *
+ * A shadow image records what was last written to the sensor, so a
+ * later mode switch only sends registers whose value differs. Anything
+ * written outside a compiled sequence must invalidate its shadow entry.
+ * Volatile or self-clearing registers (stream on/off, group hold,
+ * triggers) go in the shadow's always-write list and are never skipped.
+ */
+
+/* data bytes per segment, the message also carries 2 address bytes */
+#define IMGSENSOR_REGSEQ_SEG_MAX    253
+/* clean registers bridged inside a diff run instead of a new message */
+#define IMGSENSOR_REGSEQ_GAP_MAX    2
+
+#define IMGSENSOR_REGSEQ_PAGE_SHIFT 8
+#define IMGSENSOR_REGSEQ_PAGE_SIZE  (1 << IMGSENSOR_REGSEQ_PAGE_SHIFT)
+#define IMGSENSOR_REGSEQ_PAGE_NUM   (0x10000 >> IMGSENSOR_REGSEQ_PAGE_SHIFT)
+
+struct imgsensor_regseq {
+	u8  *buf;       /* segments back to back: addr_hi, addr_lo, data... */
+	u16 *seg_len;   /* message length of each segment */
+	u32  seg_cnt;
+	u32  reg_cnt;
+	u32  buf_len;
+
+	/* scratch for diff-only writes */
+	u8  *dbuf;
+	u16 *dseg_len;
+};
+
+struct imgsensor_regseq_page;
+
+struct imgsensor_regseq_shadow {
+	struct imgsensor_regseq_page *page[IMGSENSOR_REGSEQ_PAGE_NUM];
+
+	/* registers written even when the shadow holds the value */
+	const u16 *always;
+	u32 always_cnt;
+
+	/* statistics */
+	u32 reg_write;
+	u32 reg_skip;
+	u32 msg_write;
+};
+
+int imgsensor_regseq_compile(struct imgsensor_regseq *seq,
+	const u16 *table, u32 len);
+void imgsensor_regseq_free(struct imgsensor_regseq *seq);
+
+/*
+ * Write a compiled sequence. With a NULL shadow every register is sent;
+ * otherwise only registers not known to hold the table value are sent
+ * and the shadow is updated.
+ */
+int imgsensor_regseq_write(struct imgsensor_regseq *seq,
+	struct imgsensor_regseq_shadow *shadow, u16 i2c_id, int speed);
+
+void imgsensor_regseq_shadow_invalidate(
+	struct imgsensor_regseq_shadow *shadow, u16 addr);
+void imgsensor_regseq_shadow_reset(struct imgsensor_regseq_shadow *shadow);
+void imgsensor_regseq_shadow_free(struct imgsensor_regseq_shadow *shadow);
+
+#endif
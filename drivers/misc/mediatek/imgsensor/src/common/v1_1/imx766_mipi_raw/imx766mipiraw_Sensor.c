@@ -39,6 +39,7 @@
 
 #include "imx766mipiraw_Sensor.h"
 #include "imx766_eeprom.h"
+#include "imgsensor_regseq.h"
 
 #undef VENDOR_EDIT
 
@@ -52,6 +53,15 @@
 static kal_uint8 qsc_flag;
 static kal_uint8 otp_flag;
 
+/* last values written by the compiled settings, see imx766_write_setting */
+/* mode select, software reset and group hold act on every write */
+static const u16 imx766_always_write[] = { 0x0100, 0x0103, 0x0104 };
+
+static struct imgsensor_regseq_shadow imx766_shadow = {
+	.always = imx766_always_write,
+	.always_cnt = ARRAY_SIZE(imx766_always_write),
+};
+
 
 static DEFINE_SPINLOCK(imgsensor_drv_lock);
 
@@ -405,6 +415,7 @@ static void write_cmos_sensor_8(kal_uint16 addr, kal_uint8 para)
 			(char)(para & 0xFF)};
 
 	iWriteRegI2C(pusendcmd, 3, imgsensor.i2c_write_id);
+	imgsensor_regseq_shadow_invalidate(&imx766_shadow, addr);
 }
 
 static kal_uint32 get_exp_cnt_by_scenario(kal_uint32 scenario)
@@ -461,7 +472,8 @@ static kal_uint16 imx766_table_write_cmos_sensor(kal_uint16 *para, kal_uint32 le
 			puSendCmd[tosend++] = (char)(data & 0xFF);
 			IDX += 2;
 			addr_last = addr;
-
+			imgsensor_regseq_shadow_invalidate(&imx766_shadow,
+				addr);
 		}
 		/* Write when remain buffer size is less than 3 bytes
 		 * or reach end of data
@@ -501,7 +513,8 @@ static kal_uint16 imx766_table_write_cmos_sensor(kal_uint16 *para,
 			puSendCmd[tosend++] = (char)(data & 0xFF);
 			IDX += 2;
 			addr_last = addr;
-
+			imgsensor_regseq_shadow_invalidate(&imx766_shadow,
+				addr);
 		}
 		iWriteRegI2C(puSendCmd, 3, imgsensor.i2c_write_id);
 		tosend = 0;
@@ -3227,6 +3240,73 @@ static kal_uint16 imx766_custom3_setting[] = {
 	0x3911, 0x00,
 };
 
+enum {
+	IMX766_SETTING_INIT = 0,
+	IMX766_SETTING_PREVIEW,
+	IMX766_SETTING_CAPTURE,
+	IMX766_SETTING_NORMAL_VIDEO,
+	IMX766_SETTING_CUSTOM1,
+	IMX766_SETTING_CUSTOM2,
+	IMX766_SETTING_CUSTOM3,
+	IMX766_SETTING_NUM
+};
+
+#define IMX766_SETTING(_tbl) { \
+	.table = _tbl, \
+	.len = sizeof(_tbl) / sizeof(kal_uint16), \
+}
+
+static struct {
+	kal_uint16 *table;
+	kal_uint32 len;
+	struct imgsensor_regseq seq;
+} imx766_setting[IMX766_SETTING_NUM] = {
+	[IMX766_SETTING_INIT] = IMX766_SETTING(imx766_init_setting),
+	[IMX766_SETTING_PREVIEW] = IMX766_SETTING(imx766_preview_setting),
+	[IMX766_SETTING_CAPTURE] = IMX766_SETTING(imx766_capture_30_setting),
+	[IMX766_SETTING_NORMAL_VIDEO] =
+		IMX766_SETTING(imx766_normal_video_setting),
+	[IMX766_SETTING_CUSTOM1] = IMX766_SETTING(imx766_custom1_setting),
+	[IMX766_SETTING_CUSTOM2] = IMX766_SETTING(imx766_custom2_setting),
+	[IMX766_SETTING_CUSTOM3] = IMX766_SETTING(imx766_custom3_setting),
+};
+
+static void imx766_compile_setting(void)
+{
+	int i;
+
+	for (i = 0; i < IMX766_SETTING_NUM; i++) {
+		if (imx766_setting[i].seq.buf != NULL)
+			continue;
+		if (imgsensor_regseq_compile(&imx766_setting[i].seq,
+				imx766_setting[i].table,
+				imx766_setting[i].len))
+			LOG_INF("setting %d not compiled, use table write\n", i);
+	}
+}
+
+/*
+ * Settings are sent as precompiled auto-increment bursts. A mode switch
+ * only sends registers that differ from what the previous setting left
+ * in the sensor; sensor_init() starts from an empty shadow after power on.
+ */
+static void imx766_write_setting(int idx)
+{
+	struct imgsensor_regseq *seq = &imx766_setting[idx].seq;
+
+	if (seq->buf != NULL &&
+	    !imgsensor_regseq_write(seq, &imx766_shadow,
+			imgsensor.i2c_write_id, imgsensor_info.i2c_speed)) {
+		LOG_INF("setting %d: write %u skip %u msg %u\n", idx,
+			imx766_shadow.reg_write, imx766_shadow.reg_skip,
+			imx766_shadow.msg_write);
+		return;
+	}
+
+	imx766_table_write_cmos_sensor(imx766_setting[idx].table,
+		imx766_setting[idx].len);
+}
+
 void extend_frame_length(kal_uint32 ns)
 {
 	UINT32 old_fl = imgsensor.frame_length;
@@ -3256,8 +3336,8 @@ void extend_frame_length(kal_uint32 ns)
 static void sensor_init(void)
 {
 	LOG_INF("E\n");
-	imx766_table_write_cmos_sensor(imx766_init_setting,
-		sizeof(imx766_init_setting)/sizeof(kal_uint16));
+	imgsensor_regseq_shadow_reset(&imx766_shadow);
+	imx766_write_setting(IMX766_SETTING_INIT);
 
 	/*enable temperature sensor, TEMP_SEN_CTL:*/
 	//write_cmos_sensor_8(0x0138, 0x01);
@@ -3271,8 +3351,7 @@ static void preview_setting(void)
 {
 	LOG_INF("E\n");
 
-	imx766_table_write_cmos_sensor(imx766_preview_setting,
-		sizeof(imx766_preview_setting)/sizeof(kal_uint16));
+	imx766_write_setting(IMX766_SETTING_PREVIEW);
 
 	if (otp_flag == OTP_QSC_NONE) {
 		LOG_INF("OTP no QSC Data, close qsc register");
@@ -3288,8 +3367,7 @@ static void capture_setting(kal_uint16 currefps)
 	LOG_INF("%s(PD 012515) 30 fps E! currefps:%d\n", __func__, currefps);
 	/*************MIPI output setting************/
 
-	imx766_table_write_cmos_sensor(imx766_capture_30_setting,
-		sizeof(imx766_capture_30_setting)/sizeof(kal_uint16));
+	imx766_write_setting(IMX766_SETTING_CAPTURE);
 
 	if (otp_flag == OTP_QSC_NONE) {
 		LOG_INF("OTP no QSC Data, close qsc register");
@@ -3302,8 +3380,7 @@ static void capture_setting(kal_uint16 currefps)
 static void normal_video_setting(kal_uint16 currefps)
 {
 	LOG_INF("%s E! currefps:%d\n", __func__, currefps);
-	imx766_table_write_cmos_sensor(imx766_normal_video_setting,
-	sizeof(imx766_normal_video_setting)/sizeof(kal_uint16));
+	imx766_write_setting(IMX766_SETTING_NORMAL_VIDEO);
 
 	if (otp_flag == OTP_QSC_NONE) {
 		LOG_INF("OTP no QSC Data, close qsc register");
@@ -3749,8 +3826,7 @@ static void custom1_setting(void)
 	LOG_INF("%s 240 fps E! currefps\n", __func__);
 	/*************MIPI output setting************/
 
-	imx766_table_write_cmos_sensor(imx766_custom1_setting,
-		sizeof(imx766_custom1_setting)/sizeof(kal_uint16));
+	imx766_write_setting(IMX766_SETTING_CUSTOM1);
 
 	if (otp_flag == OTP_QSC_NONE) {
 		LOG_INF("OTP no QSC Data, close qsc register");
@@ -3766,8 +3842,7 @@ static void custom2_setting(void)
 	LOG_INF("%s 480 fps E! currefps\n", __func__);
 	/*************MIPI output setting************/
 
-	imx766_table_write_cmos_sensor(imx766_custom2_setting,
-		sizeof(imx766_custom2_setting)/sizeof(kal_uint16));
+	imx766_write_setting(IMX766_SETTING_CUSTOM2);
 
 	if (otp_flag == OTP_QSC_NONE) {
 		LOG_INF("OTP no QSC Data, close qsc register");
@@ -3783,8 +3858,7 @@ static void custom3_setting(void)
 	LOG_INF("%s 4M*60 fps E! currefps\n", __func__);
 	/*************MIPI output setting************/
 
-	imx766_table_write_cmos_sensor(imx766_custom3_setting,
-		sizeof(imx766_custom3_setting)/sizeof(kal_uint16));
+	imx766_write_setting(IMX766_SETTING_CUSTOM3);
 
 	if (otp_flag == OTP_QSC_NONE) {
 		LOG_INF("OTP no QSC Data, close qsc register");
@@ -3946,6 +4020,8 @@ static kal_uint32 close(void)
 
 	write_cmos_sensor_8(0x0100, 0x00);
 	qsc_flag = 0;
+	/* power goes off after close, nothing in the sensor is known */
+	imgsensor_regseq_shadow_free(&imx766_shadow);
 	return ERROR_NONE;
 } /* close */
 
@@ -6404,6 +6480,7 @@ static struct SENSOR_FUNCTION_STRUCT sensor_func = {
 UINT32 IMX766_MIPI_RAW_SensorInit(struct SENSOR_FUNCTION_STRUCT **pfFunc)
 {
 	/* To Do : Check Sensor status here */
+	imx766_compile_setting();
 	if (pfFunc != NULL)
 		*pfFunc = &sensor_func;
 	return ERROR_NONE;
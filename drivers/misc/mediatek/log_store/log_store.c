@@ -20,6 +20,11 @@
 #include <asm/memory.h>
 #include <linux/of_fdt.h>
 #include <linux/kmsg_dump.h>
+#include <linux/math64.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+#include <linux/sched/clock.h>
+#include <linux/workqueue.h>
 
 #include "log_store_kernel.h"
 #include "upmu_common.h"
@@ -39,6 +44,9 @@ static u32 last_boot_phase;
 
 #define LOG_BLOCK_SIZE (512)
 #define EXPDB_LOG_SIZE (2*1024*1024)
+#define LOG_FLUSH_CHUNK (32*1024)
+/* room kept for one more record before a chunk is written out */
+#define LOG_FLUSH_LINE_MAX (1024)
 
 #if 0
 def CONFIG_MTK_PMIC_COMMON
@@ -160,25 +168,68 @@ void log_store_bootup(void)
 	set_boot_phase(BOOT_PHASE_ANDROID);
 }
 
-void log_store_to_emmc(void)
+/*
+ * Kernel log flush to expdb. The dumper keeps its position across calls,
+ * so every flush after the first one only appends records printed since
+ * the previous flush. Records are packed into chunks to keep the number
+ * of block writes low, and consecutive flushes of one boot extend the
+ * same LOG_LAST_KERNEL index entry instead of using up a new one.
+ */
+static struct kmsg_dumper log_store_dumper = { .active = true };
+static bool log_store_dumper_ready;
+static DEFINE_MUTEX(log_store_flush_lock);
+static int log_store_last_index = -1;
+static u32 log_store_last_start;
+static u32 log_store_last_end;
+
+static int log_store_write_chunk(int fd, int file_size,
+	struct log_emmc_header *pEmmc, const char *buff, size_t len,
+	bool *wrapped)
+{
+	int size;
+
+	if (pEmmc->offset + len + LOG_BLOCK_SIZE > EXPDB_LOG_SIZE) {
+		pEmmc->offset = 0;
+		*wrapped = true;
+	}
+	ksys_lseek(fd, file_size - EXPDB_LOG_SIZE + pEmmc->offset, 0);
+	size = ksys_write(fd, buff, len);
+	if (size < 0) {
+		pr_notice_once("write expdb failed:%d.\n", size);
+		return size;
+	}
+	pEmmc->offset += size;
+	return 0;
+}
+
+static void __log_store_to_emmc(bool verbose)
 {
 	int fd;
 	mm_segment_t fs;
-	char buff[LOG_BLOCK_SIZE];
+	char *buff;
 	struct log_emmc_header pEmmc;
-	struct kmsg_dumper dumper = { .active = true };
-	size_t len = 0;
-	int file_size, size = 0;
+	size_t len = 0, used = 0;
+	int file_size, size = 0, index;
 	struct emmc_log kernel_log_config;
+	u32 lines = 0, bytes = 0, writes = 0;
+	u64 first_seq, t_start = sched_clock();
+	bool wrapped = false;
+
+	if (!sram_header)
+		return;
+
+	buff = kmalloc(LOG_FLUSH_CHUNK, GFP_KERNEL);
+	if (!buff)
+		return;
 
+	mutex_lock(&log_store_flush_lock);
 	fs = get_fs();
 	set_fs(get_ds());
 
 	fd = ksys_open(EXPDB_PATH, O_RDWR, 0);
 	if (fd < 0) {
 		pr_notice("log_store can't open expdb file: %d.\n", fd);
-		set_fs(fs);
-		return;
+		goto out;
 	}
 
 	memset(&pEmmc, 0, sizeof(struct log_emmc_header));
@@ -189,41 +240,124 @@ void log_store_to_emmc(void)
 		pr_notice("log_store emmc header error, format it.\n");
 		memset(&pEmmc, 0, sizeof(struct log_emmc_header));
 		pEmmc.sig = LOG_EMMC_SIG;
+		log_store_last_index = -1;
 	}
 	kernel_log_config.start = pEmmc.offset;
 
-	kmsg_dump_rewind_nolock(&dumper);
-	memset(buff, 0, LOG_BLOCK_SIZE);
-	while (kmsg_dump_get_line_nolock(&dumper, true, buff,
-					 LOG_BLOCK_SIZE, &len)) {
-		if (pEmmc.offset + len + LOG_BLOCK_SIZE > EXPDB_LOG_SIZE)
-			pEmmc.offset = 0;
-		ksys_lseek(fd, file_size - EXPDB_LOG_SIZE + pEmmc.offset, 0);
-		size = ksys_write(fd, buff, len);
-		if (size < 0)
-			pr_notice_once("write expdb failed:%d.\n", size);
-		else
-			pEmmc.offset += size;
-		memset(buff, 0, LOG_BLOCK_SIZE);
+	if (!log_store_dumper_ready) {
+		kmsg_dump_rewind(&log_store_dumper);
+		log_store_dumper_ready = true;
+	}
+	first_seq = log_store_dumper.cur_seq;
+
+	while (kmsg_dump_get_line(&log_store_dumper, true, buff + used,
+				  LOG_FLUSH_CHUNK - used, &len)) {
+		used += len;
+		lines++;
+		if (LOG_FLUSH_CHUNK - used >= LOG_FLUSH_LINE_MAX)
+			continue;
+		if (log_store_write_chunk(fd, file_size, &pEmmc, buff, used,
+					  &wrapped) == 0)
+			bytes += used;
+		writes++;
+		used = 0;
+	}
+	if (used) {
+		if (log_store_write_chunk(fd, file_size, &pEmmc, buff, used,
+					  &wrapped) == 0)
+			bytes += used;
+		writes++;
+	}
+
+	/* keep growing the entry of the previous flush if it is still last */
+	index = pEmmc.reserve_flag[LOG_INDEX];
+	if (log_store_last_index >= 0 && !wrapped &&
+	    log_store_last_end == kernel_log_config.start &&
+	    (log_store_last_index + 1) % HEADER_INDEX_MAX == index) {
+		index = log_store_last_index;
+		kernel_log_config.start = log_store_last_start;
+	} else {
+		pEmmc.reserve_flag[LOG_INDEX] = (index + 1) % HEADER_INDEX_MAX;
 	}
 
 	kernel_log_config.end = pEmmc.offset;
 	kernel_log_config.type = LOG_LAST_KERNEL;
 	size = file_size - sram_header->reserve[1] +
 		sizeof(struct log_emmc_header) +
-		pEmmc.reserve_flag[LOG_INDEX] * sizeof(struct emmc_log);
+		index * sizeof(struct emmc_log);
 	ksys_lseek(fd, size, 0);
 	ksys_write(fd, (char *)&kernel_log_config, sizeof(struct emmc_log));
-	pEmmc.reserve_flag[LOG_INDEX] += 1;
-	pEmmc.reserve_flag[LOG_INDEX] = pEmmc.reserve_flag[LOG_INDEX] %
-		HEADER_INDEX_MAX;
 	ksys_lseek(fd, file_size - sram_header->reserve[1], 0);
 	ksys_write(fd, (char *)&pEmmc, sizeof(struct log_emmc_header));
 	ksys_close(fd);
+
+	log_store_last_index = index;
+	log_store_last_start = kernel_log_config.start;
+	log_store_last_end = kernel_log_config.end;
+
+	if (verbose)
+		pr_notice("log_store write expdb done, %u lines %u bytes %u writes, %llu lost, %llu us\n",
+			lines, bytes, writes,
+			log_store_dumper.cur_seq - first_seq - lines,
+			div_u64(sched_clock() - t_start, NSEC_PER_USEC));
+out:
 	set_fs(fs);
-	pr_notice("log_store write expdb done!\n");
+	mutex_unlock(&log_store_flush_lock);
+	kfree(buff);
 }
 
+void log_store_to_emmc(void)
+{
+	__log_store_to_emmc(true);
+}
+
+/*
+ * Optional periodic flush, so the log reaches expdb a little at a time
+ * instead of only in one burst on a long power key press.
+ * /sys/module/log_store/parameters/flush_ms, 0 disables it.
+ */
+static unsigned int log_store_flush_ms;
+static bool log_store_flush_ready;
+
+static void log_store_flush_work_fn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(log_store_flush_work, log_store_flush_work_fn);
+
+static void log_store_flush_work_fn(struct work_struct *work)
+{
+	unsigned int ms = READ_ONCE(log_store_flush_ms);
+
+	if (!ms)
+		return;
+	__log_store_to_emmc(false);
+	schedule_delayed_work(&log_store_flush_work, msecs_to_jiffies(ms));
+}
+
+static int param_set_log_store_flush_ms(const char *val,
+	const struct kernel_param *kp)
+{
+	int ret = param_set_uint(val, kp);
+
+	if (ret || !log_store_flush_ready)
+		return ret;
+
+	if (log_store_flush_ms)
+		mod_delayed_work(system_wq, &log_store_flush_work,
+			msecs_to_jiffies(log_store_flush_ms));
+	else
+		cancel_delayed_work(&log_store_flush_work);
+	return 0;
+}
+
+static const struct kernel_param_ops param_ops_log_store_flush_ms = {
+	.set = param_set_log_store_flush_ms,
+	.get = param_get_uint,
+};
+
+param_check_uint(flush_ms, &log_store_flush_ms);
+/* 0644: S_IRUGO | S_IWUSR */
+module_param_cb(flush_ms, &param_ops_log_store_flush_ms, &log_store_flush_ms,
+		0644);
+
 int set_emmc_config(int type, int value)
 {
 	int fd;
@@ -409,6 +543,11 @@ static const struct file_operations pl_lk_file_ops = {
 static int __init log_store_late_init(void)
 {
 	set_boot_phase(BOOT_PHASE_KERNEL);
+	log_store_flush_ready = true;
+	if (log_store_flush_ms)
+		schedule_delayed_work(&log_store_flush_work,
+			msecs_to_jiffies(log_store_flush_ms));
+
 	if (sram_dram_buff == NULL) {
 		pr_notice("log_store: sram header DRAM buff is null.\n");
 		dram_log_store_status = BUFF_ALLOC_ERROR;
@@ -590,6 +729,8 @@ static int __init log_store_early_init(void)
 #ifdef MODULE
 static void __exit log_store_exit(void)
 {
+	log_store_flush_ms = 0;
+	cancel_delayed_work_sync(&log_store_flush_work);
 	if (entry)
 		proc_remove(entry);
 }
@@ -9,6 +9,7 @@
 #include <linux/fs.h>
 #include <linux/hardirq.h>
 #include <linux/init.h>
+#include <linux/jhash.h>
 #include <linux/kallsyms.h>
 #include <linux/miscdevice.h>
 #include <linux/module.h>
@@ -143,6 +144,7 @@ int module_fun_init(void)
 
 static void ShowStatus(int flag);
 static void MonitorHangKick(int lParam);
+static void hang_blocked_show(struct seq_file *m);
 
 static void reset_hang_info(void)
 {
@@ -254,6 +256,7 @@ static int monitor_hang_show(struct seq_file *m, void *v)
 		pList = pList->next;
 	}
 	raw_spin_unlock(&white_list_lock);
+	hang_blocked_show(m);
 
 	return 0;
 }
@@ -788,6 +791,241 @@ static void get_kernel_bt(struct task_struct *tsk)
 	}
 }
 
+/*
+ * Blocked task sampler. Every second while hang detect is armed, a bounded
+ * batch of threads is visited, resuming where the previous batch stopped,
+ * so the cost of a tick does not grow with the thread count and the RCU
+ * read section stays short. Stacks of D state threads are folded into a
+ * table of unique signatures, and the time since each one last ran is
+ * added to the histogram of its wait channel.
+ */
+#define HD_SCAN_BATCH	128
+#define HD_SIG_NUM	128
+#define HD_SIG_DEPTH	16
+#define HD_WCHAN_NUM	64
+#define HD_HIST_NUM	10	/* <1s, <2s, <4s ... <256s, >=256s */
+
+struct hd_stack_sig {
+	u32 hash;
+	u32 hits;
+	u32 nr_entries;
+	pid_t pid;
+	char comm[TASK_COMM_LEN];
+	u64 first_seen;
+	u64 last_seen;
+	unsigned long entries[HD_SIG_DEPTH];
+};
+
+struct hd_wchan_hist {
+	unsigned long wchan;
+	u32 bucket[HD_HIST_NUM];
+};
+
+static struct hd_stack_sig hd_sig[HD_SIG_NUM];
+static struct hd_wchan_hist hd_hist[HD_WCHAN_NUM];
+static u32 hd_sig_evict;
+static u32 hd_hist_overflow;
+static u32 hd_scan_rounds;
+static struct task_struct *hd_scan_g, *hd_scan_t;
+static DEFINE_SPINLOCK(hd_stat_lock);
+
+static int hd_in_sched_functions(unsigned long addr)
+{
+#ifdef MODULE
+	return Pin_sched_functions(addr);
+#else
+	return in_sched_functions(addr);
+#endif
+}
+
+static void hd_record_sig(struct task_struct *t, unsigned long *entries,
+	unsigned int nr, u64 now)
+{
+	struct hd_stack_sig *sig, *victim = &hd_sig[0];
+	u32 hash = jhash(entries, nr * sizeof(unsigned long), 0);
+	int i;
+
+	/* slots are never freed, so the used ones are all in front */
+	for (i = 0; i < HD_SIG_NUM; i++) {
+		sig = &hd_sig[i];
+		if (!sig->hits) {
+			victim = sig;
+			break;
+		}
+		if (sig->hash == hash && sig->nr_entries == nr &&
+		    !memcmp(sig->entries, entries, nr * sizeof(unsigned long)))
+			goto hit;
+		if (sig->last_seen < victim->last_seen)
+			victim = sig;
+	}
+
+	sig = victim;
+	if (sig->hits)
+		hd_sig_evict++;
+	sig->hash = hash;
+	sig->hits = 0;
+	sig->nr_entries = nr;
+	sig->first_seen = now;
+	memcpy(sig->entries, entries, nr * sizeof(unsigned long));
+hit:
+	sig->hits++;
+	sig->last_seen = now;
+	sig->pid = task_pid_nr(t);
+	memcpy(sig->comm, t->comm, TASK_COMM_LEN);
+}
+
+static void hd_record_hist(unsigned long wchan, u64 blocked_ns)
+{
+	u64 sec = div_u64(blocked_ns, NSEC_PER_SEC);
+	int i, b;
+
+	for (i = 0; i < HD_WCHAN_NUM; i++)
+		if (!hd_hist[i].wchan || hd_hist[i].wchan == wchan)
+			break;
+	if (i == HD_WCHAN_NUM) {
+		hd_hist_overflow++;
+		return;
+	}
+
+	b = sec ? min_t(int, fls64(sec), HD_HIST_NUM - 1) : 0;
+	hd_hist[i].wchan = wchan;
+	hd_hist[i].bucket[b]++;
+}
+
+static void hd_sample_task(struct task_struct *t, u64 now)
+{
+	struct stack_trace trace;
+	unsigned long stacks[HD_SIG_DEPTH + 8];
+	unsigned int start, nr;
+	u64 blocked = 0;
+
+	if (t->state != TASK_UNINTERRUPTIBLE || !try_get_task_stack(t))
+		return;
+
+	trace.entries = stacks;
+	trace.nr_entries = 0;
+	trace.max_entries = ARRAY_SIZE(stacks);
+	trace.skip = 0;
+	save_stack_trace_tsk_me(t, &trace);
+#ifdef MODULE
+	Pput_task_stack(t);
+#else
+	put_task_stack(t);
+#endif
+
+	nr = trace.nr_entries;
+	if (nr && stacks[nr - 1] == ULONG_MAX)
+		nr--;
+	/* switch and scheduler frames are the same for every sleeper */
+	for (start = 0; start < nr; start++)
+		if (!hd_in_sched_functions(stacks[start]))
+			break;
+	if (start == nr)
+		return;
+	nr = min_t(unsigned int, nr - start, HD_SIG_DEPTH);
+
+#ifdef CONFIG_SCHED_INFO
+	if (now > t->sched_info.last_arrival)
+		blocked = now - t->sched_info.last_arrival;
+#endif
+
+	spin_lock(&hd_stat_lock);
+	hd_record_sig(t, &stacks[start], nr, now);
+	hd_record_hist(stacks[start], blocked);
+	spin_unlock(&hd_stat_lock);
+}
+
+static void hang_sample_blocked(void)
+{
+	struct task_struct *g, *t;
+	int batch = HD_SCAN_BATCH;
+	u64 now = local_clock();
+
+	rcu_read_lock();
+	g = hd_scan_g;
+	t = hd_scan_t;
+	if (!g || !pid_alive(g) || !pid_alive(t)) {
+		g = next_task(&init_task);
+		t = g;
+	}
+	/* the cursor stays valid for this RCU section even without a ref */
+	if (hd_scan_g) {
+		put_task_struct(hd_scan_t);
+		put_task_struct(hd_scan_g);
+		hd_scan_g = NULL;
+		hd_scan_t = NULL;
+	}
+
+	while (batch--) {
+		hd_sample_task(t, now);
+		t = next_thread(t);
+		if (t != g)
+			continue;
+		g = next_task(g);
+		t = g;
+		if (g == &init_task) {
+			hd_scan_rounds++;
+			break;
+		}
+	}
+
+	if (g != &init_task) {
+		get_task_struct(g);
+		get_task_struct(t);
+		hd_scan_g = g;
+		hd_scan_t = t;
+	}
+	rcu_read_unlock();
+}
+
+#define HD_printf(m, x...) \
+do {                \
+	if (m)          \
+		seq_printf(m, x);   \
+	else            \
+		Log2HangInfo(x);    \
+} while (0)
+
+static void hang_blocked_show(struct seq_file *m)
+{
+	struct hd_stack_sig *sig;
+	struct hd_wchan_hist *h;
+	int i, j;
+
+	spin_lock(&hd_stat_lock);
+	HD_printf(m, "blocked stacks: rounds %u, evicted %u\n",
+		hd_scan_rounds, hd_sig_evict);
+	for (i = 0; i < HD_SIG_NUM && hd_sig[i].hits; i++) {
+		sig = &hd_sig[i];
+		HD_printf(m, "sig %08x hits %u first %llu last %llu %s:%d\n",
+			sig->hash, sig->hits, sig->first_seen, sig->last_seen,
+			sig->comm, sig->pid);
+		for (j = 0; j < sig->nr_entries; j++)
+			HD_printf(m, "<%lx> %pS\n", sig->entries[j],
+				(void *)sig->entries[j]);
+	}
+
+	HD_printf(m, "blocked time: <1s <2s <4s <8s <16s <32s <64s <128s <256s >=256s\n");
+	for (i = 0; i < HD_WCHAN_NUM && hd_hist[i].wchan; i++) {
+		h = &hd_hist[i];
+		HD_printf(m, "%ps:", (void *)h->wchan);
+		for (j = 0; j < HD_HIST_NUM; j++)
+			HD_printf(m, " %u", h->bucket[j]);
+		HD_printf(m, "\n");
+	}
+	if (hd_hist_overflow)
+		HD_printf(m, "wchan overflow %u\n", hd_hist_overflow);
+	spin_unlock(&hd_stat_lock);
+}
+
+#else
+static void hang_sample_blocked(void)
+{
+}
+
+static void hang_blocked_show(struct seq_file *m)
+{
+}
 #endif
 
 static long long nsec_high(unsigned long long nsec)
@@ -1758,6 +1996,8 @@ static void hang_dump_backtrace(void)
 	system_server_exist = false;
 #endif
 	Log2HangInfo("dump backtrace start: %llu\n", local_clock());
+	if (Hang_Detect_first)
+		hang_blocked_show(NULL);
 
 	rcu_read_lock();
 	for_each_process(p) {
@@ -1937,6 +2177,7 @@ static int hang_detect_thread(void *arg)
 		.sched_priority = 99
 	};
 	struct task_struct *hd_thread;
+	int i;
 
 	sched_setscheduler(current, SCHED_FIFO, &param);
 	reset_hang_info();
@@ -1999,7 +2240,11 @@ static int hang_detect_thread(void *arg)
 			hang_detect_counter--;
 		}
 
-		msleep((HD_INTER) * 1000);
+		for (i = 0; i < HD_INTER; i++) {
+			if (hd_detect_enabled)
+				hang_sample_blocked();
+			msleep(1000);
+		}
 	}
 	return 0;
 }
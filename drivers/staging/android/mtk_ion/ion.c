@@ -104,6 +104,128 @@ void ion_dmabuf_dbg_show(struct seq_file *s)
 	mutex_unlock(&dmabuf_list.lock);
 }
 
+/*
+ * Per-pid accounting, kept up to date by ion_client_buf_add/sub so it can
+ * be reported without walking clients, handles or task files.
+ */
+struct ion_pid_acct {
+	struct rb_node node;
+	pid_t pid;
+	u32 clients;
+	u32 handles;
+	u64 size[HEAP_NUM];
+};
+
+static struct rb_root ion_pid_acct_root = RB_ROOT;
+static DEFINE_SPINLOCK(ion_pid_acct_lock);
+static int ion_pid_acct_nr;
+
+static struct ion_pid_acct *ion_pid_acct_get(pid_t pid)
+{
+	struct rb_node **p = &ion_pid_acct_root.rb_node;
+	struct rb_node *parent = NULL;
+	struct ion_pid_acct *acct, *new;
+
+	new = kzalloc(sizeof(*new), GFP_KERNEL);
+
+	spin_lock(&ion_pid_acct_lock);
+	while (*p) {
+		parent = *p;
+		acct = rb_entry(parent, struct ion_pid_acct, node);
+
+		if (pid < acct->pid) {
+			p = &(*p)->rb_left;
+		} else if (pid > acct->pid) {
+			p = &(*p)->rb_right;
+		} else {
+			acct->clients++;
+			spin_unlock(&ion_pid_acct_lock);
+			kfree(new);
+			return acct;
+		}
+	}
+	if (new) {
+		new->pid = pid;
+		new->clients = 1;
+		rb_link_node(&new->node, parent, p);
+		rb_insert_color(&new->node, &ion_pid_acct_root);
+		ion_pid_acct_nr++;
+	}
+	spin_unlock(&ion_pid_acct_lock);
+
+	return new;
+}
+
+static void ion_pid_acct_put(struct ion_pid_acct *acct)
+{
+	if (!acct)
+		return;
+
+	spin_lock(&ion_pid_acct_lock);
+	if (--acct->clients) {
+		spin_unlock(&ion_pid_acct_lock);
+		return;
+	}
+	rb_erase(&acct->node, &ion_pid_acct_root);
+	ion_pid_acct_nr--;
+	spin_unlock(&ion_pid_acct_lock);
+
+	kfree(acct);
+}
+
+static int ion_pid_acct_idx(struct ion_heap *heap)
+{
+	if (heap->type == ION_HEAP_TYPE_MULTIMEDIA_SEC)
+		return SECURE_HEAP;
+	else if (heap->type == ION_HEAP_TYPE_SYSTEM)
+		return SYSTEM_HEAP;
+	return NORMAL_HEAP;
+}
+
+static void ion_pid_acct_add(struct ion_heap *heap, struct ion_client *client,
+			     size_t size, bool add)
+{
+	struct ion_pid_acct *acct = client->acct;
+	int idx = ion_pid_acct_idx(heap);
+
+	if (!acct)
+		return;
+
+	spin_lock(&ion_pid_acct_lock);
+	if (add) {
+		acct->handles++;
+		acct->size[idx] += size;
+	} else {
+		if (acct->handles)
+			acct->handles--;
+		acct->size[idx] -= min_t(u64, acct->size[idx], size);
+	}
+	spin_unlock(&ion_pid_acct_lock);
+}
+
+int ion_pid_acct_snapshot(struct ion_acct_rec *rec, int max)
+{
+	struct rb_node *n;
+	int nr = 0;
+
+	spin_lock(&ion_pid_acct_lock);
+	for (n = rb_first(&ion_pid_acct_root); n && nr < max;
+	     n = rb_next(n), nr++) {
+		struct ion_pid_acct *acct =
+			rb_entry(n, struct ion_pid_acct, node);
+
+		rec[nr].pid = acct->pid;
+		rec[nr].clients = acct->clients;
+		rec[nr].handles = acct->handles;
+		rec[nr].reserved = 0;
+		memcpy(rec[nr].size, acct->size, sizeof(rec[nr].size));
+	}
+	nr = ion_pid_acct_nr;
+	spin_unlock(&ion_pid_acct_lock);
+
+	return nr;
+}
+
 void ion_client_buf_add(struct ion_heap *heap, struct ion_client *client,
 			size_t size)
 {
@@ -140,6 +262,7 @@ void ion_client_buf_add(struct ion_heap *heap, struct ion_client *client,
 		client->threshold_size += CLIENT_THRESHOLD_SIZE_INC;
 	}
 #endif
+	ion_pid_acct_add(heap, client, size, true);
 }
 
 void ion_client_buf_sub(struct ion_heap *heap, struct ion_client *client,
@@ -186,6 +309,7 @@ void ion_client_buf_sub(struct ion_heap *heap, struct ion_client *client,
 			client->threshold_size = CLIENT_THRESHOLD_SIZE;
 	}
 #endif
+	ion_pid_acct_add(heap, client, size, false);
 }
 
 u64 ion_client_buf_dump(struct ion_heap *heap, struct ion_client *client)
@@ -1142,6 +1266,8 @@ struct ion_client *ion_client_create(struct ion_device *dev,
 	client->name = kstrdup(name, GFP_KERNEL);
 	if (!client->name)
 		goto err_free_client;
+	/* an untracked pid only misses from clients_acct */
+	client->acct = ion_pid_acct_get(pid);
 
 	down_write(&dev->lock);
 	client->display_serial = ion_get_client_serial(&dev->clients, name);
@@ -1180,6 +1306,7 @@ struct ion_client *ion_client_create(struct ion_device *dev,
 	return client;
 
 err_free_client_name:
+	ion_pid_acct_put(client->acct);
 	kfree(client->name);
 err_free_client:
 	kfree(client);
@@ -1247,6 +1374,7 @@ void ion_client_destroy(struct ion_client *client)
 		       __func__, (time_e_lock - time_s),
 		       task_comm, pid);
 
+	ion_pid_acct_put(client->acct);
 	kfree(client->display_name);
 	kfree(client->name);
 	kfree(client);
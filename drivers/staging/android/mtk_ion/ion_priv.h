@@ -135,6 +135,8 @@ struct ion_device {
  * The mutex stored here is used to protect both handles tree
  * as well as the handles themselves, and should be held while modifying either.
  */
+struct ion_pid_acct;
+
 struct ion_client {
 	struct rb_node node;
 	struct ion_device *dev;
@@ -154,11 +156,18 @@ struct ion_client {
 #endif
 	char dbg_name[ION_MM_DBG_NAME_LEN]; /* add by K for debug! */
 	atomic64_t total_size[HEAP_NUM];
+	struct ion_pid_acct *acct;
 	int hnd_cnt;
 	int dbg_hnd_cnt;
 	unsigned long long threshold_size;
 };
 
+/*
+ * Copy the per-pid accounting into @rec, at most @max entries. Returns
+ * the number of pids currently tracked, which may exceed @max.
+ */
+int ion_pid_acct_snapshot(struct ion_acct_rec *rec, int max);
+
 struct ion_handle_debug {
 	int fd;
 	unsigned long long user_ts; /* alloc or import timestamp */
@@ -934,6 +934,72 @@ static const struct file_operations proc_client_fops = {
 #endif
 #endif
 
+#if IS_ENABLED(CONFIG_PROC_FS)
+struct ion_acct_snap {
+	size_t len;
+	char data[0];
+};
+
+/*
+ * Compact per-pid accounting for the memory governor, see struct
+ * ion_acct_hdr. The snapshot is taken at open, so reads are O(pids)
+ * and never walk clients, handles or task files.
+ */
+static int ion_proc_acct_open(struct inode *inode, struct file *file)
+{
+	struct ion_acct_snap *snap = NULL;
+	struct ion_acct_hdr *hdr;
+	int max = 0, nr, retry = 3;
+
+	do {
+		kvfree(snap);
+		snap = kvzalloc(sizeof(*snap) + sizeof(*hdr) +
+				max * sizeof(struct ion_acct_rec), GFP_KERNEL);
+		if (!snap)
+			return -ENOMEM;
+		hdr = (struct ion_acct_hdr *)snap->data;
+		nr = ion_pid_acct_snapshot((struct ion_acct_rec *)(hdr + 1),
+					   max);
+		if (nr <= max)
+			break;
+		/* leave room for pids created meanwhile */
+		max = nr + 16;
+	} while (--retry);
+
+	hdr->magic = ION_ACCT_MAGIC;
+	hdr->version = ION_ACCT_VERSION;
+	hdr->rec_size = sizeof(struct ion_acct_rec);
+	hdr->nr_rec = min(nr, max);
+	hdr->heap_num = HEAP_NUM;
+	snap->len = sizeof(*hdr) + hdr->nr_rec * sizeof(struct ion_acct_rec);
+	file->private_data = snap;
+
+	return 0;
+}
+
+static ssize_t ion_proc_acct_read(struct file *file, char __user *buf,
+				  size_t count, loff_t *ppos)
+{
+	struct ion_acct_snap *snap = file->private_data;
+
+	return simple_read_from_buffer(buf, count, ppos, snap->data,
+				       snap->len);
+}
+
+static int ion_proc_acct_release(struct inode *inode, struct file *file)
+{
+	kvfree(file->private_data);
+	return 0;
+}
+
+static const struct file_operations proc_acct_fops = {
+	.open = ion_proc_acct_open,
+	.read = ion_proc_acct_read,
+	.llseek = default_llseek,
+	.release = ion_proc_acct_release,
+};
+#endif
+
 #ifdef CONFIG_MTK_IOMMU_V2
 struct device *g_iommu_device;
 #endif
@@ -1010,6 +1076,8 @@ static int ion_drv_probe(struct platform_device *pdev)
 		    &proc_client_fops);
 	proc_symlink("ion_mm_heap", g_ion_device->proc_root,
 		     "./heaps/ion_mm_heap");
+	proc_create("clients_acct", S_IFREG | 0444,
+		    g_ion_device->proc_root, &proc_acct_fops);
 #endif
 
 	ion_history_init();
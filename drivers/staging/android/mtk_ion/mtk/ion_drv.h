@@ -78,6 +78,31 @@ enum ION_HEAP_NUM {
 	HEAP_NUM
 };
 
+/*
+ * Binary layout of /proc/ion/clients_acct: one ion_acct_hdr followed by
+ * nr_rec ion_acct_rec, one per pid owning ion clients. size[] is indexed
+ * by enum ION_HEAP_NUM and counts every handle, so a buffer shared by
+ * two pids is accounted to both.
+ */
+#define ION_ACCT_MAGIC		0x494f4e41	/* "IONA" */
+#define ION_ACCT_VERSION	1
+
+struct ion_acct_hdr {
+	__u32 magic;
+	__u16 version;
+	__u16 rec_size;
+	__u32 nr_rec;
+	__u32 heap_num;
+};
+
+struct ion_acct_rec {
+	__s32 pid;
+	__u32 clients;
+	__u32 handles;
+	__u32 reserved;
+	__u64 size[HEAP_NUM];
+};
+
 /* mm or mm_sec heap flag which is do not conflist */
 /* with ION_HEAP_FLAG_DEFER_FREE */
 #define ION_FLAG_MM_HEAP_INIT_ZERO BIT(16)
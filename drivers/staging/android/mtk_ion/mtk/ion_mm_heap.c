@@ -10,6 +10,7 @@
 #include <linux/mm.h>
 #include <linux/scatterlist.h>
 #include <linux/seq_file.h>
+#include <linux/sizes.h>
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
 #include <linux/slab.h>
@@ -110,10 +111,31 @@ static unsigned int order_to_size(int order)
 	return PAGE_SIZE << order;
 }
 
+/* pages are kept zeroed in the pools up to totalram / ratio */
+#define ION_MM_POOL_HIGH_WM_RATIO	8
+#define ION_MM_SLOW_NS			10000000ULL	/* 10ms */
+/* deferred free list drained inline per shrink_ion_by_scenario() call */
+#define ION_MM_SCENARIO_DRAIN_MAX	SZ_64M
+
+struct ion_mm_heap_stat {
+	u64 alloc_cnt;
+	u64 alloc_ns;
+	u64 alloc_ns_max;
+	u64 alloc_slow;
+	u64 free_cnt;
+	u64 free_ns;
+	u64 free_ns_max;
+	u64 zero_bytes;
+	u64 bypass_bytes;
+};
+
 struct ion_system_heap {
 	struct ion_heap heap;
 	struct ion_page_pool **pools;
 	struct ion_page_pool **cached_pools;
+	unsigned long pool_high_wm;
+	spinlock_t stat_lock;	/* protects stat */
+	struct ion_mm_heap_stat stat;
 };
 
 struct page_info {
@@ -151,6 +173,17 @@ static struct page *alloc_buffer_page(struct ion_system_heap *heap,
 	return page;
 }
 
+static void free_buffer_page_to_buddy(struct page *page, unsigned int order)
+{
+	__free_pages(page, order);
+	if (atomic64_sub_return((1 << order), &page_sz_cnt) < 0) {
+		IONMSG("underflow!, total_now[%ld]free[%lu]\n",
+		       atomic64_read(&page_sz_cnt),
+		       (unsigned long)(1 << order));
+		atomic64_set(&page_sz_cnt, 0);
+	}
+}
+
 static void free_buffer_page(struct ion_system_heap *heap,
 			     struct ion_buffer *buffer, struct page *page,
 			     unsigned int order)
@@ -168,14 +201,94 @@ static void free_buffer_page(struct ion_system_heap *heap,
 
 		ion_page_pool_free(pool, page);
 	} else {
-		__free_pages(page, order);
-		if (atomic64_sub_return((1 << order), &page_sz_cnt) < 0) {
-			IONMSG("underflow!, total_now[%ld]free[%lu]\n",
-			       atomic64_read(&page_sz_cnt),
-			       (unsigned long)(1 << order));
-			atomic64_set(&page_sz_cnt, 0);
+		free_buffer_page_to_buddy(page, order);
+	}
+}
+
+static unsigned long ion_mm_pool_pages(struct ion_system_heap *heap)
+{
+	unsigned long pages = 0;
+	int i;
+
+	for (i = 0; i < num_orders; i++) {
+		pages += (unsigned long)(heap->pools[i]->low_count +
+			 heap->pools[i]->high_count) << orders[i];
+		pages += (unsigned long)(heap->cached_pools[i]->low_count +
+			 heap->cached_pools[i]->high_count) << orders[i];
+	}
+
+	return pages;
+}
+
+static void ion_mm_heap_stat_add(struct ion_system_heap *heap, bool alloc,
+				 u64 ns, u64 zero_bytes, u64 bypass_bytes)
+{
+	struct ion_mm_heap_stat *stat = &heap->stat;
+
+	spin_lock(&heap->stat_lock);
+	if (alloc) {
+		stat->alloc_cnt++;
+		stat->alloc_ns += ns;
+		if (ns > stat->alloc_ns_max)
+			stat->alloc_ns_max = ns;
+		if (ns > ION_MM_SLOW_NS)
+			stat->alloc_slow++;
+	} else {
+		stat->free_cnt++;
+		stat->free_ns += ns;
+		if (ns > stat->free_ns_max)
+			stat->free_ns_max = ns;
+		stat->zero_bytes += zero_bytes;
+		stat->bypass_bytes += bypass_bytes;
+	}
+	spin_unlock(&heap->stat_lock);
+}
+
+/*
+ * Return the pages of a freed buffer. This mostly runs from the heap's
+ * deferred free thread, but also synchronously for ION_FLAG_FREE_WITHOUT_DEFER
+ * buffers and from the freelist drain in shrink_ion_by_scenario(); the
+ * latter are marked SHRINKER_FREE and skip the zeroing.
+ *
+ * Pages refill the pools only up to pool_high_wm, zeroed here so the
+ * next allocation can hand them out as is. The rest goes back to buddy
+ * unzeroed: the pool gfp masks carry __GFP_ZERO, so zeroing them now
+ * would just be done twice.
+ */
+static void ion_mm_heap_free_pages(struct ion_system_heap *heap,
+				   struct ion_buffer *buffer,
+				   struct sg_table *table)
+{
+	unsigned long pooled = ion_mm_pool_pages(heap);
+	bool to_buddy = buffer->private_flags & ION_PRIV_FLAG_SHRINKER_FREE;
+	u64 zero_bytes = 0, bypass_bytes = 0;
+	unsigned long long start = sched_clock();
+	struct scatterlist *sg;
+	pgprot_t pgprot;
+	int i;
+
+	if (ion_buffer_cached(buffer))
+		pgprot = PAGE_KERNEL;
+	else
+		pgprot = pgprot_writecombine(PAGE_KERNEL);
+
+	for_each_sg(table->sgl, sg, table->nents, i) {
+		struct page *page = sg_page(sg);
+		unsigned int order = get_order(sg->length);
+
+		if (!to_buddy && pooled < heap->pool_high_wm &&
+		    !ion_heap_pages_zero(page, sg->length, pgprot)) {
+			free_buffer_page(heap, buffer, page, order);
+			pooled += 1 << order;
+			zero_bytes += sg->length;
+		} else {
+			free_buffer_page_to_buddy(page, order);
+			bypass_bytes += sg->length;
 		}
 	}
+
+	ion_mm_heap_stat_add(heap, false, sched_clock() - start,
+			     zero_bytes, bypass_bytes);
 }
 
 static struct page_info *alloc_largest_available(struct ion_system_heap *heap,
@@ -394,8 +507,9 @@ static int ion_mm_heap_allocate(struct ion_heap *heap,
 		i++;
 	}
 	end = sched_clock();
+	ion_mm_heap_stat_add(sys_heap, true, end - start, 0, 0);
 
-	if (end - start > 10000000ULL) {	/* unit is ns, 10ms */
+	if (end - start > ION_MM_SLOW_NS) {	/* unit is ns, 10ms */
 		IONMSG(" %s warn: size: %lu time: %lld ns --%d\n",
 		       __func__, size, end - start, heap->id);
 	}
@@ -612,20 +726,11 @@ void ion_mm_heap_free(struct ion_buffer *buffer)
 #endif
 	struct ion_system_heap *sys_heap =
 	    container_of(heap, struct ion_system_heap, heap);
-	struct scatterlist *sg;
-	LIST_HEAD(pages);
-	int i;
-
-	/* uncached pages come from the page pools, zero them before return */
-	/*for security purposes (other allocations are zerod at alloc time */
-	if (!(buffer->private_flags & ION_PRIV_FLAG_SHRINKER_FREE))
-		ion_heap_buffer_zero(buffer);
 
 	ion_mm_heap_free_buffer_info(buffer);
 
-	for_each_sg(table->sgl, sg, table->nents, i)
-		free_buffer_page(sys_heap, buffer, sg_page(sg),
-				 get_order(sg->length));
+	/* pages kept in the pools are zeroed there for security purposes */
+	ion_mm_heap_free_pages(sys_heap, buffer, table);
 
 	sg_free_table(table);
 	kfree(table);
@@ -1206,6 +1311,7 @@ static int ion_mm_heap_debug_show(struct ion_heap *heap, struct seq_file *s,
 	int i;
 	bool has_orphaned = false;
 	struct ion_mm_buffer_info *bug_info;
+	struct ion_mm_heap_stat stat;
 	unsigned long long current_ts;
 
 	current_ts = sched_clock();
@@ -1243,6 +1349,22 @@ static int ion_mm_heap_debug_show(struct ion_heap *heap, struct seq_file *s,
 	else
 		ION_DUMP(s, "mm_heap defer free disabled\n");
 
+	spin_lock(&sys_heap->stat_lock);
+	stat = sys_heap->stat;
+	spin_unlock(&sys_heap->stat_lock);
+	ION_DUMP(s, "mm_heap pool %lu pages, high_wm %lu pages\n",
+		 ion_mm_pool_pages(sys_heap), sys_heap->pool_high_wm);
+	ION_DUMP(s,
+		 "mm_heap alloc cnt %llu avg %llu ns max %llu ns slow %llu\n",
+		 stat.alloc_cnt,
+		 stat.alloc_cnt ? div64_u64(stat.alloc_ns, stat.alloc_cnt) : 0,
+		 stat.alloc_ns_max, stat.alloc_slow);
+	ION_DUMP(s,
+		 "mm_heap free cnt %llu avg %llu ns max %llu ns zeroed %llu to_buddy %llu\n",
+		 stat.free_cnt,
+		 stat.free_cnt ? div64_u64(stat.free_ns, stat.free_cnt) : 0,
+		 stat.free_ns_max, stat.zero_bytes, stat.bypass_bytes);
+
 	ION_DUMP(s,
 		 "----------------------------------------------------\n");
 #if (DOMAIN_NUM == 1)
@@ -1680,6 +1802,8 @@ struct ion_heap *ion_mm_heap_create(struct ion_platform_heap *unused)
 	heap->heap.ops = &ion_mm_heap_ops;
 	heap->heap.type = (unsigned int)ION_HEAP_TYPE_MULTIMEDIA;
 	heap->heap.flags = ION_HEAP_FLAG_DEFER_FREE;
+	heap->pool_high_wm = totalram_pages / ION_MM_POOL_HIGH_WM_RATIO;
+	spin_lock_init(&heap->stat_lock);
 	heap->pools =
 	    kcalloc(num_orders, sizeof(struct ion_page_pool *), GFP_KERNEL);
 	if (!heap->pools)
@@ -2471,13 +2595,15 @@ void ion_mm_heap_cache_free(struct ion_buffer *buffer)
 	struct ion_system_heap *sys_heap;
 	struct sg_table *table = buffer->sg_table;
 	struct scatterlist *sg;
-	LIST_HEAD(pages);
 	int i;
 
 	sys_heap = container_of(heap, struct ion_system_heap, heap);
-	if (!(buffer->private_flags & ION_PRIV_FLAG_SHRINKER_FREE))
-		ion_heap_buffer_zero(buffer);
 
+	/*
+	 * The buffer was never handed out: its pages came zeroed from the
+	 * pools or from __GFP_ZERO, and the caller asked for them to be
+	 * pooled, so neither zero them again nor apply pool_high_wm.
+	 */
 	for_each_sg(table->sgl, sg, table->nents, i)
 		free_buffer_page(sys_heap, buffer,
 				 sg_page(sg), get_order(sg->length));
@@ -2518,6 +2644,16 @@ void shrink_ion_by_scenario(int need_lock)
 
 	if (!cam_heap)
 		return;
+
+	/*
+	 * Buffers still waiting on the deferred free list go straight back
+	 * to buddy, there is no point zeroing them into the pools first.
+	 * This runs inline from screen off and secure allocation, so only
+	 * a bounded amount is drained; the free thread handles the rest.
+	 */
+	if (cam_heap->flags & ION_HEAP_FLAG_DEFER_FREE)
+		ion_heap_freelist_shrink(cam_heap, ION_MM_SCENARIO_DRAIN_MAX);
+
 	do {
 		nr_to_reclaim =
 		    ion_mm_heap_shrink(cam_heap,
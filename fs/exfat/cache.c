@@ -13,13 +13,25 @@
 #include <linux/slab.h>
 #include <asm/unaligned.h>
 #include <linux/buffer_head.h>
+#include <linux/blkdev.h>
+#include <linux/rbtree.h>
 
 #include "exfat_raw.h"
 #include "exfat_fs.h"
 
-#define EXFAT_MAX_CACHE		16
+/*
+ * Every contiguous run seen while walking a cluster chain is kept in a
+ * per-inode rbtree keyed by file cluster, so seeking in a fragmented file
+ * costs O(log n) once the chain has been walked.  The LRU list only
+ * decides which run to recycle once the inode reaches EXFAT_MAX_CACHE.
+ */
+#define EXFAT_MAX_CACHE		256
+
+/* FAT sectors read ahead when the chain walk leaves the current window */
+#define EXFAT_FAT_RA_SECTORS	8
 
 struct exfat_cache {
+	struct rb_node cache_node;
 	struct list_head cache_list;
 	unsigned int nr_contig;	/* number of contiguous clusters */
 	unsigned int fcluster;	/* cluster number in the file. */
@@ -39,6 +51,7 @@ static void exfat_cache_init_once(void *c)
 {
 	struct exfat_cache *cache = (struct exfat_cache *)c;
 
+	RB_CLEAR_NODE(&cache->cache_node);
 	INIT_LIST_HEAD(&cache->cache_list);
 }
 
@@ -85,24 +98,30 @@ static unsigned int exfat_cache_lookup(struct inode *inode,
 		unsigned int *cached_fclus, unsigned int *cached_dclus)
 {
 	struct exfat_inode_info *ei = EXFAT_I(inode);
-	static struct exfat_cache nohit = { .fcluster = 0, };
-	struct exfat_cache *hit = &nohit, *p;
+	struct exfat_cache *hit = NULL, *p;
+	struct rb_node *node;
 	unsigned int offset = EXFAT_EOF_CLUSTER;
 
 	spin_lock(&ei->cache_lru_lock);
-	list_for_each_entry(p, &ei->cache_lru, cache_list) {
-		/* Find the cache of "fclus" or nearest cache. */
-		if (p->fcluster <= fclus && hit->fcluster < p->fcluster) {
-			hit = p;
-			if (hit->fcluster + hit->nr_contig < fclus) {
-				offset = hit->nr_contig;
-			} else {
-				offset = fclus - hit->fcluster;
-				break;
-			}
+	node = ei->cache_tree.rb_node;
+	while (node) {
+		p = rb_entry(node, struct exfat_cache, cache_node);
+		if (p->fcluster > fclus) {
+			node = node->rb_left;
+			continue;
 		}
+		/* Find the cache of "fclus" or nearest cache. */
+		hit = p;
+		if (hit->fcluster + hit->nr_contig >= fclus)
+			break;
+		node = node->rb_right;
 	}
-	if (hit != &nohit) {
+	if (hit) {
+		if (hit->fcluster + hit->nr_contig < fclus)
+			offset = hit->nr_contig;
+		else
+			offset = fclus - hit->fcluster;
+
 		exfat_cache_update_lru(inode, hit);
 
 		cid->id = ei->cache_valid_id;
@@ -121,11 +140,17 @@ static struct exfat_cache *exfat_cache_merge(struct inode *inode,
 		struct exfat_cache_id *new)
 {
 	struct exfat_inode_info *ei = EXFAT_I(inode);
+	struct rb_node *node = ei->cache_tree.rb_node;
 	struct exfat_cache *p;
 
-	list_for_each_entry(p, &ei->cache_lru, cache_list) {
+	while (node) {
+		p = rb_entry(node, struct exfat_cache, cache_node);
 		/* Find the same part as "new" in cluster-chain. */
-		if (p->fcluster == new->fcluster) {
+		if (new->fcluster < p->fcluster) {
+			node = node->rb_left;
+		} else if (new->fcluster > p->fcluster) {
+			node = node->rb_right;
+		} else {
 			if (new->nr_contig > p->nr_contig)
 				p->nr_contig = new->nr_contig;
 			return p;
@@ -134,6 +159,24 @@ static struct exfat_cache *exfat_cache_merge(struct inode *inode,
 	return NULL;
 }
 
+static void exfat_cache_insert(struct inode *inode, struct exfat_cache *cache)
+{
+	struct exfat_inode_info *ei = EXFAT_I(inode);
+	struct rb_node **link = &ei->cache_tree.rb_node, *parent = NULL;
+	struct exfat_cache *p;
+
+	while (*link) {
+		parent = *link;
+		p = rb_entry(parent, struct exfat_cache, cache_node);
+		if (cache->fcluster < p->fcluster)
+			link = &parent->rb_left;
+		else
+			link = &parent->rb_right;
+	}
+	rb_link_node(&cache->cache_node, parent, link);
+	rb_insert_color(&cache->cache_node, &ei->cache_tree);
+}
+
 static void exfat_cache_add(struct inode *inode,
 		struct exfat_cache_id *new)
 {
@@ -175,10 +218,12 @@ static void exfat_cache_add(struct inode *inode,
 
 			cache = list_entry(p,
 					struct exfat_cache, cache_list);
+			rb_erase(&cache->cache_node, &ei->cache_tree);
 		}
 		cache->fcluster = new->fcluster;
 		cache->dcluster = new->dcluster;
 		cache->nr_contig = new->nr_contig;
+		exfat_cache_insert(inode, cache);
 	}
 out_update_lru:
 	exfat_cache_update_lru(inode, cache);
@@ -199,6 +244,8 @@ static void __exfat_cache_inval_inode(struct inode *inode)
 		cache = list_entry(ei->cache_lru.next,
 				   struct exfat_cache, cache_list);
 		list_del_init(&cache->cache_list);
+		rb_erase(&cache->cache_node, &ei->cache_tree);
+		RB_CLEAR_NODE(&cache->cache_node);
 		ei->nr_caches--;
 		exfat_cache_free(cache);
 	}
@@ -233,6 +280,39 @@ static inline void cache_init(struct exfat_cache_id *cid,
 	cid->nr_contig = 0;
 }
 
+/*
+ * Start reading the FAT sectors around "clus" when the walk leaves the
+ * window that was read ahead last time, so that following a fragmented
+ * chain does not issue one synchronous single-sector read per hop.
+ */
+static void exfat_fat_readahead(struct super_block *sb, unsigned int clus,
+		sector_t *ra_start)
+{
+	struct exfat_sb_info *sbi = EXFAT_SB(sb);
+	sector_t sec = FAT_ENT_OFFSET_SECTOR(sb, clus);
+	sector_t end = sbi->FAT1_start_sector + sbi->num_FAT_sectors;
+	struct buffer_head *bh;
+	struct blk_plug plug;
+	unsigned int i;
+
+	if (*ra_start != (sector_t)-1 && sec >= *ra_start &&
+	    sec < *ra_start + EXFAT_FAT_RA_SECTORS)
+		return;
+	*ra_start = sec;
+
+	bh = sb_find_get_block(sb, sec);
+	if (bh && buffer_uptodate(bh)) {
+		brelse(bh);
+		return;
+	}
+	brelse(bh);
+
+	blk_start_plug(&plug);
+	for (i = 0; i < EXFAT_FAT_RA_SECTORS && sec + i < end; i++)
+		sb_breadahead(sb, sec + i);
+	blk_finish_plug(&plug);
+}
+
 int exfat_get_cluster(struct inode *inode, unsigned int cluster,
 		unsigned int *fclus, unsigned int *dclus,
 		unsigned int *last_dclus, int allow_eof)
@@ -243,6 +323,7 @@ int exfat_get_cluster(struct inode *inode, unsigned int cluster,
 	struct exfat_inode_info *ei = EXFAT_I(inode);
 	struct exfat_cache_id cid;
 	unsigned int content;
+	sector_t ra_start = (sector_t)-1;
 
 	if (ei->start_clu == EXFAT_FREE_CLUSTER) {
 		exfat_fs_error(sb,
@@ -287,6 +368,7 @@ int exfat_get_cluster(struct inode *inode, unsigned int cluster,
 			return -EIO;
 		}
 
+		exfat_fat_readahead(sb, *dclus, &ra_start);
 		if (exfat_ent_get(sb, *dclus, &content))
 			return -EIO;
 
@@ -305,8 +387,12 @@ int exfat_get_cluster(struct inode *inode, unsigned int cluster,
 			break;
 		}
 
-		if (!cache_contiguous(&cid, *dclus))
+		if (!cache_contiguous(&cid, *dclus)) {
+			/* remember the run just finished before starting anew */
+			cid.nr_contig--;
+			exfat_cache_add(inode, &cid);
 			cache_init(&cid, *fclus, *dclus);
+		}
 	}
 
 	exfat_cache_add(inode, &cid);
@@ -324,6 +324,7 @@ struct exfat_inode_info {
 
 	spinlock_t cache_lru_lock;
 	struct list_head cache_lru;
+	struct rb_root cache_tree;
 	int nr_caches;
 	/* for avoiding the race between alloc and free */
 	unsigned int cache_valid_id;
@@ -194,6 +194,43 @@ __flush_batch(journal_t *journal, int *batch_count)
 	*batch_count = 0;
 }
 
+/*
+ * Queue writeback for the dirty buffers at the head of the checkpoint lists
+ * of the JBD2_CHECKPOINT_AHEAD transactions following "transaction", so that
+ * their I/O is in flight while we wait for the oldest one. Returns the
+ * number of buffers added to j_chkpt_bhs.
+ *
+ * Called with j_list_lock held.
+ */
+static int __checkpoint_ahead(journal_t *journal, transaction_t *transaction,
+			      int *batch_count)
+{
+	transaction_t *t = transaction->t_cpnext;
+	struct journal_head *jh;
+	struct buffer_head *bh;
+	int nr;
+
+	for (nr = 0; nr < JBD2_CHECKPOINT_AHEAD &&
+	     t != journal->j_checkpoint_transactions; nr++, t = t->t_cpnext) {
+		while (t->t_checkpoint_list && *batch_count < JBD2_NR_BATCH) {
+			jh = t->t_checkpoint_list;
+			bh = jh2bh(jh);
+			/* leave anything unusual to the transaction's own pass */
+			if (buffer_locked(bh) || jh->b_transaction != NULL ||
+			    !buffer_dirty(bh))
+				break;
+			if (t->t_chp_stats.cs_chp_time == 0)
+				t->t_chp_stats.cs_chp_time = jiffies;
+			get_bh(bh);
+			J_ASSERT_BH(bh, !buffer_jwrite(bh));
+			journal->j_chkpt_bhs[(*batch_count)++] = bh;
+			__buffer_relink_io(jh);
+			t->t_chp_stats.cs_written++;
+		}
+	}
+	return *batch_count;
+}
+
 /*
  * Perform an actual checkpoint. We take the first transaction on the
  * list of transactions to be checkpointed and send all its buffers
@@ -320,8 +357,17 @@ int jbd2_log_do_checkpoint(journal_t *journal)
 	}
 
 	/*
-	 * Now we issued all of the transaction's buffers, let's deal
-	 * with the buffers that are out for I/O.
+	 * Now we issued all of the transaction's buffers. Before waiting on
+	 * them, get writeback of the next transactions going as well.
+	 */
+	if (__checkpoint_ahead(journal, transaction, &batch_count)) {
+		spin_unlock(&journal->j_list_lock);
+		__flush_batch(journal, &batch_count);
+		spin_lock(&journal->j_list_lock);
+	}
+
+	/*
+	 * Let's deal with the buffers that are out for I/O.
 	 */
 restart2:
 	/* Did somebody clean up the transaction in the meanwhile? */
@@ -1158,6 +1158,8 @@ static journal_t *journal_init_common(struct block_device *bdev,
 	journal->j_min_batch_time = 0;
 	journal->j_max_batch_time = 15000; /* 15ms */
 	atomic_set(&journal->j_reserved_credits, 0);
+	/* Without it handles just charge the transaction directly */
+	journal->j_credit_cache = alloc_percpu(struct jbd2_credit_cache);
 
 	/* The journal is marked for error until we succeed with recovery! */
 	journal->j_flags = JBD2_ABORT;
@@ -1197,6 +1199,7 @@ static journal_t *journal_init_common(struct block_device *bdev,
 	return journal;
 
 err_cleanup:
+	free_percpu(journal->j_credit_cache);
 	kfree(journal->j_wbuf);
 	jbd2_journal_destroy_revoke(journal);
 	kfree(journal);
@@ -1794,6 +1797,7 @@ int jbd2_journal_destroy(journal_t *journal)
 		jbd2_journal_destroy_revoke(journal);
 	if (journal->j_chksum_driver)
 		crypto_free_shash(journal->j_chksum_driver);
+	free_percpu(journal->j_credit_cache);
 	kfree(journal->j_wbuf);
 	kfree(journal);
 
@@ -168,6 +168,71 @@ static void sub_reserved_credits(journal_t *journal, int blocks)
 	wake_up(&journal->j_wait_reserved);
 }
 
+/*
+ * Take "total" credits for a handle from this cpu's credit cache, refilling
+ * the cache from the running transaction in JBD2_PCPU_CREDITS chunks.
+ * Returns false if the caller has to charge t_outstanding_credits itself.
+ *
+ * Called with j_state_lock held for reading and t not locked, so this
+ * cannot race with __jbd2_journal_fold_credits().
+ */
+static bool jbd2_get_cached_credits(journal_t *journal, transaction_t *t,
+				    int total)
+{
+	struct jbd2_credit_cache *cc;
+	int batch = total + JBD2_PCPU_CREDITS;
+	bool ret = true;
+
+	/* Small journals cannot afford credits parked on every cpu */
+	if (!journal->j_credit_cache ||
+	    journal->j_max_transaction_buffers <
+	    num_online_cpus() * JBD2_PCPU_CREDITS * 8)
+		return false;
+
+	cc = get_cpu_ptr(journal->j_credit_cache);
+	if (cc->tid != t->t_tid) {
+		cc->tid = t->t_tid;
+		cc->credits = 0;
+	}
+	if (cc->credits >= total) {
+		cc->credits -= total;
+		goto out;
+	}
+	if (atomic_add_return(batch, &t->t_outstanding_credits) >
+	    journal->j_max_transaction_buffers) {
+		atomic_sub(batch, &t->t_outstanding_credits);
+		ret = false;
+		goto out;
+	}
+	cc->credits += batch - total;
+out:
+	put_cpu_ptr(journal->j_credit_cache);
+	return ret;
+}
+
+/*
+ * Give back credits still parked in per-cpu caches for a transaction that is
+ * being locked for commit. Called with j_state_lock held for writing.
+ */
+void __jbd2_journal_fold_credits(journal_t *journal, transaction_t *transaction)
+{
+	struct jbd2_credit_cache *cc;
+	int cpu, unused = 0;
+
+	if (!journal->j_credit_cache)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		cc = per_cpu_ptr(journal->j_credit_cache, cpu);
+		if (cc->tid != transaction->t_tid)
+			continue;
+		unused += cc->credits;
+		cc->credits = 0;
+	}
+	if (unused)
+		atomic_sub(unused, &transaction->t_outstanding_credits);
+}
+
 /*
  * Wait until we can add credits for handle to the running transaction.  Called
  * with j_state_lock held for reading. Returns 0 if handle joined the running
@@ -195,6 +260,9 @@ static int add_transaction_credits(journal_t *journal, int blocks,
 	 * potential buffers requested by this operation, we need to
 	 * stall pending a log checkpoint to free some more log space.
 	 */
+	if (jbd2_get_cached_credits(journal, t, total))
+		goto check_space;
+
 	needed = atomic_add_return(total, &t->t_outstanding_credits);
 	if (needed > journal->j_max_transaction_buffers) {
 		/*
@@ -222,6 +290,7 @@ static int add_transaction_credits(journal_t *journal, int blocks,
 		return 1;
 	}
 
+check_space:
 	/*
 	 * The commit code assumes that it can get enough log space
 	 * without forcing a checkpoint.  This is *critical* for
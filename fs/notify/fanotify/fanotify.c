@@ -13,6 +13,7 @@
 #include <linux/wait.h>
 #include <linux/audit.h>
 #include <linux/sched/mm.h>
+#include <linux/hash.h>
 
 #include "fanotify.h"
 
@@ -32,24 +33,39 @@ static bool should_merge(struct fsnotify_event *old_fsn,
 	return false;
 }
 
-/* and the list better be locked by something too! */
-static int fanotify_merge(struct list_head *list, struct fsnotify_event *event)
+static unsigned int fanotify_event_hash(struct fanotify_event_info *event)
 {
-	struct fsnotify_event *test_event;
+	return hash_long((unsigned long)event->path.dentry ^
+			 (unsigned long)event->tgid, FANOTIFY_HTABLE_BITS);
+}
 
-	pr_debug("%s: list=%p event=%p\n", __func__, list, event);
+/*
+ * Only queued events with the same hash can be merged, so instead of walking
+ * the whole notification list look at the matching merge_hash bucket, which
+ * keeps the newest event first like the old reverse list walk did.
+ *
+ * Called with group->notification_lock held.
+ */
+static int fanotify_merge(struct fsnotify_group *group,
+			  struct fsnotify_event *event)
+{
+	struct fanotify_event_info *new = FANOTIFY_E(event), *test_event;
+	struct hlist_head *hlist;
+
+	pr_debug("%s: group=%p event=%p\n", __func__, group, event);
 
 	/*
 	 * Don't merge a permission event with any other event so that we know
 	 * the event structure we have created in fanotify_handle_event() is the
 	 * one we should check for permission response.
 	 */
-	if (fanotify_is_perm_event(event->mask))
+	if (!fanotify_is_hashed_event(event->mask))
 		return 0;
 
-	list_for_each_entry_reverse(test_event, list, list) {
-		if (should_merge(test_event, event)) {
-			test_event->mask |= event->mask;
+	hlist = &group->fanotify_data.merge_hash[new->hash];
+	hlist_for_each_entry(test_event, hlist, merge_list) {
+		if (should_merge(&test_event->fse, event)) {
+			test_event->fse.mask |= event->mask;
 			return 1;
 		}
 	}
@@ -57,6 +73,19 @@ static int fanotify_merge(struct list_head *list, struct fsnotify_event *event)
 	return 0;
 }
 
+/* Called with group->notification_lock held once the event is queued. */
+static void fanotify_insert_event(struct fsnotify_group *group,
+				  struct fsnotify_event *event)
+{
+	struct fanotify_event_info *fae = FANOTIFY_E(event);
+
+	if (!fanotify_is_hashed_event(event->mask))
+		return;
+
+	hlist_add_head(&fae->merge_list,
+		       &group->fanotify_data.merge_hash[fae->hash]);
+}
+
 static int fanotify_get_response(struct fsnotify_group *group,
 				 struct fanotify_perm_event_info *event,
 				 struct fsnotify_iter_info *iter_info)
@@ -177,6 +206,7 @@ struct fanotify_event_info *fanotify_alloc_event(struct fsnotify_group *group,
 		goto out;
 init: __maybe_unused
 	fsnotify_init_event(&event->fse, inode, mask);
+	INIT_HLIST_NODE(&event->merge_list);
 	event->tgid = get_pid(task_tgid(current));
 	if (path) {
 		event->path = *path;
@@ -185,6 +215,7 @@ init: __maybe_unused
 		event->path.mnt = NULL;
 		event->path.dentry = NULL;
 	}
+	event->hash = fanotify_event_hash(event);
 out:
 	memalloc_unuse_memcg();
 	return event;
@@ -239,7 +270,8 @@ static int fanotify_handle_event(struct fsnotify_group *group,
 	}
 
 	fsn_event = &event->fse;
-	ret = fsnotify_add_event(group, fsn_event, fanotify_merge);
+	ret = fsnotify_add_event(group, fsn_event, fanotify_merge,
+				 fanotify_insert_event);
 	if (ret) {
 		/* Permission events shouldn't be merged */
 		BUG_ON(ret == 1 && mask & FAN_ALL_PERM_EVENTS);
@@ -263,6 +295,7 @@ static void fanotify_free_group_priv(struct fsnotify_group *group)
 {
 	struct user_struct *user;
 
+	kfree(group->fanotify_data.merge_hash);
 	user = group->fanotify_data.user;
 	atomic_dec(&user->fanotify_listeners);
 	free_uid(user);
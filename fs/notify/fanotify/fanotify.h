@@ -14,6 +14,9 @@ extern struct kmem_cache *fanotify_perm_event_cachep;
  */
 struct fanotify_event_info {
 	struct fsnotify_event fse;
+	/* links queued events in group->fanotify_data.merge_hash */
+	struct hlist_node merge_list;
+	unsigned int hash;
 	/*
 	 * We hold ref to this path so it may be dereferenced at any point
 	 * during this object's lifetime
@@ -52,6 +55,25 @@ static inline struct fanotify_event_info *FANOTIFY_E(struct fsnotify_event *fse)
 	return container_of(fse, struct fanotify_event_info, fse);
 }
 
+/* Buckets in the per-group table of queued events that may be merged */
+#define FANOTIFY_HTABLE_BITS	7
+#define FANOTIFY_HTABLE_SIZE	(1 << FANOTIFY_HTABLE_BITS)
+
+/* Permission and overflow events are never merged, so never hashed */
+static inline bool fanotify_is_hashed_event(u32 mask)
+{
+	return !fanotify_is_perm_event(mask) && !(mask & FS_Q_OVERFLOW);
+}
+
+/* Called with group->notification_lock held when an event is dequeued */
+static inline void fanotify_unhash_event(struct fsnotify_event *fse)
+{
+	struct fanotify_event_info *event = FANOTIFY_E(fse);
+
+	if (!hlist_unhashed(&event->merge_list))
+		hlist_del_init(&event->merge_list);
+}
+
 struct fanotify_event_info *fanotify_alloc_event(struct fsnotify_group *group,
 						 struct inode *inode, u32 mask,
 						 const struct path *path);
@@ -28,6 +28,9 @@
 #define FANOTIFY_DEFAULT_MAX_MARKS	8192
 #define FANOTIFY_DEFAULT_MAX_LISTENERS	128
 
+/* Events taken off the notification queue per notification_lock hold */
+#define FANOTIFY_READ_BATCH		16
+
 /*
  * All flags that may be specified in parameter event_f_flags of fanotify_init.
  *
@@ -48,28 +51,66 @@ struct kmem_cache *fanotify_event_cachep __read_mostly;
 struct kmem_cache *fanotify_perm_event_cachep __read_mostly;
 
 /*
- * Get an fsnotify notification event if one exists and is small
- * enough to fit in "count". Return an error pointer if the count
- * is not large enough.
+ * Move as many queued events as fit in "count" (up to FANOTIFY_READ_BATCH)
+ * from the notification queue to "batch". A permission event is only taken
+ * alone, so a blocked task never waits behind a batch. Return the number of
+ * events moved, or -EINVAL if events are queued but "count" cannot hold a
+ * single one.
  *
  * Called with the group->notification_lock held.
  */
-static struct fsnotify_event *get_one_event(struct fsnotify_group *group,
-					    size_t count)
+static int get_event_batch(struct fsnotify_group *group, size_t count,
+			   struct list_head *batch)
 {
+	struct fsnotify_event *event;
+	int nr, max;
+
 	assert_spin_locked(&group->notification_lock);
 
 	pr_debug("%s: group=%p count=%zd\n", __func__, group, count);
 
 	if (fsnotify_notify_queue_is_empty(group))
-		return NULL;
+		return 0;
 
 	if (FAN_EVENT_METADATA_LEN > count)
-		return ERR_PTR(-EINVAL);
+		return -EINVAL;
+
+	max = min_t(size_t, count / FAN_EVENT_METADATA_LEN,
+		    FANOTIFY_READ_BATCH);
+	for (nr = 0; nr < max && !fsnotify_notify_queue_is_empty(group); nr++) {
+		event = fsnotify_peek_first_event(group);
+		if (fanotify_is_perm_event(event->mask)) {
+			if (nr)
+				break;
+			max = 1;
+		}
+		fsnotify_remove_first_event(group);
+		fanotify_unhash_event(event);
+		list_add_tail(&event->list, batch);
+	}
 
-	/* held the notification_lock the whole time, so this is the
-	 * same event we peeked above */
-	return fsnotify_remove_first_event(group);
+	return nr;
+}
+
+/*
+ * Put events taken by get_event_batch() but not delivered back at the head of
+ * the queue, in order. They are no longer candidates for merging. Waiters that
+ * went to sleep while the batch held the queue empty are woken again.
+ */
+static void requeue_event_batch(struct fsnotify_group *group,
+				struct list_head *batch)
+{
+	struct fsnotify_event *event, *next;
+
+	spin_lock(&group->notification_lock);
+	list_for_each_entry_safe_reverse(event, next, batch, list) {
+		list_move(&event->list, &group->notification_list);
+		group->q_len++;
+	}
+	spin_unlock(&group->notification_lock);
+
+	wake_up(&group->notification_waitq);
+	kill_fasync(&group->fsn_fa, SIGIO, POLL_IN);
 }
 
 static int create_fd(struct fsnotify_group *group,
@@ -261,6 +302,7 @@ static ssize_t fanotify_read(struct file *file, char __user *buf,
 	struct fsnotify_event *kevent;
 	char __user *start;
 	int ret;
+	LIST_HEAD(batch);
 	DEFINE_WAIT_FUNC(wait, woken_wake_function);
 
 	start = buf;
@@ -270,16 +312,16 @@ static ssize_t fanotify_read(struct file *file, char __user *buf,
 
 	add_wait_queue(&group->notification_waitq, &wait);
 	while (1) {
-		spin_lock(&group->notification_lock);
-		kevent = get_one_event(group, count);
-		spin_unlock(&group->notification_lock);
+		if (list_empty(&batch)) {
+			spin_lock(&group->notification_lock);
+			ret = get_event_batch(group, count, &batch);
+			spin_unlock(&group->notification_lock);
 
-		if (IS_ERR(kevent)) {
-			ret = PTR_ERR(kevent);
-			break;
+			if (ret < 0)
+				break;
 		}
 
-		if (!kevent) {
+		if (list_empty(&batch)) {
 			ret = -EAGAIN;
 			if (file->f_flags & O_NONBLOCK)
 				break;
@@ -295,6 +337,9 @@ static ssize_t fanotify_read(struct file *file, char __user *buf,
 			continue;
 		}
 
+		kevent = list_first_entry(&batch, struct fsnotify_event, list);
+		list_del_init(&kevent->list);
+
 		ret = copy_event_to_user(group, kevent, buf);
 		if (unlikely(ret == -EOPENSTALE)) {
 			/*
@@ -328,6 +373,8 @@ static ssize_t fanotify_read(struct file *file, char __user *buf,
 		buf += ret;
 		count -= ret;
 	}
+	if (!list_empty(&batch))
+		requeue_event_batch(group, &batch);
 	remove_wait_queue(&group->notification_waitq, &wait);
 
 	if (start != buf && ret != -EFAULT)
@@ -395,6 +442,7 @@ static int fanotify_release(struct inode *ignored, struct file *file)
 	 */
 	while (!fsnotify_notify_queue_is_empty(group)) {
 		fsn_event = fsnotify_remove_first_event(group);
+		fanotify_unhash_event(fsn_event);
 		if (!(fsn_event->mask & FAN_ALL_PERM_EVENTS)) {
 			spin_unlock(&group->notification_lock);
 			fsnotify_destroy_event(group, fsn_event);
@@ -734,6 +782,13 @@ SYSCALL_DEFINE2(fanotify_init, unsigned int, flags, unsigned int, event_f_flags)
 	atomic_inc(&user->fanotify_listeners);
 	group->memcg = get_mem_cgroup_from_mm(current->mm);
 
+	group->fanotify_data.merge_hash = kcalloc(FANOTIFY_HTABLE_SIZE,
+					sizeof(struct hlist_head), GFP_KERNEL);
+	if (!group->fanotify_data.merge_hash) {
+		fd = -ENOMEM;
+		goto out_destroy_group;
+	}
+
 	oevent = fanotify_alloc_event(group, NULL, FS_Q_OVERFLOW, NULL);
 	if (unlikely(!oevent)) {
 		fd = -ENOMEM;
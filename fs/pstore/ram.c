@@ -376,6 +376,27 @@ static size_t ramoops_write_kmsg_hdr(struct persistent_ram_zone *prz,
 	return len;
 }
 
+/*
+ * Make zones with deferred ECC consistent before the system goes down.
+ * Their writers do not take any lock this path could use, so this is only
+ * done for a panic dump, which runs after the other CPUs were stopped. An
+ * oops leaves them running and relies on the block-sized checkpoints.
+ */
+static void ramoops_flush_ecc(struct ramoops_context *cxt,
+			      enum kmsg_dump_reason reason)
+{
+	int i;
+
+	if (!(cxt->flags & RAMOOPS_FLAG_DEFERRED_ECC) ||
+	    reason != KMSG_DUMP_PANIC)
+		return;
+
+	for (i = 0; cxt->fprzs && i < cxt->max_ftrace_cnt; i++)
+		persistent_ram_flush_ecc(cxt->fprzs[i]);
+	if (cxt->mprz)
+		persistent_ram_flush_ecc(cxt->mprz);
+}
+
 static int notrace ramoops_pstore_write(struct pstore_record *record)
 {
 	struct ramoops_context *cxt = record->psi->data;
@@ -432,6 +453,8 @@ static int notrace ramoops_pstore_write(struct pstore_record *record)
 	if (record->part != 1)
 		return -ENOSPC;
 
+	ramoops_flush_ecc(cxt, record->reason);
+
 	if (!cxt->dprzs)
 		return -ENOSPC;
 
@@ -631,7 +654,7 @@ static int ramoops_init_przs(const char *name,
 static int ramoops_init_prz(const char *name,
 			    struct device *dev, struct ramoops_context *cxt,
 			    struct persistent_ram_zone **prz,
-			    phys_addr_t *paddr, size_t sz, u32 sig)
+			    phys_addr_t *paddr, size_t sz, u32 sig, u32 flags)
 {
 	if (!sz)
 		return 0;
@@ -644,7 +667,7 @@ static int ramoops_init_prz(const char *name,
 	}
 
 	*prz = persistent_ram_new(*paddr, sz, sig, &cxt->ecc_info,
-				  cxt->memtype, 0);
+				  cxt->memtype, flags);
 	if (IS_ERR(*prz)) {
 		int err = PTR_ERR(*prz);
 
@@ -731,6 +754,7 @@ static int ramoops_probe(struct platform_device *pdev)
 	struct ramoops_context *cxt = &oops_cxt;
 	size_t dump_mem_sz;
 	phys_addr_t paddr;
+	u32 prz_flags;
 	int err = -EINVAL;
 
 	if (dev_of_node(dev) && !pdata) {
@@ -797,23 +821,30 @@ static int ramoops_probe(struct platform_device *pdev)
 		goto fail_out;
 
 	err = ramoops_init_prz("console", dev, cxt, &cxt->cprz, &paddr,
-			       cxt->console_size, 0);
+			       cxt->console_size, 0, 0);
 	if (err)
 		goto fail_init_cprz;
 
 	cxt->max_ftrace_cnt = (cxt->flags & RAMOOPS_FLAG_FTRACE_PER_CPU)
 				? nr_cpu_ids
 				: 1;
+	/*
+	 * Per-cpu ftrace zones and the pmsg zone (serialized by pmsg_lock)
+	 * have a single writer at a time, so their ECC can be batched.
+	 */
+	prz_flags = (cxt->flags & RAMOOPS_FLAG_DEFERRED_ECC)
+			? PRZ_FLAG_DEFERRED_ECC : 0;
+
 	err = ramoops_init_przs("ftrace", dev, cxt, &cxt->fprzs, &paddr,
 				cxt->ftrace_size, -1,
 				&cxt->max_ftrace_cnt, LINUX_VERSION_CODE,
 				(cxt->flags & RAMOOPS_FLAG_FTRACE_PER_CPU)
-					? PRZ_FLAG_NO_LOCK : 0);
+					? PRZ_FLAG_NO_LOCK | prz_flags : 0);
 	if (err)
 		goto fail_init_fprz;
 
 	err = ramoops_init_prz("pmsg", dev, cxt, &cxt->mprz, &paddr,
-				cxt->pmsg_size, 0);
+				cxt->pmsg_size, 0, prz_flags);
 	if (err)
 		goto fail_init_mprz;
 
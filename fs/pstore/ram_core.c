@@ -275,7 +275,8 @@ static void notrace persistent_ram_update(struct persistent_ram_zone *prz,
 {
 	struct persistent_ram_buffer *buffer = prz->buffer;
 	memcpy_toio(buffer->data + start, s, count);
-	persistent_ram_update_ecc(prz, start, count);
+	if (!(prz->flags & PRZ_FLAG_DEFERRED_ECC))
+		persistent_ram_update_ecc(prz, start, count);
 }
 
 static int notrace persistent_ram_update_user(struct persistent_ram_zone *prz,
@@ -284,10 +285,57 @@ static int notrace persistent_ram_update_user(struct persistent_ram_zone *prz,
 	struct persistent_ram_buffer *buffer = prz->buffer;
 	int ret = unlikely(__copy_from_user(buffer->data + start, s, count)) ?
 		-EFAULT : 0;
-	persistent_ram_update_ecc(prz, start, count);
+	if (!(prz->flags & PRZ_FLAG_DEFERRED_ECC))
+		persistent_ram_update_ecc(prz, start, count);
 	return ret;
 }
 
+/* Encode every ECC block touched since the last checkpoint. */
+static void notrace persistent_ram_ecc_checkpoint(struct persistent_ram_zone *prz)
+{
+	size_t start = prz->ecc_pending_start;
+	size_t count = min(prz->ecc_pending, prz->buffer_size);
+	size_t rem = prz->buffer_size - start;
+
+	if (!count)
+		return;
+
+	if (unlikely(rem < count)) {
+		persistent_ram_update_ecc(prz, start, rem);
+		count -= rem;
+		start = 0;
+	}
+	persistent_ram_update_ecc(prz, start, count);
+	persistent_ram_update_header_ecc(prz);
+	prz->ecc_pending = 0;
+}
+
+/*
+ * Account a write of count bytes at start to a PRZ_FLAG_DEFERRED_ECC zone,
+ * and checkpoint the ECC once a whole ECC block worth of data is pending.
+ */
+static void notrace persistent_ram_defer_ecc(struct persistent_ram_zone *prz,
+	size_t start, size_t count)
+{
+	if (!prz->ecc_info.ecc_size)
+		return;
+
+	if (!prz->ecc_pending)
+		prz->ecc_pending_start = start;
+	prz->ecc_pending += count;
+
+	if (prz->ecc_pending >= prz->ecc_info.block_size)
+		persistent_ram_ecc_checkpoint(prz);
+}
+
+void notrace persistent_ram_flush_ecc(struct persistent_ram_zone *prz)
+{
+	if (!(prz->flags & PRZ_FLAG_DEFERRED_ECC) || !prz->ecc_info.ecc_size)
+		return;
+
+	persistent_ram_ecc_checkpoint(prz);
+}
+
 void persistent_ram_save_old(struct persistent_ram_zone *prz)
 {
 	struct persistent_ram_buffer *buffer = prz->buffer;
@@ -315,8 +363,8 @@ int notrace persistent_ram_write(struct persistent_ram_zone *prz,
 	const void *s, unsigned int count)
 {
 	int rem;
-	int c = count;
-	size_t start;
+	int c = count, len;
+	size_t start, first;
 
 	if (unlikely(c > prz->buffer_size)) {
 		s += c - prz->buffer_size;
@@ -326,6 +374,8 @@ int notrace persistent_ram_write(struct persistent_ram_zone *prz,
 	buffer_size_add(prz, c);
 
 	start = buffer_start_add(prz, c);
+	first = start;
+	len = c;
 
 	rem = prz->buffer_size - start;
 	if (unlikely(rem < c)) {
@@ -336,7 +386,10 @@ int notrace persistent_ram_write(struct persistent_ram_zone *prz,
 	}
 	persistent_ram_update(prz, s, start, c);
 
-	persistent_ram_update_header_ecc(prz);
+	if (prz->flags & PRZ_FLAG_DEFERRED_ECC)
+		persistent_ram_defer_ecc(prz, first, len);
+	else
+		persistent_ram_update_header_ecc(prz);
 
 	return count;
 }
@@ -344,8 +397,8 @@ int notrace persistent_ram_write(struct persistent_ram_zone *prz,
 int notrace persistent_ram_write_user(struct persistent_ram_zone *prz,
 	const void __user *s, unsigned int count)
 {
-	int rem, ret = 0, c = count;
-	size_t start;
+	int rem, ret = 0, c = count, len;
+	size_t start, first;
 
 	if (unlikely(!access_ok(VERIFY_READ, s, count)))
 		return -EFAULT;
@@ -357,6 +410,8 @@ int notrace persistent_ram_write_user(struct persistent_ram_zone *prz,
 	buffer_size_add(prz, c);
 
 	start = buffer_start_add(prz, c);
+	first = start;
+	len = c;
 
 	rem = prz->buffer_size - start;
 	if (unlikely(rem < c)) {
@@ -368,7 +423,10 @@ int notrace persistent_ram_write_user(struct persistent_ram_zone *prz,
 	if (likely(!ret))
 		ret = persistent_ram_update_user(prz, s, start, c);
 
-	persistent_ram_update_header_ecc(prz);
+	if (prz->flags & PRZ_FLAG_DEFERRED_ECC)
+		persistent_ram_defer_ecc(prz, first, len);
+	else
+		persistent_ram_update_header_ecc(prz);
 
 	return unlikely(ret) ? ret : count;
 }
@@ -394,6 +452,7 @@ void persistent_ram_zap(struct persistent_ram_zone *prz)
 {
 	atomic_set(&prz->buffer->start, 0);
 	atomic_set(&prz->buffer->size, 0);
+	prz->ecc_pending = 0;
 	persistent_ram_update_header_ecc(prz);
 }
 
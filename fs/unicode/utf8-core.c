@@ -10,6 +10,42 @@
 
 #include "utf8n.h"
 
+/*
+ * NFD+CF of a pure ASCII string is the string itself with 'A'-'Z'
+ * folded to lower case, so names made only of 0x01-0x7f bytes can skip
+ * the utf8data trie entirely.  The scan below is a plain OR-reduction
+ * that the compiler turns into word or vector loads.  Embedded NUL
+ * bytes terminate the normalization cursor, so they are left to the
+ * slow path to keep the results identical.
+ */
+static bool utf8_is_ascii(const unsigned char *s, size_t len)
+{
+	unsigned char acc = 0;
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		acc |= s[i];
+	if (acc & 0x80)
+		return false;
+	return !memchr(s, 0, len);
+}
+
+static inline unsigned char utf8_ascii_fold(unsigned char c)
+{
+	return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+static int utf8_ascii_strncasecmp(const unsigned char *s1,
+				  const unsigned char *s2, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		if (utf8_ascii_fold(s1[i]) != utf8_ascii_fold(s2[i]))
+			return 1;
+	return 0;
+}
+
 int utf8_validate(const struct unicode_map *um, const struct qstr *str)
 {
 	const struct utf8data *data = utf8nfdi(um->version);
@@ -54,6 +90,13 @@ int utf8_strncasecmp(const struct unicode_map *um,
 	struct utf8cursor cur1, cur2;
 	int c1, c2;
 
+	if (utf8_is_ascii(s1->name, s1->len) &&
+	    utf8_is_ascii(s2->name, s2->len)) {
+		if (s1->len != s2->len)
+			return 1;
+		return utf8_ascii_strncasecmp(s1->name, s2->name, s1->len);
+	}
+
 	if (utf8ncursor(&cur1, data, s1->name, s1->len) < 0)
 		return -EINVAL;
 
@@ -86,6 +129,13 @@ int utf8_strncasecmp_folded(const struct unicode_map *um,
 	int c1, c2;
 	int i = 0;
 
+	if (utf8_is_ascii(s1->name, s1->len)) {
+		for (; i < s1->len; i++)
+			if (utf8_ascii_fold(s1->name[i]) != cf->name[i])
+				return 1;
+		return cf->name[i] ? 1 : 0;
+	}
+
 	if (utf8ncursor(&cur1, data, s1->name, s1->len) < 0)
 		return -EINVAL;
 
@@ -109,6 +159,15 @@ int utf8_casefold(const struct unicode_map *um, const struct qstr *str,
 	struct utf8cursor cur;
 	size_t nlen = 0;
 
+	if (utf8_is_ascii(str->name, str->len)) {
+		if (str->len >= dlen)
+			return -EINVAL;
+		for (nlen = 0; nlen < str->len; nlen++)
+			dest[nlen] = utf8_ascii_fold(str->name[nlen]);
+		dest[nlen] = 0;
+		return nlen;
+	}
+
 	if (utf8ncursor(&cur, data, str->name, str->len) < 0)
 		return -EINVAL;
 
@@ -133,6 +192,16 @@ int utf8_casefold_hash(const struct unicode_map *um, const void *salt,
 	int c;
 	unsigned long hash = init_name_hash(salt);
 
+	if (utf8_is_ascii(str->name, str->len)) {
+		unsigned int i;
+
+		for (i = 0; i < str->len; i++)
+			hash = partial_name_hash(utf8_ascii_fold(str->name[i]),
+						 hash);
+		str->hash = end_name_hash(hash);
+		return 0;
+	}
+
 	if (utf8ncursor(&cur, data, str->name, str->len) < 0)
 		return -EINVAL;
 
@@ -146,6 +215,56 @@ int utf8_casefold_hash(const struct unicode_map *um, const void *salt,
 }
 EXPORT_SYMBOL(utf8_casefold_hash);
 
+/*
+ * Casefold hints let a filesystem keep the result of one casefold pass
+ * next to a name (in its per-dentry d_fsdata or in its lookup name
+ * structure) so that d_hash and d_compare, and the directory scan that
+ * follows a dcache miss, do not walk the utf8data trie for it again.
+ *
+ * A hint is only trusted for hash comparisons against another hint
+ * computed with the same salt.
+ */
+int utf8_casefold_hash_hint(const struct unicode_map *um, const void *salt,
+			    struct qstr *str, struct utf8_cf_hint *hint)
+{
+	int ret;
+
+	if ((hint->flags & UTF8_CF_HINT_HASHED) && hint->salt == salt) {
+		str->hash = hint->hash;
+		return 0;
+	}
+
+	ret = utf8_casefold_hash(um, salt, str);
+	if (ret)
+		return ret;
+
+	hint->salt = salt;
+	hint->hash = str->hash;
+	hint->flags = UTF8_CF_HINT_HASHED;
+	if (utf8_is_ascii(str->name, str->len))
+		hint->flags |= UTF8_CF_HINT_ASCII;
+	return 0;
+}
+EXPORT_SYMBOL(utf8_casefold_hash_hint);
+
+int utf8_strncasecmp_hint(const struct unicode_map *um,
+			  const struct qstr *s1, const struct utf8_cf_hint *h1,
+			  const struct qstr *s2, const struct utf8_cf_hint *h2)
+{
+	if ((h1->flags & h2->flags & UTF8_CF_HINT_HASHED) &&
+	    h1->salt == h2->salt && h1->hash != h2->hash)
+		return 1;
+
+	if (h1->flags & h2->flags & UTF8_CF_HINT_ASCII) {
+		if (s1->len != s2->len)
+			return 1;
+		return utf8_ascii_strncasecmp(s1->name, s2->name, s1->len);
+	}
+
+	return utf8_strncasecmp(um, s1, s2);
+}
+EXPORT_SYMBOL(utf8_strncasecmp_hint);
+
 int utf8_normalize(const struct unicode_map *um, const struct qstr *str,
 		   unsigned char *dest, size_t dlen)
 {
@@ -19,6 +19,7 @@
 #include <linux/printk.h>
 #include <linux/unicode.h>
 #include <linux/dcache.h>
+#include <linux/ktime.h>
 
 #include "utf8n.h"
 
@@ -274,6 +275,160 @@ static void check_utf8_comparisons(void)
 	utf8_unload(table);
 }
 
+static void check_utf8_ascii_fast_path(void)
+{
+	struct unicode_map *table = utf8_load("12.1.0");
+	const struct qstr upper = QSTR_INIT("DCIM-Camera_0001.JPG", 20);
+	const struct qstr lower = QSTR_INIT("dcim-camera_0001.jpg", 20);
+	const struct qstr other = QSTR_INIT("dcim-camera_0002.jpg", 20);
+	/* "K" and KELVIN SIGN fold to the same letter. */
+	const struct qstr kelvin = {.name = "\xe2\x84\xaa", .len = 3};
+	const struct qstr k = QSTR_INIT("k", 1);
+	struct utf8_cf_hint h1, h2;
+	struct qstr q1 = upper, q2 = lower;
+	unsigned char buf[32];
+
+	if (IS_ERR(table)) {
+		pr_err("%s: Unable to load utf8 %d.%d.%d. Skipping.\n",
+		       __func__, latest_maj, latest_min, latest_rev);
+		return;
+	}
+
+	test(!utf8_strncasecmp(table, &upper, &lower));
+	test(utf8_strncasecmp(table, &upper, &other) == 1);
+	test(!utf8_strncasecmp(table, &kelvin, &k));
+	test(utf8_casefold(table, &upper, buf, sizeof(buf)) == lower.len);
+	test(!memcmp(buf, lower.name, lower.len + 1));
+	test(!utf8_strncasecmp_folded(table, &lower, &upper));
+	test(utf8_strncasecmp_folded(table, &other, &upper) == 1);
+
+	utf8_cf_hint_init(&h1);
+	utf8_cf_hint_init(&h2);
+	test(!utf8_casefold_hash_hint(table, NULL, &q1, &h1));
+	test(!utf8_casefold_hash_hint(table, NULL, &q2, &h2));
+	test(q1.hash == q2.hash);
+	test(h1.flags & UTF8_CF_HINT_ASCII);
+	test(!utf8_strncasecmp_hint(table, &upper, &h1, &lower, &h2));
+
+	utf8_unload(table);
+}
+
+#define UTF8_BENCH_LOOPS	100000
+
+/*
+ * The lookup path as it was before the ASCII fast path: every name is
+ * walked through the utf8data trie. Kept here so the benchmark can time
+ * it on the same input as the new paths.
+ */
+static int bench_trie_hash(const struct utf8data *data, struct qstr *str)
+{
+	struct utf8cursor cur;
+	unsigned long hash = init_name_hash(NULL);
+	int c;
+
+	if (utf8ncursor(&cur, data, str->name, str->len) < 0)
+		return -EINVAL;
+
+	while ((c = utf8byte(&cur))) {
+		if (c < 0)
+			return c;
+		hash = partial_name_hash((unsigned char)c, hash);
+	}
+	str->hash = end_name_hash(hash);
+	return 0;
+}
+
+static int bench_trie_strncasecmp(const struct utf8data *data,
+				  const struct qstr *s1, const struct qstr *s2)
+{
+	struct utf8cursor cur1, cur2;
+	int c1, c2;
+
+	if (utf8ncursor(&cur1, data, s1->name, s1->len) < 0 ||
+	    utf8ncursor(&cur2, data, s2->name, s2->len) < 0)
+		return -EINVAL;
+
+	do {
+		c1 = utf8byte(&cur1);
+		c2 = utf8byte(&cur2);
+
+		if (c1 < 0 || c2 < 0)
+			return -EINVAL;
+		if (c1 != c2)
+			return 1;
+	} while (c1);
+
+	return 0;
+}
+
+static void bench_utf8_lookup(struct unicode_map *table, const char *what,
+			      const struct qstr *s1, const struct qstr *s2)
+{
+	const struct utf8data *data = utf8nfdicf(table->version);
+	struct utf8_cf_hint h1, h2;
+	struct qstr q1 = *s1, q2 = *s2, t1 = *s1;
+	ktime_t start;
+	u64 trie, fast, hinted;
+	int i;
+
+	/* both paths must agree before their timings mean anything */
+	test(!bench_trie_hash(data, &t1));
+	test(!utf8_casefold_hash(table, NULL, &q1));
+	test_f((t1.hash == q1.hash), "%s: trie hash %x, fast path hash %x\n",
+	       what, t1.hash, q1.hash);
+	test((bench_trie_strncasecmp(data, s1, s2) ==
+	      utf8_strncasecmp(table, s1, s2)));
+
+	start = ktime_get();
+	for (i = 0; i < UTF8_BENCH_LOOPS; i++) {
+		bench_trie_hash(data, &t1);
+		bench_trie_strncasecmp(data, s1, s2);
+	}
+	trie = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	start = ktime_get();
+	for (i = 0; i < UTF8_BENCH_LOOPS; i++) {
+		utf8_casefold_hash(table, NULL, &q1);
+		utf8_strncasecmp(table, s1, s2);
+	}
+	fast = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	utf8_cf_hint_init(&h1);
+	utf8_cf_hint_init(&h2);
+	utf8_casefold_hash_hint(table, NULL, &q2, &h2);
+	start = ktime_get();
+	for (i = 0; i < UTF8_BENCH_LOOPS; i++) {
+		utf8_casefold_hash_hint(table, NULL, &q1, &h1);
+		utf8_strncasecmp_hint(table, s1, &h1, s2, &h2);
+	}
+	hinted = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	pr_info("%s lookup: %llu ns trie walk, %llu ns fast path, %llu ns with hints\n",
+		what, div_u64(trie, UTF8_BENCH_LOOPS),
+		div_u64(fast, UTF8_BENCH_LOOPS),
+		div_u64(hinted, UTF8_BENCH_LOOPS));
+}
+
+static void bench_utf8_lookups(void)
+{
+	struct unicode_map *table = utf8_load("12.1.0");
+	const struct qstr ascii1 = QSTR_INIT("IMG_20200101_123456.jpg", 23);
+	const struct qstr ascii2 = QSTR_INIT("img_20200101_123456.JPG", 23);
+	/* "Ärger_Übersicht.txt" in NFC and NFD forms. */
+	const struct qstr utf1 = {.name = "\xc3\x84rger_\xc3\x9cbersicht.txt",
+				  .len = 21};
+	const struct qstr utf2 = {.name = "a\xcc\x88rger_u\xcc\x88bersicht.txt",
+				  .len = 23};
+
+	if (IS_ERR(table))
+		return;
+
+	bench_utf8_lookup(table, "ASCII", &ascii1, &ascii2);
+	bench_utf8_lookup(table, "non-ASCII", &utf1, &utf2);
+
+	utf8_unload(table);
+}
+
 static void check_supported_versions(void)
 {
 	/* Unicode 7.0.0 should be supported. */
@@ -300,6 +455,8 @@ static int __init init_test_ucd(void)
 	check_utf8_nfdi();
 	check_utf8_nfdicf();
 	check_utf8_comparisons();
+	check_utf8_ascii_fast_path();
+	bench_utf8_lookups();
 
 	if (!failed_tests)
 		pr_info("All %u tests passed\n", total_tests);
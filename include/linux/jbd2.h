@@ -756,6 +756,18 @@ jbd2_time_diff(unsigned long start, unsigned long end)
 
 #define JBD2_NR_BATCH	64
 
+/*
+ * Credits a cpu takes from the running transaction in one go, and how many
+ * later checkpoint transactions get their writeback started early.
+ */
+#define JBD2_PCPU_CREDITS	32
+#define JBD2_CHECKPOINT_AHEAD	4
+
+struct jbd2_credit_cache {
+	tid_t	tid;
+	int	credits;
+};
+
 /**
  * struct journal_s - The journal_s type is the concrete type associated with
  *     journal_t.
@@ -960,6 +972,15 @@ struct journal_s
 	 */
 	atomic_t		j_reserved_credits;
 
+	/**
+	 * @j_credit_cache:
+	 *
+	 * Per-cpu credits charged to the running transaction in bulk, so
+	 * that most handles do not touch @t_outstanding_credits. Unused
+	 * credits are given back when the transaction is locked for commit.
+	 */
+	struct jbd2_credit_cache __percpu *j_credit_cache;
+
 	/**
 	 * @j_list_lock: Protects the buffer lists and internal buffer state.
 	 */
@@ -1264,6 +1285,7 @@ extern void jbd2_journal_refile_buffer(journal_t *, struct journal_head *);
 extern void __jbd2_journal_file_buffer(struct journal_head *, transaction_t *, int);
 extern void __journal_free_buffer(struct journal_head *bh);
 extern void jbd2_journal_file_buffer(struct journal_head *, transaction_t *, int);
+extern void __jbd2_journal_fold_credits(journal_t *, transaction_t *);
 extern void __journal_clean_data_list(transaction_t *transaction);
 static inline void jbd2_file_log_bh(struct list_head *head, struct buffer_head *bh)
 {
@@ -30,6 +30,13 @@
  * PRZ_FLAG_NO_LOCK is used. For all other cases, locking is required.
  */
 #define PRZ_FLAG_NO_LOCK	BIT(0)
+/*
+ * Only recompute ECC once a full ECC block worth of data has been written
+ * (or on persistent_ram_flush_ecc()) instead of on every write. Data written
+ * since the last checkpoint may be lost on an unclean reset. Only valid for
+ * zones with a single writer at a time, like per-cpu ftrace zones or pmsg.
+ */
+#define PRZ_FLAG_DEFERRED_ECC	BIT(1)
 
 struct persistent_ram_buffer;
 struct rs_control;
@@ -58,6 +65,9 @@ struct persistent_ram_zone {
 	int corrected_bytes;
 	int bad_blocks;
 	struct persistent_ram_ecc_info ecc_info;
+	/* PRZ_FLAG_DEFERRED_ECC: data written since the last ECC update */
+	size_t ecc_pending_start;
+	size_t ecc_pending;
 
 	char *old_log;
 	size_t old_log_size;
@@ -74,6 +84,8 @@ int persistent_ram_write(struct persistent_ram_zone *prz, const void *s,
 int persistent_ram_write_user(struct persistent_ram_zone *prz,
 			      const void __user *s, unsigned int count);
 
+void persistent_ram_flush_ecc(struct persistent_ram_zone *prz);
+
 void persistent_ram_save_old(struct persistent_ram_zone *prz);
 size_t persistent_ram_old_size(struct persistent_ram_zone *prz);
 void *persistent_ram_old(struct persistent_ram_zone *prz);
@@ -88,6 +100,7 @@ ssize_t persistent_ram_ecc_string(struct persistent_ram_zone *prz,
  */
 
 #define RAMOOPS_FLAG_FTRACE_PER_CPU	BIT(0)
+#define RAMOOPS_FLAG_DEFERRED_ECC	BIT(1)
 
 struct ramoops_platform_data {
 	unsigned long	mem_size;
@@ -46,6 +46,7 @@ struct sock_xprt {
 	unsigned long		sock_state;
 	struct delayed_work	connect_worker;
 	struct work_struct	recv_worker;
+	struct work_struct	uncork_worker;
 	struct mutex		recv_mutex;
 	struct sockaddr_storage	srcaddr;
 	unsigned short		srcport;
@@ -85,6 +86,7 @@ struct sock_xprt {
 #define XPRT_SOCK_CONNECTING	1U
 #define XPRT_SOCK_DATA_READY	(2)
 #define XPRT_SOCK_UPD_TIMEOUT	(3)
+#define XPRT_SOCK_CORKED	(4)
 
 #endif /* __KERNEL__ */
 
@@ -10,6 +10,26 @@ struct unicode_map {
 	int version;
 };
 
+/*
+ * Cached result of casefolding a name, see utf8_casefold_hash_hint().
+ * A zeroed hint is empty.
+ */
+struct utf8_cf_hint {
+	const void *salt;
+	unsigned int hash;
+	unsigned int flags;
+};
+
+#define UTF8_CF_HINT_HASHED	0x1	/* hash is valid for salt */
+#define UTF8_CF_HINT_ASCII	0x2	/* name is plain ASCII */
+
+static inline void utf8_cf_hint_init(struct utf8_cf_hint *hint)
+{
+	hint->salt = NULL;
+	hint->hash = 0;
+	hint->flags = 0;
+}
+
 int utf8_validate(const struct unicode_map *um, const struct qstr *str);
 
 int utf8_strncmp(const struct unicode_map *um,
@@ -30,6 +50,13 @@ int utf8_casefold(const struct unicode_map *um, const struct qstr *str,
 int utf8_casefold_hash(const struct unicode_map *um, const void *salt,
 		       struct qstr *str);
 
+int utf8_casefold_hash_hint(const struct unicode_map *um, const void *salt,
+			    struct qstr *str, struct utf8_cf_hint *hint);
+
+int utf8_strncasecmp_hint(const struct unicode_map *um,
+			  const struct qstr *s1, const struct utf8_cf_hint *h1,
+			  const struct qstr *s2, const struct utf8_cf_hint *h2);
+
 struct unicode_map *utf8_load(const char *version);
 void utf8_unload(struct unicode_map *um);
 
@@ -9,6 +9,7 @@
  * Linux distribution for more details.
  */
 
+#include <linux/bitops.h>
 #include <linux/bpf.h>
 #include <linux/btf.h>
 #include <linux/err.h>
@@ -31,9 +32,36 @@ struct lpm_trie_node {
 	u8				data[0];
 };
 
+/* Multi-bit lookup index, see the comment above lpm_stride_lookup() */
+#define LPM_STRIDE_BITS		8
+#define LPM_STRIDE_SLOTS	(1 << LPM_STRIDE_BITS)
+#define LPM_STRIDE_WORDS	(LPM_STRIDE_SLOTS / 64)
+
+struct lpm_stride_node {
+	struct rcu_head			rcu;
+	u64				vector[LPM_STRIDE_WORDS];
+	u64				leafvec[LPM_STRIDE_WORDS];
+	u8				vbase[LPM_STRIDE_WORDS];
+	u8				lbase[LPM_STRIDE_WORDS];
+	u16				nr_children;
+	u16				nr_leaves;
+	/* nr_children child pointers, followed by nr_leaves leaves */
+	struct lpm_stride_node __rcu	*child[0];
+};
+
+/* Expanded form of one stride node, only used under trie->lock */
+struct lpm_stride_scratch {
+	struct lpm_trie_node		*leaf[LPM_STRIDE_SLOTS];
+	struct lpm_stride_node		*child[LPM_STRIDE_SLOTS];
+	struct lpm_stride_node		*path[0];
+};
+
 struct lpm_trie {
 	struct bpf_map			map;
 	struct lpm_trie_node __rcu	*root;
+	struct lpm_stride_node __rcu	*stride_root;
+	struct lpm_stride_scratch	*scratch;
+	bool				stride_off;
 	size_t				n_entries;
 	size_t				max_prefixlen;
 	size_t				data_size;
@@ -187,6 +215,82 @@ static size_t longest_prefix_match(const struct lpm_trie *trie,
 	return prefixlen;
 }
 
+static inline struct lpm_trie_node **
+lpm_stride_leaves(struct lpm_stride_node *snode)
+{
+	return (struct lpm_trie_node **)&snode->child[snode->nr_children];
+}
+
+static inline struct lpm_trie_node *
+lpm_stride_leaf(struct lpm_stride_node *snode, unsigned int s)
+{
+	unsigned int w = s / 64;
+	unsigned int idx;
+
+	idx = snode->lbase[w] +
+	      hweight64(snode->leafvec[w] & GENMASK_ULL(s % 64, 0)) - 1;
+	return lpm_stride_leaves(snode)[idx];
+}
+
+static inline int lpm_stride_child_idx(const struct lpm_stride_node *snode,
+				       unsigned int s)
+{
+	unsigned int w = s / 64;
+	u64 bit = BIT_ULL(s % 64);
+
+	if (!(snode->vector[w] & bit))
+		return -1;
+	return snode->vbase[w] + hweight64(snode->vector[w] & (bit - 1));
+}
+
+/* The binary trie needs one node visit, and usually one cache miss, per
+ * distinguishing bit. For full-length lookups, which is what programs
+ * matching packet addresses do, a second index with a stride of 8 bits
+ * is maintained next to it, so that an IPv6 lookup visits at most 16
+ * nodes and an IPv4 lookup at most 4.
+ *
+ * The stride node at depth d for the d-byte prefix A exists as long as
+ * the trie holds an entry longer than 8 * d bits starting with A. Its
+ * 256 slots correspond to the values of byte d of the key. For each
+ * slot it records the longest entry with a prefix length in
+ * (8 * d, 8 * d + 8] covering that slot (the root also covers /0), and
+ * whether there is a stride node one level down.
+ *
+ * Both sets are bitmap compressed, in the spirit of poptrie: @vector
+ * has a bit set for each slot with a child, which are stored densely,
+ * and @leafvec has a bit set for each slot where the leaf differs from
+ * the one of the previous slot, so a range of slots covered by the
+ * same entry takes up one pointer. A population count on one word plus
+ * a per-word base gives the array index.
+ *
+ * The binary trie stays authoritative for updates, deletions and key
+ * iteration. After each change, the stride node covering the changed
+ * entry is rebuilt from it and published RCU-style, copying the
+ * ancestors only when a child node appears or disappears.
+ */
+static struct lpm_trie_node *lpm_stride_lookup(const struct lpm_trie *trie,
+					       const u8 *data)
+{
+	struct lpm_trie_node *leaf, *found = NULL;
+	struct lpm_stride_node *snode;
+	size_t i;
+	int idx;
+
+	snode = rcu_dereference(trie->stride_root);
+	for (i = 0; snode && i < trie->data_size; i++) {
+		leaf = lpm_stride_leaf(snode, data[i]);
+		if (leaf)
+			found = leaf;
+
+		idx = lpm_stride_child_idx(snode, data[i]);
+		if (idx < 0)
+			break;
+		snode = rcu_dereference(snode->child[idx]);
+	}
+
+	return found;
+}
+
 /* Called from syscall or from eBPF program */
 static void *trie_lookup_elem(struct bpf_map *map, void *_key)
 {
@@ -197,6 +301,12 @@ static void *trie_lookup_elem(struct bpf_map *map, void *_key)
 	if (key->prefixlen > trie->max_prefixlen)
 		return NULL;
 
+	if (key->prefixlen == trie->max_prefixlen &&
+	    !READ_ONCE(trie->stride_off)) {
+		found = lpm_stride_lookup(trie, key->data);
+		goto out;
+	}
+
 	/* Start walking the trie from the root node ... */
 
 	for (node = rcu_dereference(trie->root); node;) {
@@ -234,6 +344,7 @@ static void *trie_lookup_elem(struct bpf_map *map, void *_key)
 		node = rcu_dereference(node->child[next_bit]);
 	}
 
+out:
 	if (!found)
 		return NULL;
 
@@ -263,6 +374,234 @@ static struct lpm_trie_node *lpm_trie_node_alloc(const struct lpm_trie *trie,
 	return node;
 }
 
+/* Find the binary subtree holding all entries that start with the first
+ * @depth bytes of @data and are at least 8 * @depth bits long.
+ */
+static struct lpm_trie_node *lpm_stride_subtree(struct lpm_trie *trie,
+						const u8 *data, size_t depth)
+{
+	struct lpm_trie_node *node;
+
+	node = rcu_dereference_protected(trie->root,
+					 lockdep_is_held(&trie->lock));
+	while (node && node->prefixlen < depth * 8)
+		node = rcu_dereference_protected(
+				node->child[extract_bit(data, node->prefixlen)],
+				lockdep_is_held(&trie->lock));
+
+	/* path compression skips bits, so check the ones we care about */
+	if (node && memcmp(node->data, data, depth))
+		return NULL;
+
+	return node;
+}
+
+/* Fill the scratch leaves of the stride node at @depth from the binary
+ * subtree at @node. The walk is preorder, so more specific entries
+ * overwrite the slots of the less specific ones covering them. It
+ * stops at entries longer than the stride, so it recurses at most
+ * LPM_STRIDE_BITS + 1 levels.
+ */
+static void lpm_stride_paint(struct lpm_trie *trie, struct lpm_trie_node *node,
+			     size_t depth)
+{
+	size_t lo = depth * 8, hi = lo + LPM_STRIDE_BITS;
+	unsigned int s, n;
+
+	if (!node || node->prefixlen > hi)
+		return;
+
+	if (!(node->flags & LPM_TREE_NODE_FLAG_IM) &&
+	    (node->prefixlen > lo || !depth)) {
+		n = 1U << (hi - node->prefixlen);
+		s = node->data[depth] & ~(n - 1);
+		while (n--)
+			trie->scratch->leaf[s++] = node;
+	}
+
+	lpm_stride_paint(trie, rcu_dereference_protected(node->child[0],
+				lockdep_is_held(&trie->lock)), depth);
+	lpm_stride_paint(trie, rcu_dereference_protected(node->child[1],
+				lockdep_is_held(&trie->lock)), depth);
+}
+
+static void lpm_stride_node_expand(struct lpm_trie *trie,
+				   struct lpm_stride_node *snode)
+{
+	struct lpm_stride_scratch *sc = trie->scratch;
+	struct lpm_trie_node **leaves, *leaf = NULL;
+	unsigned int s, c = 0, l = 0;
+
+	memset(sc->leaf, 0, sizeof(sc->leaf));
+	memset(sc->child, 0, sizeof(sc->child));
+	if (!snode)
+		return;
+
+	leaves = lpm_stride_leaves(snode);
+	for (s = 0; s < LPM_STRIDE_SLOTS; s++) {
+		u64 bit = BIT_ULL(s % 64);
+
+		if (snode->leafvec[s / 64] & bit)
+			leaf = leaves[l++];
+		sc->leaf[s] = leaf;
+		if (snode->vector[s / 64] & bit)
+			sc->child[s] = rcu_dereference_protected(
+					snode->child[c++],
+					lockdep_is_held(&trie->lock));
+	}
+}
+
+/* Compress the scratch node. Returns NULL if it would be empty. */
+static struct lpm_stride_node *lpm_stride_node_build(struct lpm_trie *trie)
+{
+	struct lpm_stride_scratch *sc = trie->scratch;
+	u64 vector[LPM_STRIDE_WORDS] = {}, leafvec[LPM_STRIDE_WORDS] = {};
+	unsigned int s, w, nc = 0, nl = 0;
+	struct lpm_stride_node *snode;
+	struct lpm_trie_node **leaves;
+	bool empty = true;
+
+	for (s = 0; s < LPM_STRIDE_SLOTS; s++) {
+		if (sc->child[s]) {
+			vector[s / 64] |= BIT_ULL(s % 64);
+			nc++;
+			empty = false;
+		}
+		if (!s || sc->leaf[s] != sc->leaf[s - 1]) {
+			leafvec[s / 64] |= BIT_ULL(s % 64);
+			nl++;
+		}
+		if (sc->leaf[s])
+			empty = false;
+	}
+	if (empty)
+		return NULL;
+
+	snode = kmalloc_node(sizeof(*snode) + (nc + nl) * sizeof(void *),
+			     GFP_ATOMIC | __GFP_NOWARN, trie->map.numa_node);
+	if (!snode)
+		return ERR_PTR(-ENOMEM);
+
+	snode->nr_children = nc;
+	snode->nr_leaves = nl;
+	nc = 0;
+	nl = 0;
+	for (w = 0; w < LPM_STRIDE_WORDS; w++) {
+		snode->vector[w] = vector[w];
+		snode->leafvec[w] = leafvec[w];
+		snode->vbase[w] = nc;
+		snode->lbase[w] = nl;
+		nc += hweight64(vector[w]);
+		nl += hweight64(leafvec[w]);
+	}
+
+	leaves = lpm_stride_leaves(snode);
+	nc = 0;
+	nl = 0;
+	for (s = 0; s < LPM_STRIDE_SLOTS; s++) {
+		if (sc->child[s])
+			RCU_INIT_POINTER(snode->child[nc++], sc->child[s]);
+		if (leafvec[s / 64] & BIT_ULL(s % 64))
+			leaves[nl++] = sc->leaf[s];
+	}
+
+	return snode;
+}
+
+static struct lpm_stride_node *
+lpm_stride_child(struct lpm_trie *trie, struct lpm_stride_node *snode,
+		 unsigned int s)
+{
+	int idx = lpm_stride_child_idx(snode, s);
+
+	if (idx < 0)
+		return NULL;
+	return rcu_dereference_protected(snode->child[idx],
+					 lockdep_is_held(&trie->lock));
+}
+
+/* Resync the stride index after the entry for @key was added, replaced
+ * or removed in the binary trie. Only the stride node covering the
+ * prefix length of @key changes its leaves; its ancestors are copied
+ * only if it appears or disappears, otherwise the new node is swapped
+ * into its parent's child slot in place.
+ *
+ * If memory runs out, the index is left stale and lookups fall back to
+ * the binary trie for the lifetime of the map.
+ */
+static void lpm_stride_update(struct lpm_trie *trie,
+			      const struct bpf_lpm_trie_key *key)
+{
+	struct lpm_stride_scratch *sc = trie->scratch;
+	struct lpm_stride_node *snode, *old, *new;
+	size_t depth, target, i;
+
+	if (trie->stride_off)
+		return;
+
+	target = key->prefixlen ? (key->prefixlen - 1) / LPM_STRIDE_BITS : 0;
+
+	snode = rcu_dereference_protected(trie->stride_root,
+					  lockdep_is_held(&trie->lock));
+	for (depth = 0; depth <= target; depth++) {
+		sc->path[depth] = snode;
+		if (snode)
+			snode = lpm_stride_child(trie, snode, key->data[depth]);
+	}
+
+	old = sc->path[target];
+	lpm_stride_node_expand(trie, old);
+	memset(sc->leaf, 0, sizeof(sc->leaf));
+	lpm_stride_paint(trie, lpm_stride_subtree(trie, key->data, target),
+			 target);
+	new = lpm_stride_node_build(trie);
+	if (IS_ERR(new))
+		goto disable;
+
+	for (depth = target; depth > 0; depth--) {
+		struct lpm_stride_node *parent = sc->path[depth - 1];
+		struct lpm_stride_node *copy;
+		unsigned int s = key->data[depth - 1];
+
+		if (!old && !new)
+			return;
+
+		if (old && new) {
+			rcu_assign_pointer(parent->child[
+					lpm_stride_child_idx(parent, s)], new);
+			goto free_old;
+		}
+
+		lpm_stride_node_expand(trie, parent);
+		sc->child[s] = new;
+		copy = lpm_stride_node_build(trie);
+		if (IS_ERR(copy))
+			goto free_new;
+
+		old = parent;
+		new = copy;
+	}
+
+	rcu_assign_pointer(trie->stride_root, new);
+
+free_old:
+	for (i = depth; i <= target; i++)
+		if (sc->path[i])
+			kfree_rcu(sc->path[i], rcu);
+	return;
+
+free_new:
+	/* Nothing below @depth has been published yet */
+	for (; new; depth++) {
+		snode = depth < target ?
+			lpm_stride_child(trie, new, key->data[depth]) : NULL;
+		kfree(new);
+		new = snode;
+	}
+disable:
+	WRITE_ONCE(trie->stride_off, true);
+}
+
 /* Called from syscall or from eBPF program */
 static int trie_update_elem(struct bpf_map *map,
 			    void *_key, void *value, u64 flags)
@@ -387,6 +726,8 @@ static int trie_update_elem(struct bpf_map *map,
 
 		kfree(new_node);
 		kfree(im_node);
+	} else {
+		lpm_stride_update(trie, key);
 	}
 
 	raw_spin_unlock_irqrestore(&trie->lock, irq_flags);
@@ -485,6 +826,9 @@ static int trie_delete_elem(struct bpf_map *map, void *_key)
 	kfree_rcu(node, rcu);
 
 out:
+	if (!ret)
+		lpm_stride_update(trie, key);
+
 	raw_spin_unlock_irqrestore(&trie->lock, irq_flags);
 
 	return ret;
@@ -533,9 +877,15 @@ static struct bpf_map *trie_alloc(union bpf_attr *attr)
 			  offsetof(struct bpf_lpm_trie_key, data);
 	trie->max_prefixlen = trie->data_size * 8;
 
+	/* The stride index needs about one node plus a leaf and a child
+	 * pointer per entry for the prefix distributions seen in practice.
+	 */
 	cost_per_node = sizeof(struct lpm_trie_node) +
-			attr->value_size + trie->data_size;
+			attr->value_size + trie->data_size +
+			sizeof(struct lpm_stride_node) + 2 * sizeof(void *);
 	cost += (u64) attr->max_entries * cost_per_node;
+	cost += sizeof(struct lpm_stride_scratch) +
+		trie->data_size * sizeof(struct lpm_stride_node *);
 	if (cost >= U32_MAX - PAGE_SIZE) {
 		ret = -E2BIG;
 		goto out_err;
@@ -547,6 +897,16 @@ static struct bpf_map *trie_alloc(union bpf_attr *attr)
 	if (ret)
 		goto out_err;
 
+	trie->scratch = kmalloc_node(sizeof(struct lpm_stride_scratch) +
+				     trie->data_size *
+				     sizeof(struct lpm_stride_node *),
+				     GFP_USER | __GFP_NOWARN,
+				     trie->map.numa_node);
+	if (!trie->scratch) {
+		ret = -ENOMEM;
+		goto out_err;
+	}
+
 	raw_spin_lock_init(&trie->lock);
 
 	return &trie->map;
@@ -558,14 +918,46 @@ static struct bpf_map *trie_alloc(union bpf_attr *attr)
 static void trie_free(struct bpf_map *map)
 {
 	struct lpm_trie *trie = container_of(map, struct lpm_trie, map);
+	struct lpm_stride_node __rcu **sslot;
 	struct lpm_trie_node __rcu **slot;
+	struct lpm_stride_node *snode;
 	struct lpm_trie_node *node;
+	unsigned int i;
 
 	/* Wait for outstanding programs to complete
 	 * update/lookup/delete/get_next_key and free the trie.
 	 */
 	synchronize_rcu();
 
+	/* Free the stride index the same way as the trie below, descending
+	 * into the first remaining child each time.
+	 */
+	for (;;) {
+		sslot = &trie->stride_root;
+
+		for (;;) {
+			snode = rcu_dereference_protected(*sslot, 1);
+			if (!snode)
+				goto free_trie;
+
+			for (i = 0; i < snode->nr_children; i++)
+				if (rcu_access_pointer(snode->child[i]))
+					break;
+
+			if (i < snode->nr_children) {
+				sslot = &snode->child[i];
+				continue;
+			}
+
+			kfree(snode);
+			RCU_INIT_POINTER(*sslot, NULL);
+			break;
+		}
+	}
+
+free_trie:
+	kfree(trie->scratch);
+
 	/* Always start at the root and walk down to a node that has no
 	 * children. Then free that node, nullify its reference in the parent
 	 * and start over.
@@ -2043,6 +2043,10 @@ static int cpuset_css_online(struct cgroup_subsys_state *css)
 		set_bit(CS_SPREAD_PAGE, &cs->flags);
 	if (is_spread_slab(parent))
 		set_bit(CS_SPREAD_SLAB, &cs->flags);
+#ifdef CONFIG_MTK_SCHED_EXTENSION
+	/* a new group starts with the placement hint of its parent */
+	cs->prefer_cpu = parent->prefer_cpu;
+#endif
 
 	cpuset_inc();
 
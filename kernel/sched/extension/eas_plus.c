@@ -71,6 +71,15 @@ LIST_HEAD(perf_order_domains);
 DEFINE_PER_CPU(struct perf_order_domain *, perf_order_cpu_domain);
 static bool pod_ready;
 
+/*
+ * Cached copy of the list order, so the wakeup path can index domains
+ * and compare a cpu's rank instead of walking the list.
+ * Rank 0 is the slowest domain.
+ */
+static struct perf_order_domain *perf_order_domain_asc[NR_CPUS];
+static int perf_order_domain_cnt;
+static DEFINE_PER_CPU(int, perf_order_cpu_rank);
+
 bool pod_is_ready(void)
 {
 	return pod_ready;
@@ -80,16 +89,18 @@ bool pod_is_ready(void)
 void perf_order_cpu_mask_setup(void)
 {
 	struct perf_order_domain *domain;
-	struct list_head *pos;
-	int cpu;
+	int cpu, rank = 0;
 
-	list_for_each(pos, &perf_order_domains) {
-		domain = list_entry(pos, struct perf_order_domain,
-					perf_order_domains);
+	for_each_perf_domain_ascending(domain) {
+		perf_order_domain_asc[rank] = domain;
 
-		for_each_cpu(cpu, &domain->possible_cpus)
+		for_each_cpu(cpu, &domain->possible_cpus) {
 			per_cpu(perf_order_cpu_domain, cpu) = domain;
+			per_cpu(perf_order_cpu_rank, cpu) = rank;
+		}
+		rank++;
 	}
+	perf_order_domain_cnt = rank;
 }
 
 /*
@@ -206,30 +217,24 @@ EXPORT_SYMBOL(init_perf_order_domains);
 /* Check if cpu is in fastest perf_order_domain */
 inline unsigned int cpu_is_fastest(int cpu)
 {
-	struct list_head *pos;
-
 	if (!pod_is_ready()) {
 		printk_deferred("Perf order domain is not ready!\n");
 		return -1;
 	}
 
-	pos = &perf_order_cpu_domain(cpu)->perf_order_domains;
-	return pos == perf_order_domains.next;
+	return per_cpu(perf_order_cpu_rank, cpu) == perf_order_domain_cnt - 1;
 }
 EXPORT_SYMBOL(cpu_is_fastest);
 
 /* Check if cpu is in slowest perf_order_domain */
 inline unsigned int cpu_is_slowest(int cpu)
 {
-	struct list_head *pos;
-
 	if (!pod_is_ready()) {
 		printk_deferred("Perf order domain is not ready!\n");
 		return -1;
 	}
 
-	pos = &perf_order_cpu_domain(cpu)->perf_order_domains;
-	return list_is_last(pos, &perf_order_domains);
+	return per_cpu(perf_order_cpu_rank, cpu) == 0;
 }
 EXPORT_SYMBOL(cpu_is_slowest);
 
@@ -292,8 +297,7 @@ int select_task_prefer_cpu(struct task_struct *p, int new_cpu)
 {
 	int task_prefer;
 	struct perf_order_domain *domain;
-	struct perf_order_domain *tmp_domain[5] = {0, 0, 0, 0, 0};
-	int i, iter_domain, domain_cnt = 0;
+	int i, iter_domain, domain_cnt = perf_order_domain_cnt;
 	int iter_cpu;
 	struct cpumask *tsk_cpus_allow = &p->cpus_allowed;
 #ifdef CONFIG_MTK_TASK_TURBO
@@ -306,15 +310,10 @@ int select_task_prefer_cpu(struct task_struct *p, int new_cpu)
 	if (!hinted_cpu_prefer(task_prefer) && !cpu_isolated(new_cpu))
 		return new_cpu;
 
-	for_each_perf_domain_ascending(domain) {
-		tmp_domain[domain_cnt] = domain;
-		domain_cnt++;
-	}
-
 	for (i = 0; i < domain_cnt; i++) {
 		iter_domain = (task_prefer == SCHED_PREFER_BIG) ?
 				domain_cnt-i-1 : i;
-		domain = tmp_domain[iter_domain];
+		domain = perf_order_domain_asc[iter_domain];
 
 #ifdef CONFIG_MTK_TASK_TURBO
 		/* check fastest domain for turbo task*/
@@ -322,7 +321,7 @@ int select_task_prefer_cpu(struct task_struct *p, int new_cpu)
 			break;
 #endif
 
-		if (cpumask_test_cpu(new_cpu, &domain->possible_cpus)
+		if (per_cpu(perf_order_cpu_rank, new_cpu) == iter_domain
 			&& !cpu_isolated(new_cpu))
 			return new_cpu;
 
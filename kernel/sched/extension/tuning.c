@@ -139,7 +139,7 @@ inline int cpu_prefer(struct task_struct *task)
 	if (cpu_prefer == SCHED_PREFER_LITTLE &&
 		uclamp_boosted(task))
 		cpu_prefer = SCHED_PREFER_NONE;
-	}
+
 	return cpu_prefer;
 }
 #else
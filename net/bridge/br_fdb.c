@@ -59,14 +59,47 @@ void br_fdb_fini(void)
 	kmem_cache_destroy(br_fdb_cache);
 }
 
+static void br_fdb_learn_work(struct work_struct *work);
+
 int br_fdb_hash_init(struct net_bridge *br)
 {
-	return rhashtable_init(&br->fdb_hash_tbl, &br_fdb_rht_params);
+	int cpu, err;
+
+	br->fdb_learn = alloc_percpu(struct br_fdb_learn_batch);
+	if (!br->fdb_learn)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		struct br_fdb_learn_batch *b = per_cpu_ptr(br->fdb_learn, cpu);
+
+		spin_lock_init(&b->lock);
+		b->count = 0;
+	}
+	INIT_WORK(&br->fdb_learn_work, br_fdb_learn_work);
+
+	err = rhashtable_init(&br->fdb_hash_tbl, &br_fdb_rht_params);
+	if (err)
+		free_percpu(br->fdb_learn);
+
+	return err;
 }
 
 void br_fdb_hash_fini(struct net_bridge *br)
 {
+	int cpu;
+
+	/* drop port references of entries queued after the last purge */
+	for_each_possible_cpu(cpu) {
+		struct br_fdb_learn_batch *b = per_cpu_ptr(br->fdb_learn, cpu);
+		unsigned int i;
+
+		for (i = 0; i < b->count; i++)
+			kobject_put(&b->entries[i].port->kobj);
+		b->count = 0;
+	}
+
 	rhashtable_destroy(&br->fdb_hash_tbl);
+	free_percpu(br->fdb_learn);
 }
 
 /* if topology_changing then use forward_delay (default 15 sec)
@@ -384,6 +417,32 @@ void br_fdb_flush(struct net_bridge *br)
 	spin_unlock_bh(&br->hash_lock);
 }
 
+/* Drop addresses still queued for learning on a port that is going away.
+ * Entries already taken by br_fdb_learn_work still pin the port and are
+ * skipped there, as the port is disabled by now.
+ */
+static void br_fdb_learn_purge(struct net_bridge *br,
+			       const struct net_bridge_port *p)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct br_fdb_learn_batch *b = per_cpu_ptr(br->fdb_learn, cpu);
+		unsigned int i, n = 0;
+
+		spin_lock_bh(&b->lock);
+		for (i = 0; i < b->count; i++) {
+			if (b->entries[i].port == p) {
+				kobject_put(&p->kobj);
+				continue;
+			}
+			b->entries[n++] = b->entries[i];
+		}
+		b->count = n;
+		spin_unlock_bh(&b->lock);
+	}
+}
+
 /* Flush all entries referring to a specific port.
  * if do_all is set also flush static entries
  * if vid is set delete all entries that match the vlan_id
@@ -396,6 +455,9 @@ void br_fdb_delete_by_port(struct net_bridge *br,
 	struct net_bridge_fdb_entry *f;
 	struct hlist_node *tmp;
 
+	if (p && do_all)
+		br_fdb_learn_purge(br, p);
+
 	spin_lock_bh(&br->hash_lock);
 	hlist_for_each_entry_safe(f, tmp, &br->fdb_list, fdb_node) {
 		if (f->dst != p)
@@ -558,6 +620,119 @@ int br_fdb_insert(struct net_bridge *br, struct net_bridge_port *source,
 	return ret;
 }
 
+/* Insert one batch of queued addresses and drop their port references.
+ * Called with hash_lock and rcu_read_lock held.  The port that saw the
+ * frame may have been removed in the meantime; it is disabled then.
+ */
+static void br_fdb_learn_insert(struct net_bridge *br,
+				const struct br_fdb_learn_entry *entries,
+				unsigned int count)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		const struct br_fdb_learn_entry *e = &entries[i];
+		struct net_bridge_port *source = e->port;
+		struct net_bridge_fdb_entry *fdb;
+
+		if (!(source->state == BR_STATE_LEARNING ||
+		      source->state == BR_STATE_FORWARDING))
+			goto put;
+
+		/* learned meanwhile, by another CPU or a previous batch */
+		if (fdb_find_rcu(&br->fdb_hash_tbl, e->addr, e->vid))
+			goto put;
+
+		fdb = fdb_create(br, source, e->addr, e->vid, 0, 0);
+		if (fdb) {
+			trace_br_fdb_update(br, source, e->addr, e->vid, false);
+			fdb_notify(br, fdb, RTM_NEWNEIGH, true);
+		}
+put:
+		kobject_put(&source->kobj);
+	}
+}
+
+static void br_fdb_learn_work(struct work_struct *work)
+{
+	struct net_bridge *br = container_of(work, struct net_bridge,
+					     fdb_learn_work);
+	struct br_fdb_learn_entry entries[BR_FDB_LEARN_BATCH];
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct br_fdb_learn_batch *b = per_cpu_ptr(br->fdb_learn, cpu);
+		unsigned int count;
+
+		spin_lock_bh(&b->lock);
+		count = b->count;
+		memcpy(entries, b->entries, count * sizeof(entries[0]));
+		b->count = 0;
+		spin_unlock_bh(&b->lock);
+
+		if (!count)
+			continue;
+
+		rcu_read_lock();
+		spin_lock_bh(&br->hash_lock);
+		br_fdb_learn_insert(br, entries, count);
+		spin_unlock_bh(&br->hash_lock);
+		rcu_read_unlock();
+	}
+}
+
+/* Queue a new source address on this CPU.  A full batch is inserted right
+ * away under a single hash_lock acquisition; a partial one is picked up by
+ * br_fdb_learn_work.  Called from the receive path in softirq context.
+ */
+static void br_fdb_learn_queue(struct net_bridge *br,
+			       struct net_bridge_port *source,
+			       const unsigned char *addr, u16 vid)
+{
+	struct br_fdb_learn_entry entries[BR_FDB_LEARN_BATCH];
+	struct br_fdb_learn_batch *b = this_cpu_ptr(br->fdb_learn);
+	struct br_fdb_learn_entry *e;
+	unsigned int i, count = 0;
+	bool kick = false;
+
+	spin_lock(&b->lock);
+	for (i = 0; i < b->count; i++) {
+		e = &b->entries[i];
+		if (e->vid == vid && ether_addr_equal(e->addr, addr)) {
+			if (e->port != source) {
+				kobject_get(&source->kobj);
+				kobject_put(&e->port->kobj);
+				e->port = source;
+			}
+			goto unlock;
+		}
+	}
+
+	e = &b->entries[b->count++];
+	ether_addr_copy(e->addr, addr);
+	e->vid = vid;
+	e->port = source;
+	kobject_get(&source->kobj);
+
+	if (b->count == BR_FDB_LEARN_BATCH) {
+		count = b->count;
+		memcpy(entries, b->entries, count * sizeof(entries[0]));
+		b->count = 0;
+	} else if (b->count == 1) {
+		kick = true;
+	}
+unlock:
+	spin_unlock(&b->lock);
+
+	if (count) {
+		spin_lock(&br->hash_lock);
+		br_fdb_learn_insert(br, entries, count);
+		spin_unlock(&br->hash_lock);
+	} else if (kick) {
+		schedule_work(&br->fdb_learn_work);
+	}
+}
+
 void br_fdb_update(struct net_bridge *br, struct net_bridge_port *source,
 		   const unsigned char *addr, u16 vid, bool added_by_user)
 {
@@ -583,16 +758,18 @@ void br_fdb_update(struct net_bridge *br, struct net_bridge_port *source,
 		} else {
 			unsigned long now = jiffies;
 
-			/* fastpath: update of existing entry */
-			if (unlikely(source != fdb->dst)) {
-				fdb->dst = source;
+			/* fastpath: update of existing entry, lockless.  Only
+			 * write the shared cache line when something changed.
+			 */
+			if (unlikely(source != READ_ONCE(fdb->dst))) {
+				WRITE_ONCE(fdb->dst, source);
 				fdb_modified = true;
 				/* Take over HW learned entry */
 				if (unlikely(fdb->added_by_external_learn))
 					fdb->added_by_external_learn = 0;
 			}
-			if (now != fdb->updated)
-				fdb->updated = now;
+			if (now != READ_ONCE(fdb->updated))
+				WRITE_ONCE(fdb->updated, now);
 			if (unlikely(added_by_user))
 				fdb->added_by_user = 1;
 			if (unlikely(fdb_modified)) {
@@ -600,6 +777,8 @@ void br_fdb_update(struct net_bridge *br, struct net_bridge_port *source,
 				fdb_notify(br, fdb, RTM_NEWNEIGH, true);
 			}
 		}
+	} else if (likely(!added_by_user)) {
+		br_fdb_learn_queue(br, source, addr, vid);
 	} else {
 		spin_lock(&br->hash_lock);
 		fdb = fdb_create(br, source, addr, vid, 0, 0);
@@ -192,6 +192,25 @@ struct net_bridge_fdb_entry {
 	struct rcu_head			rcu;
 };
 
+/* Addresses seen for the first time are queued per CPU and inserted in
+ * batches, so a flood of new sources takes hash_lock once per batch
+ * rather than once per frame.
+ */
+#define BR_FDB_LEARN_BATCH	16
+
+/* Each queued entry holds a reference on the kobject of its port. */
+struct br_fdb_learn_entry {
+	unsigned char			addr[ETH_ALEN];
+	u16				vid;
+	struct net_bridge_port		*port;
+};
+
+struct br_fdb_learn_batch {
+	spinlock_t			lock;
+	unsigned int			count;
+	struct br_fdb_learn_entry	entries[BR_FDB_LEARN_BATCH];
+};
+
 #define MDB_PG_FLAGS_PERMANENT	BIT(0)
 #define MDB_PG_FLAGS_OFFLOAD	BIT(1)
 
@@ -407,6 +426,8 @@ struct net_bridge {
 	struct timer_list		tcn_timer;
 	struct timer_list		topology_change_timer;
 	struct delayed_work		gc_work;
+	struct br_fdb_learn_batch	__percpu *fdb_learn;
+	struct work_struct		fdb_learn_work;
 	struct kobject			*ifobj;
 	u32				auto_cnt;
 
@@ -189,7 +189,8 @@ static void kcm_rfree(struct sk_buff *skb)
 	}
 }
 
-static int kcm_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
+static int __kcm_queue_rcv_skb(struct sock *sk, struct sk_buff *skb,
+			       bool wake)
 {
 	struct sk_buff_head *list = &sk->sk_receive_queue;
 
@@ -209,12 +210,30 @@ static int kcm_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
 
 	skb_queue_tail(list, skb);
 
-	if (!sock_flag(sk, SOCK_DEAD))
+	if (wake && !sock_flag(sk, SOCK_DEAD))
 		sk->sk_data_ready(sk);
 
 	return 0;
 }
 
+static int kcm_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
+{
+	return __kcm_queue_rcv_skb(sk, skb, true);
+}
+
+/* Messages parsed from one read_sock pass are queued to the reserved KCM
+ * socket without a wakeup each; wake its reader once for the whole batch
+ * before the reservation is dropped.  Lower sock lock held.
+ */
+static void kcm_rcv_batch_wake(struct kcm_psock *psock)
+{
+	struct kcm_sock *kcm = psock->rx_kcm;
+
+	if (kcm && !skb_queue_empty(&kcm->sk.sk_receive_queue) &&
+	    !sock_flag(&kcm->sk, SOCK_DEAD))
+		kcm->sk.sk_data_ready(&kcm->sk);
+}
+
 /* Requeue received messages for a kcm socket to other kcm sockets. This is
  * called with a kcm socket is receive disabled.
  * RX mux lock held.
@@ -375,8 +394,9 @@ static void kcm_rcv_strparser(struct strparser *strp, struct sk_buff *skb)
 		return;
 	}
 
-	if (kcm_queue_rcv_skb(&kcm->sk, skb)) {
+	if (__kcm_queue_rcv_skb(&kcm->sk, skb, false)) {
 		/* Should mean socket buffer full */
+		kcm_rcv_batch_wake(psock);
 		unreserve_rx_kcm(psock, false);
 		goto try_queue;
 	}
@@ -398,6 +418,7 @@ static int kcm_read_sock_done(struct strparser *strp, int err)
 {
 	struct kcm_psock *psock = container_of(strp, struct kcm_psock, strp);
 
+	kcm_rcv_batch_wake(psock);
 	unreserve_rx_kcm(psock, true);
 
 	return err;
@@ -37,6 +37,9 @@
 #include <linux/seq_file.h>
 #include <linux/jhash.h>
 #include <linux/random.h>
+#include <linux/seqlock.h>
+#include <linux/workqueue.h>
+#include <linux/mutex.h>
 
 #include <net/net_namespace.h>
 #include <net/ip_vs.h>
@@ -48,19 +51,53 @@
 
 /*
  * Connection hash size. Default is what was selected at compile time.
+ * The table starts at this size and never shrinks below it; it grows
+ * and shrinks online with the number of hashed connections.
 */
 static int ip_vs_conn_tab_bits = CONFIG_IP_VS_TAB_BITS;
 module_param_named(conn_tab_bits, ip_vs_conn_tab_bits, int, 0444);
-MODULE_PARM_DESC(conn_tab_bits, "Set connections' hash size");
+MODULE_PARM_DESC(conn_tab_bits, "Set connections' initial hash size");
 
-/* size and mask values */
+#define IP_VS_CONN_TAB_MIN_BITS	8
+#define IP_VS_CONN_TAB_MAX_BITS	20
+
+/* current size, for reporting */
 int ip_vs_conn_tab_size __read_mostly;
-static int ip_vs_conn_tab_mask __read_mostly;
 
 /*
- *  Connection hash table: for input and output packets lookups of IPVS
+ *  Connection hash table: for input and output packets lookups of IPVS.
+ *
+ *  While a resize is running, ip_vs_conn_new_tbl points to the table being
+ *  filled: new connections are hashed there and ip_vs_conn_rehash_work moves
+ *  the old buckets over one at a time.  Readers look in both tables and
+ *  retry on ip_vs_conn_resize_seq, since moving a connection between chains
+ *  can make a concurrent walk miss entries behind it.
  */
-static struct hlist_head *ip_vs_conn_tab __read_mostly;
+struct ip_vs_conn_tbl {
+	unsigned int		size;
+	unsigned int		mask;
+	struct hlist_head	buckets[];
+};
+
+static struct ip_vs_conn_tbl __rcu *ip_vs_conn_tbl __read_mostly;
+static struct ip_vs_conn_tbl __rcu *ip_vs_conn_new_tbl __read_mostly;
+static seqcount_t ip_vs_conn_resize_seq = SEQCNT_ZERO(ip_vs_conn_resize_seq);
+
+/* Serializes resizes against each other and against full table walks */
+static DEFINE_MUTEX(ip_vs_conn_resize_mutex);
+static void ip_vs_conn_rehash_work(struct work_struct *work);
+static DECLARE_WORK(ip_vs_conn_resize_work, ip_vs_conn_rehash_work);
+
+/* Number of hashed connections, drives the load factor */
+static atomic_t ip_vs_conn_hashed = ATOMIC_INIT(0);
+
+/* Resize statistics, updated under ip_vs_conn_resize_mutex */
+static struct {
+	unsigned int	grows;
+	unsigned int	shrinks;
+	unsigned int	moved;		/* buckets moved in current resize */
+	unsigned int	total;		/* buckets to move in current resize */
+} ip_vs_conn_resize_stats;
 
 /*  SLAB cache for IPVS connections */
 static struct kmem_cache *ip_vs_conn_cachep __read_mostly;
@@ -72,9 +109,12 @@ static atomic_t ip_vs_conn_no_cport_cnt = ATOMIC_INIT(0);
 static unsigned int ip_vs_conn_rnd __read_mostly;
 
 /*
- *  Fine locking granularity for big connection hash table
+ *  Fine locking granularity for big connection hash table.  Locks are picked
+ *  by the low bits of the full hash, which every table size keeps in its
+ *  bucket index, so one lock covers a connection's bucket in both the old
+ *  and the new table while resizing.
  */
-#define CT_LOCKARRAY_BITS  5
+#define CT_LOCKARRAY_BITS  IP_VS_CONN_TAB_MIN_BITS
 #define CT_LOCKARRAY_SIZE  (1<<CT_LOCKARRAY_BITS)
 #define CT_LOCKARRAY_MASK  (CT_LOCKARRAY_SIZE-1)
 
@@ -106,6 +146,41 @@ static inline void ct_write_unlock_bh(unsigned int key)
 
 static void ip_vs_conn_expire(struct timer_list *t);
 
+static inline struct hlist_head *
+ip_vs_conn_bucket(struct ip_vs_conn_tbl *t, unsigned int hash)
+{
+	return &t->buckets[hash & t->mask];
+}
+
+/* Table to look in after 't' while a resize is in progress, or NULL */
+static inline struct ip_vs_conn_tbl *
+ip_vs_conn_tbl_next(struct ip_vs_conn_tbl *t)
+{
+	struct ip_vs_conn_tbl *nt = rcu_dereference(ip_vs_conn_new_tbl);
+
+	return nt != t ? nt : NULL;
+}
+
+/* Walk the tables a lookup must search.  RCU read lock held. */
+#define ip_vs_conn_for_each_tbl(t)				\
+	for (t = rcu_dereference(ip_vs_conn_tbl); t;		\
+	     t = ip_vs_conn_tbl_next(t))
+
+/* Table new connections go to: the one being filled while resizing */
+static inline struct ip_vs_conn_tbl *ip_vs_conn_insert_tbl(void)
+{
+	struct ip_vs_conn_tbl *t;
+
+	/* Pairs with smp_store_release() in ip_vs_conn_rehash_work() */
+	t = (struct ip_vs_conn_tbl __force *)
+		smp_load_acquire(&ip_vs_conn_new_tbl);
+	if (!t)
+		t = rcu_dereference(ip_vs_conn_tbl);
+	return t;
+}
+
+static void ip_vs_conn_check_load(void);
+
 /*
  *	Returns hash value for IPVS connection entry
  */
@@ -115,13 +190,13 @@ static unsigned int ip_vs_conn_hashkey(struct netns_ipvs *ipvs, int af, unsigned
 {
 #ifdef CONFIG_IP_VS_IPV6
 	if (af == AF_INET6)
-		return (jhash_3words(jhash(addr, 16, ip_vs_conn_rnd),
+		return jhash_3words(jhash(addr, 16, ip_vs_conn_rnd),
 				    (__force u32)port, proto, ip_vs_conn_rnd) ^
-			((size_t)ipvs>>8)) & ip_vs_conn_tab_mask;
+			((size_t)ipvs>>8);
 #endif
-	return (jhash_3words((__force u32)addr->ip, (__force u32)port, proto,
+	return jhash_3words((__force u32)addr->ip, (__force u32)port, proto,
 			    ip_vs_conn_rnd) ^
-		((size_t)ipvs>>8)) & ip_vs_conn_tab_mask;
+		((size_t)ipvs>>8);
 }
 
 static unsigned int ip_vs_conn_hashkey_param(const struct ip_vs_conn_param *p,
@@ -131,8 +206,7 @@ static unsigned int ip_vs_conn_hashkey_param(const struct ip_vs_conn_param *p,
 	__be16 port;
 
 	if (p->pe_data && p->pe->hashkey_raw)
-		return p->pe->hashkey_raw(p, ip_vs_conn_rnd, inverse) &
-			ip_vs_conn_tab_mask;
+		return p->pe->hashkey_raw(p, ip_vs_conn_rnd, inverse);
 
 	if (likely(!inverse)) {
 		addr = p->caddr;
@@ -176,13 +250,17 @@ static inline int ip_vs_conn_hash(struct ip_vs_conn *cp)
 	/* Hash by protocol, client address and port */
 	hash = ip_vs_conn_hashkey_conn(cp);
 
+	rcu_read_lock();
 	ct_write_lock_bh(hash);
 	spin_lock(&cp->lock);
 
 	if (!(cp->flags & IP_VS_CONN_F_HASHED)) {
 		cp->flags |= IP_VS_CONN_F_HASHED;
 		refcount_inc(&cp->refcnt);
-		hlist_add_head_rcu(&cp->c_list, &ip_vs_conn_tab[hash]);
+		hlist_add_head_rcu(&cp->c_list,
+				   ip_vs_conn_bucket(ip_vs_conn_insert_tbl(),
+						     hash));
+		atomic_inc(&ip_vs_conn_hashed);
 		ret = 1;
 	} else {
 		pr_err("%s(): request for already hashed, called from %pS\n",
@@ -192,6 +270,10 @@ static inline int ip_vs_conn_hash(struct ip_vs_conn *cp)
 
 	spin_unlock(&cp->lock);
 	ct_write_unlock_bh(hash);
+	rcu_read_unlock();
+
+	if (ret)
+		ip_vs_conn_check_load();
 
 	return ret;
 }
@@ -216,6 +298,7 @@ static inline int ip_vs_conn_unhash(struct ip_vs_conn *cp)
 		hlist_del_rcu(&cp->c_list);
 		cp->flags &= ~IP_VS_CONN_F_HASHED;
 		refcount_dec(&cp->refcnt);
+		atomic_dec(&ip_vs_conn_hashed);
 		ret = 1;
 	} else
 		ret = 0;
@@ -247,6 +330,7 @@ static inline bool ip_vs_conn_unlink(struct ip_vs_conn *cp)
 		if (refcount_dec_if_one(&cp->refcnt)) {
 			hlist_del_rcu(&cp->c_list);
 			cp->flags &= ~IP_VS_CONN_F_HASHED;
+			atomic_dec(&ip_vs_conn_hashed);
 			ret = true;
 		}
 	}
@@ -254,6 +338,9 @@ static inline bool ip_vs_conn_unlink(struct ip_vs_conn *cp)
 	spin_unlock(&cp->lock);
 	ct_write_unlock_bh(hash);
 
+	if (ret)
+		ip_vs_conn_check_load();
+
 	return ret;
 }
 
@@ -267,28 +354,39 @@ static inline bool ip_vs_conn_unlink(struct ip_vs_conn *cp)
 static inline struct ip_vs_conn *
 __ip_vs_conn_in_get(const struct ip_vs_conn_param *p)
 {
-	unsigned int hash;
+	struct ip_vs_conn_tbl *t;
+	unsigned int hash, seq;
 	struct ip_vs_conn *cp;
 
 	hash = ip_vs_conn_hashkey_param(p, false);
 
 	rcu_read_lock();
 
-	hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[hash], c_list) {
-		if (p->cport == cp->cport && p->vport == cp->vport &&
-		    cp->af == p->af &&
-		    ip_vs_addr_equal(p->af, p->caddr, &cp->caddr) &&
-		    ip_vs_addr_equal(p->af, p->vaddr, &cp->vaddr) &&
-		    ((!p->cport) ^ (!(cp->flags & IP_VS_CONN_F_NO_CPORT))) &&
-		    p->protocol == cp->protocol &&
-		    cp->ipvs == p->ipvs) {
-			if (!__ip_vs_conn_get(cp))
-				continue;
-			/* HIT */
-			rcu_read_unlock();
-			return cp;
+	do {
+		seq = read_seqcount_begin(&ip_vs_conn_resize_seq);
+		ip_vs_conn_for_each_tbl(t) {
+			hlist_for_each_entry_rcu(cp, ip_vs_conn_bucket(t, hash),
+						 c_list) {
+				if (p->cport == cp->cport &&
+				    p->vport == cp->vport &&
+				    cp->af == p->af &&
+				    ip_vs_addr_equal(p->af, p->caddr,
+						     &cp->caddr) &&
+				    ip_vs_addr_equal(p->af, p->vaddr,
+						     &cp->vaddr) &&
+				    ((!p->cport) ^
+				     (!(cp->flags & IP_VS_CONN_F_NO_CPORT))) &&
+				    p->protocol == cp->protocol &&
+				    cp->ipvs == p->ipvs) {
+					if (!__ip_vs_conn_get(cp))
+						continue;
+					/* HIT */
+					rcu_read_unlock();
+					return cp;
+				}
+			}
 		}
-	}
+	} while (read_seqcount_retry(&ip_vs_conn_resize_seq, seq));
 
 	rcu_read_unlock();
 
@@ -353,38 +451,49 @@ EXPORT_SYMBOL_GPL(ip_vs_conn_in_get_proto);
 /* Get reference to connection template */
 struct ip_vs_conn *ip_vs_ct_in_get(const struct ip_vs_conn_param *p)
 {
-	unsigned int hash;
+	struct ip_vs_conn_tbl *t;
+	unsigned int hash, seq;
 	struct ip_vs_conn *cp;
 
 	hash = ip_vs_conn_hashkey_param(p, false);
 
 	rcu_read_lock();
 
-	hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[hash], c_list) {
-		if (unlikely(p->pe_data && p->pe->ct_match)) {
-			if (cp->ipvs != p->ipvs)
-				continue;
-			if (p->pe == cp->pe && p->pe->ct_match(p, cp)) {
-				if (__ip_vs_conn_get(cp))
-					goto out;
-			}
-			continue;
-		}
+	do {
+		seq = read_seqcount_begin(&ip_vs_conn_resize_seq);
+		ip_vs_conn_for_each_tbl(t) {
+			hlist_for_each_entry_rcu(cp, ip_vs_conn_bucket(t, hash),
+						 c_list) {
+				if (unlikely(p->pe_data && p->pe->ct_match)) {
+					if (cp->ipvs != p->ipvs)
+						continue;
+					if (p->pe == cp->pe &&
+					    p->pe->ct_match(p, cp)) {
+						if (__ip_vs_conn_get(cp))
+							goto out;
+					}
+					continue;
+				}
 
-		if (cp->af == p->af &&
-		    ip_vs_addr_equal(p->af, p->caddr, &cp->caddr) &&
-		    /* protocol should only be IPPROTO_IP if
-		     * p->vaddr is a fwmark */
-		    ip_vs_addr_equal(p->protocol == IPPROTO_IP ? AF_UNSPEC :
-				     p->af, p->vaddr, &cp->vaddr) &&
-		    p->vport == cp->vport && p->cport == cp->cport &&
-		    cp->flags & IP_VS_CONN_F_TEMPLATE &&
-		    p->protocol == cp->protocol &&
-		    cp->ipvs == p->ipvs) {
-			if (__ip_vs_conn_get(cp))
-				goto out;
+				if (cp->af == p->af &&
+				    ip_vs_addr_equal(p->af, p->caddr,
+						     &cp->caddr) &&
+				    /* protocol should only be IPPROTO_IP if
+				     * p->vaddr is a fwmark */
+				    ip_vs_addr_equal(p->protocol == IPPROTO_IP ?
+						     AF_UNSPEC : p->af,
+						     p->vaddr, &cp->vaddr) &&
+				    p->vport == cp->vport &&
+				    p->cport == cp->cport &&
+				    cp->flags & IP_VS_CONN_F_TEMPLATE &&
+				    p->protocol == cp->protocol &&
+				    cp->ipvs == p->ipvs) {
+					if (__ip_vs_conn_get(cp))
+						goto out;
+				}
+			}
 		}
-	}
+	} while (read_seqcount_retry(&ip_vs_conn_resize_seq, seq));
 	cp = NULL;
 
   out:
@@ -405,8 +514,9 @@ struct ip_vs_conn *ip_vs_ct_in_get(const struct ip_vs_conn_param *p)
  *	p->vaddr, p->vport: pkt dest address (foreign host) */
 struct ip_vs_conn *ip_vs_conn_out_get(const struct ip_vs_conn_param *p)
 {
-	unsigned int hash;
 	struct ip_vs_conn *cp, *ret=NULL;
+	struct ip_vs_conn_tbl *t;
+	unsigned int hash, seq;
 
 	/*
 	 *	Check for "full" addressed entries
@@ -415,21 +525,31 @@ struct ip_vs_conn *ip_vs_conn_out_get(const struct ip_vs_conn_param *p)
 
 	rcu_read_lock();
 
-	hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[hash], c_list) {
-		if (p->vport == cp->cport && p->cport == cp->dport &&
-		    cp->af == p->af &&
-		    ip_vs_addr_equal(p->af, p->vaddr, &cp->caddr) &&
-		    ip_vs_addr_equal(p->af, p->caddr, &cp->daddr) &&
-		    p->protocol == cp->protocol &&
-		    cp->ipvs == p->ipvs) {
-			if (!__ip_vs_conn_get(cp))
-				continue;
-			/* HIT */
-			ret = cp;
-			break;
+	do {
+		seq = read_seqcount_begin(&ip_vs_conn_resize_seq);
+		ip_vs_conn_for_each_tbl(t) {
+			hlist_for_each_entry_rcu(cp, ip_vs_conn_bucket(t, hash),
+						 c_list) {
+				if (p->vport == cp->cport &&
+				    p->cport == cp->dport &&
+				    cp->af == p->af &&
+				    ip_vs_addr_equal(p->af, p->vaddr,
+						     &cp->caddr) &&
+				    ip_vs_addr_equal(p->af, p->caddr,
+						     &cp->daddr) &&
+				    p->protocol == cp->protocol &&
+				    cp->ipvs == p->ipvs) {
+					if (!__ip_vs_conn_get(cp))
+						continue;
+					/* HIT */
+					ret = cp;
+					goto out;
+				}
+			}
 		}
-	}
+	} while (read_seqcount_retry(&ip_vs_conn_resize_seq, seq));
 
+out:
 	rcu_read_unlock();
 
 	IP_VS_DBG_BUF(9, "lookup/out %s %s:%d->%s:%d %s\n",
@@ -1014,19 +1134,27 @@ struct ip_vs_iter_state {
 	struct hlist_head	*l;
 };
 
+/* The walkers hold ip_vs_conn_resize_mutex, so the table can not change */
+static inline struct ip_vs_conn_tbl *ip_vs_conn_walk_tbl(void)
+{
+	return rcu_dereference_protected(ip_vs_conn_tbl,
+				lockdep_is_held(&ip_vs_conn_resize_mutex));
+}
+
 static void *ip_vs_conn_array(struct seq_file *seq, loff_t pos)
 {
 	int idx;
 	struct ip_vs_conn *cp;
 	struct ip_vs_iter_state *iter = seq->private;
+	struct ip_vs_conn_tbl *t = ip_vs_conn_walk_tbl();
 
-	for (idx = 0; idx < ip_vs_conn_tab_size; idx++) {
-		hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[idx], c_list) {
+	for (idx = 0; idx < t->size; idx++) {
+		hlist_for_each_entry_rcu(cp, &t->buckets[idx], c_list) {
 			/* __ip_vs_conn_get() is not needed by
 			 * ip_vs_conn_seq_show and ip_vs_conn_sync_seq_show
 			 */
 			if (pos-- == 0) {
-				iter->l = &ip_vs_conn_tab[idx];
+				iter->l = &t->buckets[idx];
 				return cp;
 			}
 		}
@@ -1042,6 +1170,7 @@ static void *ip_vs_conn_seq_start(struct seq_file *seq, loff_t *pos)
 	struct ip_vs_iter_state *iter = seq->private;
 
 	iter->l = NULL;
+	mutex_lock(&ip_vs_conn_resize_mutex);
 	rcu_read_lock();
 	return *pos ? ip_vs_conn_array(seq, *pos - 1) :SEQ_START_TOKEN;
 }
@@ -1052,6 +1181,7 @@ static void *ip_vs_conn_seq_next(struct seq_file *seq, void *v, loff_t *pos)
 	struct ip_vs_iter_state *iter = seq->private;
 	struct hlist_node *e;
 	struct hlist_head *l = iter->l;
+	struct ip_vs_conn_tbl *t;
 	int idx;
 
 	++*pos;
@@ -1063,10 +1193,11 @@ static void *ip_vs_conn_seq_next(struct seq_file *seq, void *v, loff_t *pos)
 	if (e)
 		return hlist_entry(e, struct ip_vs_conn, c_list);
 
-	idx = l - ip_vs_conn_tab;
-	while (++idx < ip_vs_conn_tab_size) {
-		hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[idx], c_list) {
-			iter->l = &ip_vs_conn_tab[idx];
+	t = ip_vs_conn_walk_tbl();
+	idx = l - t->buckets;
+	while (++idx < t->size) {
+		hlist_for_each_entry_rcu(cp, &t->buckets[idx], c_list) {
+			iter->l = &t->buckets[idx];
 			return cp;
 		}
 		cond_resched_rcu();
@@ -1079,6 +1210,7 @@ static void ip_vs_conn_seq_stop(struct seq_file *seq, void *v)
 	__releases(RCU)
 {
 	rcu_read_unlock();
+	mutex_unlock(&ip_vs_conn_resize_mutex);
 }
 
 static int ip_vs_conn_seq_show(struct seq_file *seq, void *v)
@@ -1215,6 +1347,61 @@ static const struct seq_operations ip_vs_conn_sync_seq_ops = {
 	.stop  = ip_vs_conn_seq_stop,
 	.show  = ip_vs_conn_sync_seq_show,
 };
+
+/* Chain length buckets reported by /proc/net/ip_vs_conn_tab */
+#define IP_VS_CONN_CHAIN_HIST	6
+
+static int ip_vs_conn_tab_show(struct seq_file *seq, void *v)
+{
+	static const char * const hist_name[IP_VS_CONN_CHAIN_HIST] = {
+		"0", "1", "2", "3", "4-7", "8+"
+	};
+	unsigned int hist[IP_VS_CONN_CHAIN_HIST] = { 0 };
+	unsigned int used = 0, longest = 0, entries = 0;
+	struct ip_vs_conn_tbl *t;
+	struct ip_vs_conn *cp;
+	unsigned int idx, len;
+	int i;
+
+	mutex_lock(&ip_vs_conn_resize_mutex);
+	rcu_read_lock();
+	t = ip_vs_conn_walk_tbl();
+	for (idx = 0; idx < t->size; idx++) {
+		len = 0;
+		hlist_for_each_entry_rcu(cp, &t->buckets[idx], c_list)
+			len++;
+		entries += len;
+		if (len) {
+			used++;
+			longest = max(longest, len);
+		}
+		if (len < 4)
+			hist[len]++;
+		else
+			hist[len < 8 ? 4 : 5]++;
+		if (!(idx & 1023))
+			cond_resched_rcu();
+	}
+	rcu_read_unlock();
+
+	seq_printf(seq, "Size:      %u\n", t->size);
+	seq_printf(seq, "Entries:   %u\n", entries);
+	seq_printf(seq, "Grows:     %u\n", ip_vs_conn_resize_stats.grows);
+	seq_printf(seq, "Shrinks:   %u\n", ip_vs_conn_resize_stats.shrinks);
+	seq_printf(seq, "Rehashed:  %u/%u\n", ip_vs_conn_resize_stats.moved,
+		   ip_vs_conn_resize_stats.total);
+	seq_printf(seq, "MaxChain:  %u\n", longest);
+	seq_printf(seq, "AvgChain:  %u.%02u\n",
+		   used ? entries / used : 0,
+		   used ? (entries % used) * 100 / used : 0);
+	seq_puts(seq, "ChainHist:");
+	for (i = 0; i < IP_VS_CONN_CHAIN_HIST; i++)
+		seq_printf(seq, " %s:%u", hist_name[i], hist[i]);
+	seq_putc(seq, '\n');
+	mutex_unlock(&ip_vs_conn_resize_mutex);
+
+	return 0;
+}
 #endif
 
 
@@ -1267,15 +1454,21 @@ void ip_vs_random_dropentry(struct netns_ipvs *ipvs)
 {
 	int idx;
 	struct ip_vs_conn *cp;
+	struct ip_vs_conn_tbl *t;
 
+	/* Skip this round rather than wait for a resize to finish */
+	if (!mutex_trylock(&ip_vs_conn_resize_mutex))
+		return;
 	rcu_read_lock();
+	t = ip_vs_conn_walk_tbl();
 	/*
 	 * Randomly scan 1/32 of the whole table every second
 	 */
-	for (idx = 0; idx < (ip_vs_conn_tab_size>>5); idx++) {
-		unsigned int hash = prandom_u32() & ip_vs_conn_tab_mask;
+	for (idx = 0; idx < (t->size>>5); idx++) {
+		unsigned int hash = prandom_u32();
 
-		hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[hash], c_list) {
+		hlist_for_each_entry_rcu(cp, ip_vs_conn_bucket(t, hash),
+					 c_list) {
 			if (cp->ipvs != ipvs)
 				continue;
 			if (atomic_read(&cp->n_control))
@@ -1328,6 +1521,7 @@ void ip_vs_random_dropentry(struct netns_ipvs *ipvs)
 		cond_resched_rcu();
 	}
 	rcu_read_unlock();
+	mutex_unlock(&ip_vs_conn_resize_mutex);
 }
 
 
@@ -1338,12 +1532,15 @@ static void ip_vs_conn_flush(struct netns_ipvs *ipvs)
 {
 	int idx;
 	struct ip_vs_conn *cp, *cp_c;
+	struct ip_vs_conn_tbl *t;
 
 flush_again:
+	mutex_lock(&ip_vs_conn_resize_mutex);
 	rcu_read_lock();
-	for (idx = 0; idx < ip_vs_conn_tab_size; idx++) {
+	t = ip_vs_conn_walk_tbl();
+	for (idx = 0; idx < t->size; idx++) {
 
-		hlist_for_each_entry_rcu(cp, &ip_vs_conn_tab[idx], c_list) {
+		hlist_for_each_entry_rcu(cp, &t->buckets[idx], c_list) {
 			if (cp->ipvs != ipvs)
 				continue;
 			/* As timers are expired in LIFO order, restart
@@ -1363,6 +1560,7 @@ static void ip_vs_conn_flush(struct netns_ipvs *ipvs)
 		cond_resched_rcu();
 	}
 	rcu_read_unlock();
+	mutex_unlock(&ip_vs_conn_resize_mutex);
 
 	/* the counter may be not NULL, because maybe some conn entries
 	   are run by slow timer handler or unhashed but still referred */
@@ -1388,11 +1586,17 @@ int __net_init ip_vs_conn_net_init(struct netns_ipvs *ipvs)
 			     &ip_vs_conn_sync_seq_ops,
 			     sizeof(struct ip_vs_iter_state)))
 		goto err_conn_sync;
+
+	if (!proc_create_net_single("ip_vs_conn_tab", 0, ipvs->net->proc_net,
+				    ip_vs_conn_tab_show, NULL))
+		goto err_conn_tab;
 #endif
 
 	return 0;
 
 #ifdef CONFIG_PROC_FS
+err_conn_tab:
+	remove_proc_entry("ip_vs_conn_sync", ipvs->net->proc_net);
 err_conn_sync:
 	remove_proc_entry("ip_vs_conn", ipvs->net->proc_net);
 err_conn:
@@ -1407,27 +1611,134 @@ void __net_exit ip_vs_conn_net_cleanup(struct netns_ipvs *ipvs)
 #ifdef CONFIG_PROC_FS
 	remove_proc_entry("ip_vs_conn", ipvs->net->proc_net);
 	remove_proc_entry("ip_vs_conn_sync", ipvs->net->proc_net);
+	remove_proc_entry("ip_vs_conn_tab", ipvs->net->proc_net);
 #endif
 }
 
+static struct ip_vs_conn_tbl *ip_vs_conn_tbl_alloc(unsigned int bits)
+{
+	struct ip_vs_conn_tbl *t;
+	unsigned int size = 1U << bits;
+	unsigned int idx;
+
+	t = kvmalloc(struct_size(t, buckets, size), GFP_KERNEL);
+	if (!t)
+		return NULL;
+	t->size = size;
+	t->mask = size - 1;
+	for (idx = 0; idx < size; idx++)
+		INIT_HLIST_HEAD(&t->buckets[idx]);
+	return t;
+}
+
+/* Kick the resize work when the load factor leaves [1/8, 2] */
+static void ip_vs_conn_check_load(void)
+{
+	unsigned int size = READ_ONCE(ip_vs_conn_tab_size);
+	unsigned int n = atomic_read(&ip_vs_conn_hashed);
+
+	if ((n > 2 * size && size < (1U << IP_VS_CONN_TAB_MAX_BITS)) ||
+	    (n < size / 8 && size > (1U << ip_vs_conn_tab_bits)))
+		schedule_work(&ip_vs_conn_resize_work);
+}
+
+/* Size the table for a load factor of about 1 after growing and
+ * about 1/2 after shrinking, so that it does not flap between sizes.
+ */
+static unsigned int ip_vs_conn_tab_target_bits(unsigned int size)
+{
+	unsigned int n = atomic_read(&ip_vs_conn_hashed);
+	unsigned int bits = ilog2(size);
+
+	if (n > 2 * size)
+		bits = min_t(unsigned int, order_base_2(n),
+			     IP_VS_CONN_TAB_MAX_BITS);
+	else if (n < size / 8)
+		bits = max_t(unsigned int, order_base_2(2 * n),
+			     ip_vs_conn_tab_bits);
+	return bits;
+}
+
+static void ip_vs_conn_rehash_work(struct work_struct *work)
+{
+	struct ip_vs_conn_tbl *t, *nt;
+	struct ip_vs_conn *cp;
+	struct hlist_node *n;
+	unsigned int bits, idx, hash;
+
+	mutex_lock(&ip_vs_conn_resize_mutex);
+	t = ip_vs_conn_walk_tbl();
+	bits = ip_vs_conn_tab_target_bits(t->size);
+	if (bits == ilog2(t->size))
+		goto out;
+
+	nt = ip_vs_conn_tbl_alloc(bits);
+	if (!nt)
+		goto out;
+
+	ip_vs_conn_resize_stats.moved = 0;
+	ip_vs_conn_resize_stats.total = t->size;
+	/* From now on new connections are hashed into nt */
+	rcu_assign_pointer(ip_vs_conn_new_tbl, nt);
+
+	/* An old bucket holds hashes that share its low CT_LOCKARRAY_BITS,
+	 * so a single lock protects it and its destination buckets.
+	 */
+	for (idx = 0; idx < t->size; idx++) {
+		ct_write_lock_bh(idx);
+		write_seqcount_begin(&ip_vs_conn_resize_seq);
+		hlist_for_each_entry_safe(cp, n, &t->buckets[idx], c_list) {
+			hash = ip_vs_conn_hashkey_conn(cp);
+			hlist_del_rcu(&cp->c_list);
+			hlist_add_head_rcu(&cp->c_list,
+					   ip_vs_conn_bucket(nt, hash));
+		}
+		write_seqcount_end(&ip_vs_conn_resize_seq);
+		ct_write_unlock_bh(idx);
+		ip_vs_conn_resize_stats.moved++;
+		cond_resched();
+	}
+
+	local_bh_disable();
+	write_seqcount_begin(&ip_vs_conn_resize_seq);
+	rcu_assign_pointer(ip_vs_conn_tbl, nt);
+	/* Inserters that see no new table must see nt as the current one */
+	smp_store_release(&ip_vs_conn_new_tbl, NULL);
+	write_seqcount_end(&ip_vs_conn_resize_seq);
+	local_bh_enable();
+
+	if (nt->size > t->size)
+		ip_vs_conn_resize_stats.grows++;
+	else
+		ip_vs_conn_resize_stats.shrinks++;
+	WRITE_ONCE(ip_vs_conn_tab_size, nt->size);
+	IP_VS_DBG(2, "Connection hash table resized %u -> %u\n",
+		  t->size, nt->size);
+
+	synchronize_rcu();
+	kvfree(t);
+out:
+	mutex_unlock(&ip_vs_conn_resize_mutex);
+}
+
 int __init ip_vs_conn_init(void)
 {
+	struct ip_vs_conn_tbl *t;
 	int idx;
 
 	/* Compute size and mask */
-	if (ip_vs_conn_tab_bits < 8 || ip_vs_conn_tab_bits > 20) {
+	if (ip_vs_conn_tab_bits < IP_VS_CONN_TAB_MIN_BITS ||
+	    ip_vs_conn_tab_bits > IP_VS_CONN_TAB_MAX_BITS) {
 		pr_info("conn_tab_bits not in [8, 20]. Using default value\n");
 		ip_vs_conn_tab_bits = CONFIG_IP_VS_TAB_BITS;
 	}
 	ip_vs_conn_tab_size = 1 << ip_vs_conn_tab_bits;
-	ip_vs_conn_tab_mask = ip_vs_conn_tab_size - 1;
 
 	/*
 	 * Allocate the connection hash table and initialize its list heads
 	 */
-	ip_vs_conn_tab = vmalloc(array_size(ip_vs_conn_tab_size,
-					    sizeof(*ip_vs_conn_tab)));
-	if (!ip_vs_conn_tab)
+	t = ip_vs_conn_tbl_alloc(ip_vs_conn_tab_bits);
+	if (!t)
 		return -ENOMEM;
 
 	/* Allocate ip_vs_conn slab cache */
@@ -1435,19 +1746,18 @@ int __init ip_vs_conn_init(void)
 					      sizeof(struct ip_vs_conn), 0,
 					      SLAB_HWCACHE_ALIGN, NULL);
 	if (!ip_vs_conn_cachep) {
-		vfree(ip_vs_conn_tab);
+		kvfree(t);
 		return -ENOMEM;
 	}
 
 	pr_info("Connection hash table configured "
 		"(size=%d, memory=%ldKbytes)\n",
 		ip_vs_conn_tab_size,
-		(long)(ip_vs_conn_tab_size*sizeof(*ip_vs_conn_tab))/1024);
+		(long)(ip_vs_conn_tab_size*sizeof(t->buckets[0]))/1024);
 	IP_VS_DBG(0, "Each connection entry needs %zd bytes at least\n",
 		  sizeof(struct ip_vs_conn));
 
-	for (idx = 0; idx < ip_vs_conn_tab_size; idx++)
-		INIT_HLIST_HEAD(&ip_vs_conn_tab[idx]);
+	RCU_INIT_POINTER(ip_vs_conn_tbl, t);
 
 	for (idx = 0; idx < CT_LOCKARRAY_SIZE; idx++)  {
 		spin_lock_init(&__ip_vs_conntbl_lock_array[idx].l);
@@ -1463,7 +1773,9 @@ void ip_vs_conn_cleanup(void)
 {
 	/* Wait all ip_vs_conn_rcu_free() callbacks to complete */
 	rcu_barrier();
+	/* The table is empty now, a shrink may still be queued */
+	cancel_work_sync(&ip_vs_conn_resize_work);
 	/* Release the empty cache */
 	kmem_cache_destroy(ip_vs_conn_cachep);
-	vfree(ip_vs_conn_tab);
+	kvfree(rcu_dereference_protected(ip_vs_conn_tbl, 1));
 }
@@ -298,6 +298,82 @@ static u16 packet_pick_tx_queue(struct sk_buff *skb)
 	return queue_index;
 }
 
+/* Frames a qdisc-bypass TX ring send hands to the driver under one queue
+ * lock, flagging all but the last with xmit_more.
+ */
+#define PACKET_TX_BATCH	16
+
+static void packet_direct_xmit_drop(struct net_device *dev,
+				    struct sk_buff_head *list)
+{
+	atomic_long_add(skb_queue_len(list), &dev->tx_dropped);
+	__skb_queue_purge(list);
+}
+
+/* Batched counterpart of packet_direct_xmit() for tpacket_snd().  All skbs
+ * on 'list' belong to the same socket and device and go out on the queue
+ * picked for the first one.  Frames the driver does not take are dropped,
+ * as with packet_direct_xmit(); their destructors return the ring slots.
+ */
+static int packet_direct_xmit_batch(struct sk_buff_head *list)
+{
+	struct sk_buff *skb = skb_peek(list);
+	struct net_device *dev = skb->dev;
+	struct sk_buff_head ready;
+	struct netdev_queue *txq;
+	int ret = NET_XMIT_SUCCESS;
+	bool again = false;
+	u16 queue_index;
+
+	if (unlikely(!netif_running(dev) || !netif_carrier_ok(dev))) {
+		packet_direct_xmit_drop(dev, list);
+		return net_xmit_errno(NET_XMIT_DROP);
+	}
+
+	queue_index = packet_pick_tx_queue(skb);
+	txq = netdev_get_tx_queue(dev, queue_index);
+
+	__skb_queue_head_init(&ready);
+	while ((skb = __skb_dequeue(list)) != NULL) {
+		struct sk_buff *orig_skb = skb;
+
+		skb = validate_xmit_skb_list(skb, dev, &again);
+		if (skb != orig_skb) {
+			atomic_long_inc(&dev->tx_dropped);
+			kfree_skb_list(skb);
+			ret = NET_XMIT_DROP;
+			continue;
+		}
+		skb_set_queue_mapping(skb, queue_index);
+		__skb_queue_tail(&ready, skb);
+	}
+
+	local_bh_disable();
+	HARD_TX_LOCK(dev, txq, smp_processor_id());
+	while ((skb = skb_peek(&ready)) != NULL) {
+		int rc = NETDEV_TX_BUSY;
+
+		if (!netif_xmit_frozen_or_drv_stopped(txq)) {
+			__skb_unlink(skb, &ready);
+			rc = netdev_start_xmit(skb, dev, txq,
+					       !skb_queue_empty(&ready));
+			if (dev_xmit_complete(rc))
+				continue;
+			__skb_queue_head(&ready, skb);
+		}
+		break;
+	}
+	HARD_TX_UNLOCK(dev, txq);
+	local_bh_enable();
+
+	if (unlikely(!skb_queue_empty(&ready))) {
+		packet_direct_xmit_drop(dev, &ready);
+		ret = NET_XMIT_DROP;
+	}
+
+	return net_xmit_errno(ret);
+}
+
 /* __register_prot_hook must be invoked through register_prot_hook
  * or from a context in which asynchronous accesses to the packet
  * socket is not possible (packet_create()).
@@ -2654,7 +2730,10 @@ static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 	int status = TP_STATUS_AVAILABLE;
 	int hlen, tlen, copylen = 0;
 	long timeo = 0;
+	struct sk_buff_head batch;
+	bool batched;
 
+	__skb_queue_head_init(&batch);
 	mutex_lock(&po->pg_vec_lock);
 
 	/* packet_sendmsg() check on tx_ring.pg_vec was lockless,
@@ -2708,11 +2787,17 @@ static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 		size_max = dev->mtu + reserve + VLAN_HLEN;
 
 	reinit_completion(&po->skb_completion);
+	batched = packet_use_direct_xmit(po);
 
 	do {
 		ph = packet_current_frame(po, &po->tx_ring,
 					  TP_STATUS_SEND_REQUEST);
 		if (unlikely(ph == NULL)) {
+			if (!skb_queue_empty(&batch)) {
+				err = packet_direct_xmit_batch(&batch);
+				if (unlikely(err))
+					goto out_put;
+			}
 			if (need_wait && skb) {
 				timeo = sock_sndtimeo(&po->sk, msg->msg_flags & MSG_DONTWAIT);
 				timeo = wait_for_completion_interruptible_timeout(&po->skb_completion, timeo);
@@ -2746,6 +2831,15 @@ static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 						    vnet_hdr->hdr_len);
 		}
 		copylen = max_t(int, copylen, dev->hard_header_len);
+		/* Queued frames are already charged to sk_wmem_alloc and only
+		 * give it back once sent, so hand them to the driver before an
+		 * allocation that may wait for that memory.
+		 */
+		if (!skb_queue_empty(&batch) && !sock_writeable(&po->sk)) {
+			err = packet_direct_xmit_batch(&batch);
+			if (unlikely(err))
+				goto out_put;
+		}
 		skb = sock_alloc_send_skb(&po->sk,
 				hlen + tlen + sizeof(struct sockaddr_ll) +
 				(copylen - dev->hard_header_len),
@@ -2793,6 +2887,19 @@ static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 		packet_inc_pending(&po->tx_ring);
 
 		status = TP_STATUS_SEND_REQUEST;
+		if (batched) {
+			__skb_queue_tail(&batch, skb);
+			packet_increment_head(&po->tx_ring);
+			len_sum += tp_len;
+			if (skb_queue_len(&batch) < PACKET_TX_BATCH)
+				continue;
+
+			err = packet_direct_xmit_batch(&batch);
+			if (unlikely(err))
+				goto out_put;
+			continue;
+		}
+
 		err = po->xmit(skb);
 		if (unlikely(err != 0)) {
 			if (err > 0)
@@ -2827,6 +2934,9 @@ static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 	__packet_set_status(po, ph, status);
 	kfree_skb(skb);
 out_put:
+	/* frames already queued were accepted from the ring; send them */
+	if (!skb_queue_empty(&batch))
+		packet_direct_xmit_batch(&batch);
 	dev_put(dev);
 out:
 	mutex_unlock(&po->pg_vec_lock);
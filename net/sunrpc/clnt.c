@@ -499,6 +499,41 @@ static struct rpc_clnt *rpc_create_xprt(struct rpc_create_args *args,
 	return clnt;
 }
 
+/*
+ * rpc_clnt_add_xprt() setup function for the extra nconnect transports.
+ * They share the server address with the first one, so they are added
+ * here rather than going through the duplicate address check.
+ */
+static int rpc_clnt_setup_nconnect_xprt(struct rpc_clnt *clnt,
+					struct rpc_xprt_switch *xps,
+					struct rpc_xprt *xprt,
+					void *data)
+{
+	rpc_xprt_switch_add_xprt_shared(xps, xprt);
+	return 1;
+}
+
+static void rpc_clnt_add_nconnect_xprts(struct rpc_clnt *clnt,
+					struct rpc_create_args *args,
+					struct xprt_create *xprtargs)
+{
+	struct rpc_xprt_switch *xps;
+	unsigned int i;
+
+	for (i = 1; i < min(args->nconnect, RPC_MAX_NCONNECT); i++) {
+		if (rpc_clnt_add_xprt(clnt, xprtargs,
+				      rpc_clnt_setup_nconnect_xprt, NULL) < 0)
+			break;
+	}
+
+	if (args->flags & RPC_CLNT_CREATE_LEASTQUEUED) {
+		rcu_read_lock();
+		xps = rcu_dereference(clnt->cl_xpi.xpi_xpswitch);
+		rpc_xprt_switch_set_leastqueued(xps);
+		rcu_read_unlock();
+	}
+}
+
 /**
  * rpc_create - create an RPC client and transport with one call
  * @args: rpc_clnt create argument structure
@@ -508,9 +543,14 @@ static struct rpc_clnt *rpc_create_xprt(struct rpc_create_args *args,
  * It can ping the server in order to determine if it is up, and to see if
  * it supports this program and version.  RPC_CLNT_CREATE_NOPING disables
  * this behavior so asynchronous tasks can also use rpc_create.
+ *
+ * If args->nconnect is greater than one, up to RPC_MAX_NCONNECT transports
+ * to the same server are opened and requests are spread over them
+ * round-robin, or to the least loaded one with RPC_CLNT_CREATE_LEASTQUEUED.
  */
 struct rpc_clnt *rpc_create(struct rpc_create_args *args)
 {
+	struct rpc_clnt *clnt;
 	struct rpc_xprt *xprt;
 	struct xprt_create xprtargs = {
 		.net = args->net,
@@ -584,7 +624,10 @@ struct rpc_clnt *rpc_create(struct rpc_create_args *args)
 	if (args->flags & RPC_CLNT_CREATE_NONPRIVPORT)
 		xprt->resvport = 0;
 
-	return rpc_create_xprt(args, xprt);
+	clnt = rpc_create_xprt(args, xprt);
+	if (!IS_ERR(clnt) && args->nconnect > 1)
+		rpc_clnt_add_nconnect_xprts(clnt, args, &xprtargs);
+	return clnt;
 }
 EXPORT_SYMBOL_GPL(rpc_create);
 
@@ -971,6 +1014,7 @@ void rpc_task_release_transport(struct rpc_task *task)
 
 	if (xprt) {
 		task->tk_xprt = NULL;
+		atomic_long_dec(&xprt->queuelen);
 		xprt_put(xprt);
 	}
 }
@@ -995,8 +1039,11 @@ void rpc_task_release_client(struct rpc_task *task)
 static
 void rpc_task_set_transport(struct rpc_task *task, struct rpc_clnt *clnt)
 {
-	if (!task->tk_xprt)
-		task->tk_xprt = xprt_iter_get_next(&clnt->cl_xpi);
+	if (task->tk_xprt)
+		return;
+	task->tk_xprt = xprt_iter_get_next(&clnt->cl_xpi);
+	if (task->tk_xprt)
+		atomic_long_inc(&task->tk_xprt->queuelen);
 }
 
 static
@@ -2788,9 +2835,11 @@ EXPORT_SYMBOL_GPL(rpc_clnt_xprt_switch_put);
 
 void rpc_clnt_xprt_switch_add_xprt(struct rpc_clnt *clnt, struct rpc_xprt *xprt)
 {
+	struct rpc_xprt_switch *xps;
+
 	rcu_read_lock();
-	rpc_xprt_switch_add_xprt(rcu_dereference(clnt->cl_xpi.xpi_xpswitch),
-				 xprt);
+	xps = rcu_dereference(clnt->cl_xpi.xpi_xpswitch);
+	rpc_xprt_switch_add_xprt(xps, xprt);
 	rcu_read_unlock();
 }
 EXPORT_SYMBOL_GPL(rpc_clnt_xprt_switch_add_xprt);
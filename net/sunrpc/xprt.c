@@ -44,6 +44,7 @@
 #include <linux/workqueue.h>
 #include <linux/net.h>
 #include <linux/ktime.h>
+#include <linux/percpu.h>
 
 #include <linux/sunrpc/clnt.h>
 #include <linux/sunrpc/metrics.h>
@@ -1138,6 +1139,75 @@ static bool xprt_throttle_congested(struct rpc_xprt *xprt, struct rpc_task *task
 	return ret;
 }
 
+/*
+ * Per-cpu cache of free slots.  Most requests are allocated and released
+ * on the same cpu, so this keeps them off xprt->reserve_lock.  The caches
+ * are drained back into xprt->free before anybody is sent to the backlog
+ * queue, and are bypassed entirely while the transport is congested.
+ */
+struct rpc_slot_cache {
+	spinlock_t		lock;
+	unsigned int		count;
+	struct rpc_rqst		*slots[RPC_SLOT_CACHE_SIZE];
+};
+
+static struct rpc_rqst *xprt_slot_cache_get(struct rpc_xprt *xprt)
+{
+	struct rpc_slot_cache *cache;
+	struct rpc_rqst *req = NULL;
+
+	if (xprt->slot_cache == NULL)
+		return NULL;
+	cache = raw_cpu_ptr(xprt->slot_cache);
+	spin_lock(&cache->lock);
+	if (cache->count)
+		req = cache->slots[--cache->count];
+	spin_unlock(&cache->lock);
+	return req;
+}
+
+static bool xprt_slot_cache_put(struct rpc_xprt *xprt, struct rpc_rqst *req)
+{
+	struct rpc_slot_cache *cache;
+	bool ret = false;
+
+	if (xprt->slot_cache == NULL)
+		return false;
+	cache = raw_cpu_ptr(xprt->slot_cache);
+	spin_lock(&cache->lock);
+	if (cache->count < RPC_SLOT_CACHE_SIZE) {
+		memset(req, 0, sizeof(*req));	/* mark unused */
+		cache->slots[cache->count++] = req;
+		ret = true;
+	}
+	spin_unlock(&cache->lock);
+	return ret;
+}
+
+/* Move all cached slots to xprt->free. Called with xprt->reserve_lock held */
+static bool xprt_slot_cache_drain(struct rpc_xprt *xprt)
+{
+	struct rpc_slot_cache *cache;
+	bool found = false;
+	int cpu;
+
+	if (xprt->slot_cache == NULL)
+		return false;
+	for_each_possible_cpu(cpu) {
+		cache = per_cpu_ptr(xprt->slot_cache, cpu);
+		if (!READ_ONCE(cache->count))
+			continue;
+		spin_lock(&cache->lock);
+		while (cache->count) {
+			list_add(&cache->slots[--cache->count]->rq_list,
+				 &xprt->free);
+			found = true;
+		}
+		spin_unlock(&cache->lock);
+	}
+	return found;
+}
+
 static struct rpc_rqst *xprt_dynamic_alloc_slot(struct rpc_xprt *xprt)
 {
 	struct rpc_rqst *req = ERR_PTR(-EAGAIN);
@@ -1170,8 +1240,15 @@ void xprt_alloc_slot(struct rpc_xprt *xprt, struct rpc_task *task)
 {
 	struct rpc_rqst *req;
 
+	req = xprt_slot_cache_get(xprt);
+	if (req != NULL) {
+		task->tk_status = 0;
+		task->tk_rqstp = req;
+		return;
+	}
+
 	spin_lock(&xprt->reserve_lock);
-	if (!list_empty(&xprt->free)) {
+	if (!list_empty(&xprt->free) || xprt_slot_cache_drain(xprt)) {
 		req = list_entry(xprt->free.next, struct rpc_rqst, rq_list);
 		list_del(&req->rq_list);
 		goto out_init_req;
@@ -1187,6 +1264,13 @@ void xprt_alloc_slot(struct rpc_xprt *xprt, struct rpc_task *task)
 		break;
 	case -EAGAIN:
 		xprt_add_backlog(xprt, task);
+		/*
+		 * A slot may have been parked in a per-cpu cache after the
+		 * drain above. Pairs with the barrier in xprt_free_slot().
+		 */
+		smp_mb();
+		if (xprt_slot_cache_drain(xprt))
+			xprt_wake_up_backlog(xprt);
 		dprintk("RPC:       waiting for request slot\n");
 		/* fall through */
 	default:
@@ -1218,8 +1302,27 @@ void xprt_lock_and_alloc_slot(struct rpc_xprt *xprt, struct rpc_task *task)
 }
 EXPORT_SYMBOL_GPL(xprt_lock_and_alloc_slot);
 
+/*
+ * Park the slot in this CPU's cache while it has room, dynamically
+ * allocated slots included: they stay counted in num_reqs and are reused
+ * before the table grows again. A full cache falls back to xprt->free,
+ * where dynamic slots above min_reqs are released.
+ */
 void xprt_free_slot(struct rpc_xprt *xprt, struct rpc_rqst *req)
 {
+	if (!test_bit(XPRT_CONGESTED, &xprt->state) &&
+	    xprt_slot_cache_put(xprt, req)) {
+		/* Pairs with the barrier in xprt_alloc_slot() */
+		smp_mb();
+		if (!test_bit(XPRT_CONGESTED, &xprt->state))
+			return;
+		spin_lock(&xprt->reserve_lock);
+		xprt_slot_cache_drain(xprt);
+		xprt_wake_up_backlog(xprt);
+		spin_unlock(&xprt->reserve_lock);
+		return;
+	}
+
 	spin_lock(&xprt->reserve_lock);
 	if (!xprt_dynamic_free_slot(xprt, req)) {
 		memset(req, 0, sizeof(*req));	/* mark unused */
@@ -1233,6 +1336,8 @@ EXPORT_SYMBOL_GPL(xprt_free_slot);
 static void xprt_free_all_slots(struct rpc_xprt *xprt)
 {
 	struct rpc_rqst *req;
+
+	xprt_slot_cache_drain(xprt);
 	while (!list_empty(&xprt->free)) {
 		req = list_first_entry(&xprt->free, struct rpc_rqst, rq_list);
 		list_del(&req->rq_list);
@@ -1254,6 +1359,12 @@ struct rpc_xprt *xprt_alloc(struct net *net, size_t size,
 
 	xprt_init(xprt, net);
 
+	xprt->slot_cache = alloc_percpu(struct rpc_slot_cache);
+	if (!xprt->slot_cache)
+		goto out_free;
+	for_each_possible_cpu(i)
+		spin_lock_init(&per_cpu_ptr(xprt->slot_cache, i)->lock);
+
 	for (i = 0; i < num_prealloc; i++) {
 		req = kzalloc(sizeof(struct rpc_rqst), GFP_KERNEL);
 		if (!req)
@@ -1280,6 +1391,7 @@ void xprt_free(struct rpc_xprt *xprt)
 {
 	put_net(xprt->xprt_net);
 	xprt_free_all_slots(xprt);
+	free_percpu(xprt->slot_cache);
 	kfree_rcu(xprt, rcu);
 }
 EXPORT_SYMBOL_GPL(xprt_free);
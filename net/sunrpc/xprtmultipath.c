@@ -24,6 +24,7 @@ typedef struct rpc_xprt *(*xprt_switch_find_xprt_t)(struct list_head *head,
 
 static const struct rpc_xprt_iter_ops rpc_xprt_iter_singular;
 static const struct rpc_xprt_iter_ops rpc_xprt_iter_roundrobin;
+static const struct rpc_xprt_iter_ops rpc_xprt_iter_leastqueued;
 static const struct rpc_xprt_iter_ops rpc_xprt_iter_listall;
 
 static void xprt_switch_add_xprt_locked(struct rpc_xprt_switch *xps,
@@ -38,23 +39,45 @@ static void xprt_switch_add_xprt_locked(struct rpc_xprt_switch *xps,
 	xps->xps_nxprts++;
 }
 
+static void xprt_switch_add_xprt(struct rpc_xprt_switch *xps,
+		struct rpc_xprt *xprt, bool shared)
+{
+	if (xprt == NULL)
+		return;
+	spin_lock(&xps->xps_lock);
+	if ((xps->xps_net == xprt->xprt_net || xps->xps_net == NULL) &&
+	    (shared ||
+	     !rpc_xprt_switch_has_addr(xps, (struct sockaddr *)&xprt->addr)))
+		xprt_switch_add_xprt_locked(xps, xprt);
+	spin_unlock(&xps->xps_lock);
+}
+
 /**
  * rpc_xprt_switch_add_xprt - Add a new rpc_xprt to an rpc_xprt_switch
  * @xps: pointer to struct rpc_xprt_switch
  * @xprt: pointer to struct rpc_xprt
  *
- * Adds xprt to the end of the list of struct rpc_xprt in xps.
+ * Adds xprt to the end of the list of struct rpc_xprt in xps, unless
+ * xps already has a transport to the same address.
  */
 void rpc_xprt_switch_add_xprt(struct rpc_xprt_switch *xps,
 		struct rpc_xprt *xprt)
 {
-	if (xprt == NULL)
-		return;
-	spin_lock(&xps->xps_lock);
-	if ((xps->xps_net == xprt->xprt_net || xps->xps_net == NULL) &&
-	    !rpc_xprt_switch_has_addr(xps, (struct sockaddr *)&xprt->addr))
-		xprt_switch_add_xprt_locked(xps, xprt);
-	spin_unlock(&xps->xps_lock);
+	xprt_switch_add_xprt(xps, xprt, false);
+}
+
+/**
+ * rpc_xprt_switch_add_xprt_shared - Add an rpc_xprt sharing its address
+ * @xps: pointer to struct rpc_xprt_switch
+ * @xprt: pointer to struct rpc_xprt
+ *
+ * Adds xprt to the end of the list of struct rpc_xprt in xps even if
+ * another transport connects to the same address, as nconnect does.
+ */
+void rpc_xprt_switch_add_xprt_shared(struct rpc_xprt_switch *xps,
+		struct rpc_xprt *xprt)
+{
+	xprt_switch_add_xprt(xps, xprt, true);
 }
 
 static void xprt_switch_remove_xprt_locked(struct rpc_xprt_switch *xps,
@@ -165,14 +188,28 @@ void xprt_switch_put(struct rpc_xprt_switch *xps)
  * rpc_xprt_switch_set_roundrobin - Set a round-robin policy on rpc_xprt_switch
  * @xps: pointer to struct rpc_xprt_switch
  *
- * Sets a round-robin default policy for iterators acting on xps.
+ * Sets a round-robin default policy for iterators acting on xps, unless
+ * a multipath policy has already been chosen.
  */
 void rpc_xprt_switch_set_roundrobin(struct rpc_xprt_switch *xps)
 {
-	if (READ_ONCE(xps->xps_iter_ops) != &rpc_xprt_iter_roundrobin)
+	if (READ_ONCE(xps->xps_iter_ops) == &rpc_xprt_iter_singular)
 		WRITE_ONCE(xps->xps_iter_ops, &rpc_xprt_iter_roundrobin);
 }
 
+/**
+ * rpc_xprt_switch_set_leastqueued - Set a least-queued policy on rpc_xprt_switch
+ * @xps: pointer to struct rpc_xprt_switch
+ *
+ * Sets a default policy for iterators acting on xps that picks the
+ * transport with the fewest tasks bound to it, round-robin among equals.
+ */
+void rpc_xprt_switch_set_leastqueued(struct rpc_xprt_switch *xps)
+{
+	if (READ_ONCE(xps->xps_iter_ops) != &rpc_xprt_iter_leastqueued)
+		WRITE_ONCE(xps->xps_iter_ops, &rpc_xprt_iter_leastqueued);
+}
+
 static
 const struct rpc_xprt_iter_ops *xprt_iter_ops(const struct rpc_xprt_iter *xpi)
 {
@@ -334,6 +371,45 @@ struct rpc_xprt *xprt_iter_next_entry_roundrobin(struct rpc_xprt_iter *xpi)
 			xprt_switch_find_next_entry_roundrobin);
 }
 
+/*
+ * Find the entry with the shortest queue.  Entries following cur win ties
+ * over those up to and including it, so idle transports are still used
+ * in round-robin order.
+ */
+static
+struct rpc_xprt *xprt_switch_find_next_entry_leastqueued(struct list_head *head,
+		const struct rpc_xprt *cur)
+{
+	struct rpc_xprt *pos, *before = NULL, *after = NULL;
+	long len, min_before = LONG_MAX, min_after = LONG_MAX;
+	bool seen_cur = (cur == NULL);
+
+	list_for_each_entry_rcu(pos, head, xprt_switch) {
+		len = atomic_long_read(&pos->queuelen);
+		if (seen_cur) {
+			if (len < min_after) {
+				min_after = len;
+				after = pos;
+			}
+		} else if (len < min_before) {
+			min_before = len;
+			before = pos;
+		}
+		if (pos == cur)
+			seen_cur = true;
+	}
+	if (after != NULL && min_after <= min_before)
+		return after;
+	return before;
+}
+
+static
+struct rpc_xprt *xprt_iter_next_entry_leastqueued(struct rpc_xprt_iter *xpi)
+{
+	return xprt_iter_next_entry_multiple(xpi,
+			xprt_switch_find_next_entry_leastqueued);
+}
+
 static
 struct rpc_xprt *xprt_iter_next_entry_all(struct rpc_xprt_iter *xpi)
 {
@@ -500,6 +576,14 @@ const struct rpc_xprt_iter_ops rpc_xprt_iter_roundrobin = {
 	.xpi_next = xprt_iter_next_entry_roundrobin,
 };
 
+/* Policy for picking the least loaded entry in the rpc_xprt_switch */
+static
+const struct rpc_xprt_iter_ops rpc_xprt_iter_leastqueued = {
+	.xpi_rewind = xprt_iter_default_rewind,
+	.xpi_xprt = xprt_iter_current_entry,
+	.xpi_next = xprt_iter_next_entry_leastqueued,
+};
+
 /* Policy for once-through iteration of entries in the rpc_xprt_switch */
 static
 const struct rpc_xprt_iter_ops rpc_xprt_iter_listall = {
@@ -390,10 +390,11 @@ static int xs_send_pagedata(struct socket *sock, struct xdr_buf *xdr, unsigned i
  * @xdr: buffer containing this request
  * @base: starting position in the buffer
  * @zerocopy: true if it is safe to use sendpage()
+ * @more: true if another request will follow on this socket
  * @sent_p: return the total number of bytes successfully queued for sending
  *
  */
-static int xs_sendpages(struct socket *sock, struct sockaddr *addr, int addrlen, struct xdr_buf *xdr, unsigned int base, bool zerocopy, int *sent_p)
+static int xs_sendpages(struct socket *sock, struct sockaddr *addr, int addrlen, struct xdr_buf *xdr, unsigned int base, bool zerocopy, bool more, int *sent_p)
 {
 	unsigned int remainder = xdr->len - base;
 	int err = 0;
@@ -410,7 +411,7 @@ static int xs_sendpages(struct socket *sock, struct sockaddr *addr, int addrlen,
 	if (base < xdr->head[0].iov_len || addr != NULL) {
 		unsigned int len = xdr->head[0].iov_len - base;
 		remainder -= len;
-		err = xs_send_kvec(sock, addr, addrlen, &xdr->head[0], base, remainder != 0);
+		err = xs_send_kvec(sock, addr, addrlen, &xdr->head[0], base, remainder != 0 || more);
 		if (remainder == 0 || err != len)
 			goto out;
 		*sent_p += err;
@@ -421,7 +422,7 @@ static int xs_sendpages(struct socket *sock, struct sockaddr *addr, int addrlen,
 	if (base < xdr->page_len) {
 		unsigned int len = xdr->page_len - base;
 		remainder -= len;
-		err = xs_send_pagedata(sock, xdr, base, remainder != 0, zerocopy, &sent);
+		err = xs_send_pagedata(sock, xdr, base, remainder != 0 || more, zerocopy, &sent);
 		*sent_p += sent;
 		if (remainder == 0 || sent != len)
 			goto out;
@@ -431,7 +432,7 @@ static int xs_sendpages(struct socket *sock, struct sockaddr *addr, int addrlen,
 
 	if (base >= xdr->tail[0].iov_len)
 		return 0;
-	err = xs_send_kvec(sock, NULL, 0, &xdr->tail[0], base, 0);
+	err = xs_send_kvec(sock, NULL, 0, &xdr->tail[0], base, more);
 out:
 	if (err > 0) {
 		*sent_p += err;
@@ -529,7 +530,7 @@ static int xs_local_send_request(struct rpc_task *task)
 
 	req->rq_xtime = ktime_get();
 	status = xs_sendpages(transport->sock, NULL, 0, xdr, req->rq_bytes_sent,
-			      true, &sent);
+			      true, false, &sent);
 	dprintk("RPC:       %s(%u) = %d\n",
 			__func__, xdr->len - req->rq_bytes_sent, status);
 
@@ -592,7 +593,7 @@ static int xs_udp_send_request(struct rpc_task *task)
 		return -ENOTCONN;
 	req->rq_xtime = ktime_get();
 	status = xs_sendpages(transport->sock, xs_addr(xprt), xprt->addrlen,
-			      xdr, req->rq_bytes_sent, true, &sent);
+			      xdr, req->rq_bytes_sent, true, false, &sent);
 
 	dprintk("RPC:       xs_udp_send_request(%u) = %d\n",
 			xdr->len - req->rq_bytes_sent, status);
@@ -648,6 +649,11 @@ static int xs_udp_send_request(struct rpc_task *task)
  * ENOTCONN:	Caller needs to invoke connect logic then call again
  *    other:	Some other error occurred, the request was not sent
  *
+ * If other tasks are already queued to send on this transport, the
+ * record is sent with MSG_MORE so that TCP can pack it into the same
+ * segments as the requests that follow.  The last request of such a
+ * burst is sent without MSG_MORE, which pushes the queued data out.
+ *
  * XXX: In the case of soft timeouts, should we eventually give up
  *	if sendmsg is not able to make progress?
  */
@@ -657,6 +663,7 @@ static int xs_tcp_send_request(struct rpc_task *task)
 	struct rpc_xprt *xprt = req->rq_xprt;
 	struct sock_xprt *transport = container_of(xprt, struct sock_xprt, xprt);
 	struct xdr_buf *xdr = &req->rq_snd_buf;
+	bool more = READ_ONCE(xprt->sending.qlen) != 0;
 	bool zerocopy = true;
 	bool vm_wait = false;
 	int status;
@@ -684,7 +691,7 @@ static int xs_tcp_send_request(struct rpc_task *task)
 	while (1) {
 		sent = 0;
 		status = xs_sendpages(transport->sock, NULL, 0, xdr,
-				      req->rq_bytes_sent, zerocopy, &sent);
+				      req->rq_bytes_sent, zerocopy, more, &sent);
 
 		dprintk("RPC:       xs_tcp_send_request(%u) = %d\n",
 				xdr->len - req->rq_bytes_sent, status);
@@ -695,6 +702,10 @@ static int xs_tcp_send_request(struct rpc_task *task)
 		req->rq_xmit_bytes_sent += sent;
 		if (likely(req->rq_bytes_sent >= req->rq_slen)) {
 			req->rq_bytes_sent = 0;
+			if (more)
+				set_bit(XPRT_SOCK_CORKED, &transport->sock_state);
+			else
+				clear_bit(XPRT_SOCK_CORKED, &transport->sock_state);
 			return 0;
 		}
 
@@ -757,9 +768,13 @@ static int xs_tcp_send_request(struct rpc_task *task)
  * This cleans up if an error causes us to abort the transmission of a request.
  * In this case, the socket may need to be reset in order to avoid confusing
  * the server.
+ *
+ * If the last request went out with MSG_MORE and nobody else is waiting to
+ * send, data may still be held back by TCP, so have it pushed out.
  */
 static void xs_tcp_release_xprt(struct rpc_xprt *xprt, struct rpc_task *task)
 {
+	struct sock_xprt *transport = container_of(xprt, struct sock_xprt, xprt);
 	struct rpc_rqst *req;
 
 	if (task != xprt->snd_task)
@@ -776,6 +791,27 @@ static void xs_tcp_release_xprt(struct rpc_xprt *xprt, struct rpc_task *task)
 	set_bit(XPRT_CLOSE_WAIT, &xprt->state);
 out_release:
 	xprt_release_xprt(xprt, task);
+	if (xprt->snd_task == NULL &&
+	    test_bit(XPRT_SOCK_CORKED, &transport->sock_state))
+		queue_work(xprtiod_workqueue, &transport->uncork_worker);
+}
+
+/*
+ * Push out whatever the last MSG_MORE send left queued in the socket.
+ * Clearing TCP_CORK flushes pending frames even though it was never set.
+ */
+static void xs_tcp_uncork_workfn(struct work_struct *work)
+{
+	struct sock_xprt *transport =
+		container_of(work, struct sock_xprt, uncork_worker);
+	int val = 0;
+
+	mutex_lock(&transport->recv_mutex);
+	if (transport->sock != NULL &&
+	    test_and_clear_bit(XPRT_SOCK_CORKED, &transport->sock_state))
+		kernel_setsockopt(transport->sock, SOL_TCP, TCP_CORK,
+				  (char *)&val, sizeof(val));
+	mutex_unlock(&transport->recv_mutex);
 }
 
 static void xs_save_old_callbacks(struct sock_xprt *transport, struct sock *sk)
@@ -799,6 +835,7 @@ static void xs_sock_reset_state_flags(struct rpc_xprt *xprt)
 	struct sock_xprt *transport = container_of(xprt, struct sock_xprt, xprt);
 
 	clear_bit(XPRT_SOCK_DATA_READY, &transport->sock_state);
+	clear_bit(XPRT_SOCK_CORKED, &transport->sock_state);
 }
 
 static void xs_sock_reset_connection_flags(struct rpc_xprt *xprt)
@@ -917,6 +954,7 @@ static void xs_destroy(struct rpc_xprt *xprt)
 	cancel_delayed_work_sync(&transport->connect_worker);
 	xs_close(xprt);
 	cancel_work_sync(&transport->recv_worker);
+	cancel_work_sync(&transport->uncork_worker);
 	xs_xprt_free(xprt);
 	module_put(THIS_MODULE);
 }
@@ -2907,6 +2945,7 @@ static struct rpc_xprt *xs_setup_xprt(struct xprt_create *args,
 
 	new = container_of(xprt, struct sock_xprt, xprt);
 	mutex_init(&new->recv_mutex);
+	INIT_WORK(&new->uncork_worker, xs_tcp_uncork_workfn);
 	memcpy(&xprt->addr, args->dstaddr, args->addrlen);
 	xprt->addrlen = args->addrlen;
 	if (args->srcaddr)
@@ -43,12 +43,67 @@
 
 #define MAX_IV_SIZE	TLS_CIPHER_AES_GCM_128_IV_SIZE
 
+/* Records decrypted asynchronously by one recvmsg() call.  Lives on the
+ * caller's stack; recvmsg() waits for every submitted record before it
+ * returns.  'pending' carries a bias of one held by the caller.
+ */
+struct tls_decrypt_async {
+	atomic_t pending;
+	struct completion done;
+	int err;
+};
+
+/* Per-record state handed to tls_decrypt_done(), carved out of the same
+ * allocation as the aead_request.
+ */
+struct tls_decrypt_req {
+	struct sk_buff *skb;
+	struct tls_decrypt_async *async;
+};
+
+static void tls_decrypt_done(struct crypto_async_request *req, int err)
+{
+	struct aead_request *aead_req = (struct aead_request *)req;
+	struct tls_decrypt_req *dreq = req->data;
+	struct tls_decrypt_async *async = dreq->async;
+	struct scatterlist *sg;
+	unsigned int pages;
+
+	/* Request left the backlog, completion follows later. */
+	if (err == -EINPROGRESS)
+		return;
+
+	if (err)
+		WRITE_ONCE(async->err, err);
+
+	/* Skip the first S/G entry as it points to AAD */
+	for_each_sg(sg_next(aead_req->dst), sg, UINT_MAX, pages) {
+		if (!sg)
+			break;
+		put_page(sg_page(sg));
+	}
+
+	kfree_skb(dreq->skb);
+	kfree(aead_req);
+
+	if (atomic_dec_and_test(&async->pending))
+		complete(&async->done);
+}
+
+static bool tls_sw_async_capable(struct tls_sw_context_rx *ctx)
+{
+	return crypto_aead_tfm(ctx->aead_recv)->__crt_alg->cra_flags &
+	       CRYPTO_ALG_ASYNC;
+}
+
 static int tls_do_decryption(struct sock *sk,
+			     struct sk_buff *skb,
 			     struct scatterlist *sgin,
 			     struct scatterlist *sgout,
 			     char *iv_recv,
 			     size_t data_len,
-			     struct aead_request *aead_req)
+			     struct aead_request *aead_req,
+			     struct tls_decrypt_req *dreq)
 {
 	struct tls_context *tls_ctx = tls_get_ctx(sk);
 	struct tls_sw_context_rx *ctx = tls_sw_ctx_rx(tls_ctx);
@@ -59,10 +114,32 @@ static int tls_do_decryption(struct sock *sk,
 	aead_request_set_crypt(aead_req, sgin, sgout,
 			       data_len + tls_ctx->rx.tag_size,
 			       (u8 *)iv_recv);
-	aead_request_set_callback(aead_req, CRYPTO_TFM_REQ_MAY_BACKLOG,
-				  crypto_req_done, &ctx->async_wait);
 
-	ret = crypto_wait_req(crypto_aead_decrypt(aead_req), &ctx->async_wait);
+	if (dreq) {
+		dreq->skb = skb;
+		atomic_inc(&dreq->async->pending);
+		aead_request_set_callback(aead_req,
+					  CRYPTO_TFM_REQ_MAY_BACKLOG,
+					  tls_decrypt_done, dreq);
+	} else {
+		aead_request_set_callback(aead_req,
+					  CRYPTO_TFM_REQ_MAY_BACKLOG,
+					  crypto_req_done, &ctx->async_wait);
+	}
+
+	ret = crypto_aead_decrypt(aead_req);
+	if (ret == -EINPROGRESS || ret == -EBUSY) {
+		/* tls_decrypt_done() now owns skb, pages and request */
+		if (dreq)
+			return -EINPROGRESS;
+
+		ret = crypto_wait_req(ret, &ctx->async_wait);
+	}
+
+	/* Completed inline, the callback will not run. */
+	if (dreq)
+		atomic_dec(&dreq->async->pending);
+
 	return ret;
 }
 
@@ -674,13 +751,15 @@ static struct sk_buff *tls_wait_data(struct sock *sk, int flags,
 static int decrypt_internal(struct sock *sk, struct sk_buff *skb,
 			    struct iov_iter *out_iov,
 			    struct scatterlist *out_sg,
-			    int *chunk, bool *zc)
+			    int *chunk, bool *zc,
+			    struct tls_decrypt_async *async)
 {
 	struct tls_context *tls_ctx = tls_get_ctx(sk);
 	struct tls_sw_context_rx *ctx = tls_sw_ctx_rx(tls_ctx);
 	struct strp_msg *rxm = strp_msg(skb);
 	int n_sgin, n_sgout, nsg, mem_size, aead_size, err, pages = 0;
 	struct aead_request *aead_req;
+	struct tls_decrypt_req *dreq;
 	struct sk_buff *unused;
 	u8 *aad, *iv, *mem = NULL;
 	struct scatterlist *sgin = NULL;
@@ -708,12 +787,14 @@ static int decrypt_internal(struct sock *sk, struct sk_buff *skb,
 
 	aead_size = sizeof(*aead_req) + crypto_aead_reqsize(ctx->aead_recv);
 	mem_size = aead_size + (nsg * sizeof(struct scatterlist));
+	mem_size = mem_size + sizeof(*dreq);
 	mem_size = mem_size + TLS_AAD_SPACE_SIZE;
 	mem_size = mem_size + crypto_aead_ivsize(ctx->aead_recv);
 
 	/* Allocate a single block of memory which contains
-	 * aead_req || sgin[] || sgout[] || aad || iv.
-	 * This order achieves correct alignment for aead_req, sgin, sgout.
+	 * aead_req || sgin[] || sgout[] || dreq || aad || iv.
+	 * This order achieves correct alignment for aead_req, sgin, sgout,
+	 * dreq.
 	 */
 	mem = kmalloc(mem_size, sk->sk_allocation);
 	if (!mem)
@@ -723,7 +804,8 @@ static int decrypt_internal(struct sock *sk, struct sk_buff *skb,
 	aead_req = (struct aead_request *)mem;
 	sgin = (struct scatterlist *)(mem + aead_size);
 	sgout = sgin + n_sgin;
-	aad = (u8 *)(sgout + n_sgout);
+	dreq = (struct tls_decrypt_req *)(sgout + n_sgout);
+	aad = (u8 *)(dreq + 1);
 	iv = aad + TLS_AAD_SPACE_SIZE;
 
 	/* Prepare IV */
@@ -776,8 +858,20 @@ static int decrypt_internal(struct sock *sk, struct sk_buff *skb,
 		*zc = false;
 	}
 
+	/* Only zero-copy records can complete behind the caller's back:
+	 * the plaintext lands directly in user pages and nothing else
+	 * needs the skb afterwards.
+	 */
+	if (async && *zc && out_iov)
+		dreq->async = async;
+	else
+		dreq = NULL;
+
 	/* Prepare and submit AEAD request */
-	err = tls_do_decryption(sk, sgin, sgout, iv, data_len, aead_req);
+	err = tls_do_decryption(sk, skb, sgin, sgout, iv, data_len,
+				aead_req, dreq);
+	if (err == -EINPROGRESS)
+		return err;
 
 	/* Release the pages in case iov was mapped to pages */
 	for (; pages > 0; pages--)
@@ -788,7 +882,8 @@ static int decrypt_internal(struct sock *sk, struct sk_buff *skb,
 }
 
 static int decrypt_skb_update(struct sock *sk, struct sk_buff *skb,
-			      struct iov_iter *dest, int *chunk, bool *zc)
+			      struct iov_iter *dest, int *chunk, bool *zc,
+			      struct tls_decrypt_async *async)
 {
 	struct tls_context *tls_ctx = tls_get_ctx(sk);
 	struct tls_sw_context_rx *ctx = tls_sw_ctx_rx(tls_ctx);
@@ -801,7 +896,14 @@ static int decrypt_skb_update(struct sock *sk, struct sk_buff *skb,
 		return err;
 #endif
 	if (!ctx->decrypted) {
-		err = decrypt_internal(sk, skb, dest, NULL, chunk, zc);
+		err = decrypt_internal(sk, skb, dest, NULL, chunk, zc, async);
+		if (err == -EINPROGRESS) {
+			/* The next record's AAD depends on the sequence
+			 * number, so advance it now.
+			 */
+			tls_advance_record_sn(sk, &tls_ctx->rx);
+			return err;
+		}
 		if (err < 0)
 			return err;
 	} else {
@@ -823,7 +925,7 @@ int decrypt_skb(struct sock *sk, struct sk_buff *skb,
 	bool zc = true;
 	int chunk;
 
-	return decrypt_internal(sk, skb, NULL, sgout, &chunk, &zc);
+	return decrypt_internal(sk, skb, NULL, sgout, &chunk, &zc, NULL);
 }
 
 static bool tls_sw_advance_skb(struct sock *sk, struct sk_buff *skb,
@@ -857,12 +959,15 @@ int tls_sw_recvmsg(struct sock *sk,
 {
 	struct tls_context *tls_ctx = tls_get_ctx(sk);
 	struct tls_sw_context_rx *ctx = tls_sw_ctx_rx(tls_ctx);
+	struct tls_decrypt_async async;
 	unsigned char control;
 	struct strp_msg *rxm;
 	struct sk_buff *skb;
 	ssize_t copied = 0;
 	bool cmsg = false;
 	int target, err = 0;
+	int num_async = 0;
+	bool async_capable;
 	long timeo;
 	bool is_kvec = msg->msg_iter.type & ITER_KVEC;
 
@@ -871,8 +976,14 @@ int tls_sw_recvmsg(struct sock *sk,
 	if (unlikely(flags & MSG_ERRQUEUE))
 		return sock_recv_errqueue(sk, msg, len, SOL_IP, IP_RECVERR);
 
+	atomic_set(&async.pending, 1);
+	init_completion(&async.done);
+	async.err = 0;
+
 	lock_sock(sk);
 
+	async_capable = tls_sw_async_capable(ctx);
+
 	target = sock_rcvlowat(sk, flags & MSG_WAITALL, len);
 	timeo = sock_rcvtimeo(sk, flags & MSG_DONTWAIT);
 	do {
@@ -909,7 +1020,27 @@ int tls_sw_recvmsg(struct sock *sk,
 				zc = true;
 
 			err = decrypt_skb_update(sk, skb, &msg->msg_iter,
-						 &chunk, &zc);
+						 &chunk, &zc,
+						 async_capable &&
+						 control == TLS_RECORD_TYPE_DATA ?
+						 &async : NULL);
+			if (err == -EINPROGRESS) {
+				/* The record is in flight and owns the skb;
+				 * let strparser deliver the next one while the
+				 * engine works on this.
+				 */
+				num_async++;
+				err = 0;
+				copied += chunk;
+				len -= chunk;
+				ctx->recv_pkt = NULL;
+				__strp_unpause(&ctx->strp);
+				msg->msg_flags |= MSG_EOR;
+
+				if (copied >= target && !ctx->recv_pkt)
+					break;
+				continue;
+			}
 			if (err < 0) {
 				tls_err_abort(sk, EBADMSG);
 				goto recv_end;
@@ -954,6 +1085,18 @@ int tls_sw_recvmsg(struct sock *sk,
 	} while (len);
 
 recv_end:
+	if (num_async) {
+		/* Wait for all previously submitted records to be decrypted */
+		if (!atomic_dec_and_test(&async.pending))
+			wait_for_completion(&async.done);
+
+		if (READ_ONCE(async.err)) {
+			/* One of the async decrypts failed */
+			tls_err_abort(sk, EBADMSG);
+			err = async.err;
+			copied = 0;
+		}
+	}
 	release_sock(sk);
 	return copied ? : err;
 }
@@ -988,7 +1131,7 @@ ssize_t tls_sw_splice_read(struct socket *sock,  loff_t *ppos,
 	}
 
 	if (!ctx->decrypted) {
-		err = decrypt_skb_update(sk, skb, NULL, &chunk, &zc);
+		err = decrypt_skb_update(sk, skb, NULL, &chunk, &zc, NULL);
 
 		if (err < 0) {
 			tls_err_abort(sk, EBADMSG);
@@ -29,6 +29,8 @@
 #include "xdp_umem.h"
 
 #define TX_BATCH_SIZE 16
+/* Descriptors one copy-mode sendmsg() sends before returning -EAGAIN */
+#define TX_BUDGET (TX_BATCH_SIZE * 16)
 
 static struct xdp_sock *xdp_sk(struct sock *sk)
 {
@@ -206,64 +208,159 @@ static void xsk_destruct_skb(struct sk_buff *skb)
 	sock_wfree(skb);
 }
 
+/* Batched counterpart of dev_direct_xmit(): hands all skbs on @list to
+ * the driver under one Tx queue lock, with xmit_more set on all but the
+ * last. Frames the driver does not take are freed, which completes their
+ * descriptors, as dev_direct_xmit() does.
+ */
+static int xsk_direct_xmit_batch(struct xdp_sock *xs, struct sk_buff_head *list)
+{
+	struct net_device *dev = xs->dev;
+	struct sk_buff_head ready;
+	struct netdev_queue *txq;
+	struct sk_buff *skb;
+	bool again = false;
+	int err = 0;
+
+	if (unlikely(!netif_running(dev) || !netif_carrier_ok(dev))) {
+		atomic_long_add(skb_queue_len(list), &dev->tx_dropped);
+		__skb_queue_purge(list);
+		return -EBUSY;
+	}
+
+	txq = netdev_get_tx_queue(dev, xs->queue_id);
+
+	__skb_queue_head_init(&ready);
+	while ((skb = __skb_dequeue(list)) != NULL) {
+		struct sk_buff *orig_skb = skb;
+
+		skb = validate_xmit_skb_list(skb, dev, &again);
+		if (skb != orig_skb) {
+			atomic_long_inc(&dev->tx_dropped);
+			kfree_skb_list(skb);
+			err = -EBUSY;
+			continue;
+		}
+		skb_set_queue_mapping(skb, xs->queue_id);
+		__skb_queue_tail(&ready, skb);
+	}
+
+	local_bh_disable();
+	HARD_TX_LOCK(dev, txq, smp_processor_id());
+	while ((skb = skb_peek(&ready)) != NULL) {
+		int rc;
+
+		if (netif_xmit_frozen_or_drv_stopped(txq))
+			break;
+
+		__skb_unlink(skb, &ready);
+		rc = netdev_start_xmit(skb, dev, txq, !skb_queue_empty(&ready));
+		if (!dev_xmit_complete(rc)) {
+			__skb_queue_head(&ready, skb);
+			break;
+		}
+	}
+	HARD_TX_UNLOCK(dev, txq);
+	local_bh_enable();
+
+	if (unlikely(!skb_queue_empty(&ready))) {
+		/* SKBs completed but not sent */
+		__skb_queue_purge(&ready);
+		err = -EBUSY;
+	}
+
+	return err;
+}
+
 static int xsk_generic_xmit(struct sock *sk, struct msghdr *m,
 			    size_t total_len)
 {
-	u32 max_batch = TX_BATCH_SIZE;
+	struct xdp_desc descs[TX_BATCH_SIZE];
 	struct xdp_sock *xs = xdp_sk(sk);
+	u32 budget = TX_BUDGET;
 	bool sent_frame = false;
-	struct xdp_desc desc;
+	struct sk_buff_head batch;
 	struct sk_buff *skb;
+	u32 i, nb;
 	int err = 0;
 
+	__skb_queue_head_init(&batch);
 	mutex_lock(&xs->mutex);
 
 	if (xs->queue_id >= xs->dev->real_num_tx_queues)
 		goto out;
 
-	while (xskq_peek_desc(xs->tx, &desc)) {
-		char *buffer;
-		u64 addr;
-		u32 len;
+	/* Descriptors produced from now on will be seen without a kick */
+	xskq_clear_need_wakeup(xs->tx);
 
-		if (max_batch-- == 0) {
-			err = -EAGAIN;
+	for (;;) {
+		if (!budget) {
+			if (xskq_peek_descs(xs->tx, descs, 1))
+				err = -EAGAIN;
 			goto out;
 		}
 
-		len = desc.len;
-		skb = sock_alloc_send_skb(sk, len, 1, &err);
-		if (unlikely(!skb))
-			goto out;
+		nb = xskq_peek_descs(xs->tx, descs,
+				     min_t(u32, budget, TX_BATCH_SIZE));
+		if (!nb) {
+			/* Pairs with the barrier between the producer update
+			 * and the flags check in the application.
+			 */
+			xskq_set_need_wakeup(xs->tx);
+			smp_mb();
+			if (!xskq_peek_descs(xs->tx, descs, 1))
+				goto out;
+			xskq_clear_need_wakeup(xs->tx);
+			continue;
+		}
 
-		skb_put(skb, len);
-		addr = desc.addr;
-		buffer = xdp_umem_get_data(xs->umem, addr);
-		err = skb_store_bits(skb, 0, buffer, len);
-		if (unlikely(err) || xskq_reserve_addr(xs->umem->cq)) {
-			kfree_skb(skb);
+		nb = xskq_reserve_addr_n(xs->umem->cq, nb);
+		if (!nb)
 			goto out;
+
+		for (i = 0; i < nb; i++) {
+			u32 len = descs[i].len;
+			u64 addr = descs[i].addr;
+			char *buffer;
+
+			skb = sock_alloc_send_skb(sk, len, 1, &err);
+			if (unlikely(!skb))
+				break;
+
+			skb_put(skb, len);
+			buffer = xdp_umem_get_data(xs->umem, addr);
+			err = skb_store_bits(skb, 0, buffer, len);
+			if (unlikely(err)) {
+				kfree_skb(skb);
+				break;
+			}
+
+			skb->dev = xs->dev;
+			skb->priority = sk->sk_priority;
+			skb->mark = sk->sk_mark;
+			skb_shinfo(skb)->destructor_arg = (void *)(long)addr;
+			skb->destructor = xsk_destruct_skb;
+			__skb_queue_tail(&batch, skb);
 		}
 
-		skb->dev = xs->dev;
-		skb->priority = sk->sk_priority;
-		skb->mark = sk->sk_mark;
-		skb_shinfo(skb)->destructor_arg = (void *)(long)addr;
-		skb->destructor = xsk_destruct_skb;
+		xskq_discard_descs(xs->tx, i);
+		xskq_cancel_addr_n(xs->umem->cq, nb - i);
+		budget -= i;
 
-		err = dev_direct_xmit(skb, xs->queue_id);
-		xskq_discard_desc(xs->tx);
-		/* Ignore NET_XMIT_CN as packet might have been sent */
-		if (err == NET_XMIT_DROP || err == NETDEV_TX_BUSY) {
-			/* SKB completed but not sent */
-			err = -EBUSY;
-			goto out;
+		if (i) {
+			sent_frame = true;
+			if (xsk_direct_xmit_batch(xs, &batch)) {
+				err = -EBUSY;
+				goto out;
+			}
 		}
 
-		sent_frame = true;
+		if (i < nb)
+			goto out;
 	}
 
 out:
+	xskq_set_need_wakeup(xs->tx);
 	if (sent_frame)
 		sk->sk_write_space(sk);
 
@@ -507,6 +604,9 @@ static int xsk_setsockopt(struct socket *sock, int level, int optname,
 		mutex_lock(&xs->mutex);
 		q = (optname == XDP_TX_RING) ? &xs->tx : &xs->rx;
 		err = xsk_init_queue(entries, q, false);
+		/* Nothing drains the Tx ring until the first sendmsg() */
+		if (!err && optname == XDP_TX_RING)
+			xskq_set_need_wakeup(xs->tx);
 		mutex_unlock(&xs->mutex);
 		return err;
 	}
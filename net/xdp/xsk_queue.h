@@ -13,9 +13,17 @@
 #define RX_BATCH_SIZE 16
 #define LAZY_UPDATE_THRESHOLD 128
 
+/* Bits in xdp_ring::flags. The word directly follows the consumer index
+ * in the mapped ring. NEED_WAKEUP on the Tx ring means the kernel is not
+ * currently draining it, so the application has to call sendmsg() for
+ * newly produced descriptors to be sent.
+ */
+#define XSK_RING_NEED_WAKEUP (1 << 0)
+
 struct xdp_ring {
 	u32 producer ____cacheline_aligned_in_smp;
 	u32 consumer ____cacheline_aligned_in_smp;
+	u32 flags;
 };
 
 /* Used for the RX and TX queues for packets */
@@ -74,6 +82,18 @@ static inline u32 xskq_nb_free(struct xsk_queue *q, u32 producer, u32 dcnt)
 	return q->nentries - (producer - q->cons_tail);
 }
 
+static inline void xskq_set_need_wakeup(struct xsk_queue *q)
+{
+	WRITE_ONCE(q->ring->flags,
+		   READ_ONCE(q->ring->flags) | XSK_RING_NEED_WAKEUP);
+}
+
+static inline void xskq_clear_need_wakeup(struct xsk_queue *q)
+{
+	WRITE_ONCE(q->ring->flags,
+		   READ_ONCE(q->ring->flags) & ~XSK_RING_NEED_WAKEUP);
+}
+
 /* UMEM queue */
 
 static inline bool xskq_is_valid_addr(struct xsk_queue *q, u64 addr)
@@ -166,15 +186,36 @@ static inline int xskq_reserve_addr(struct xsk_queue *q)
 	return 0;
 }
 
+/* Reserve up to @nb_entries slots, returns how many were reserved */
+static inline u32 xskq_reserve_addr_n(struct xsk_queue *q, u32 nb_entries)
+{
+	u32 free_entries = xskq_nb_free(q, q->prod_head, nb_entries);
+
+	if (free_entries < nb_entries)
+		nb_entries = free_entries;
+
+	q->prod_head += nb_entries;
+	return nb_entries;
+}
+
+static inline void xskq_cancel_addr_n(struct xsk_queue *q, u32 nb_entries)
+{
+	q->prod_head -= nb_entries;
+}
+
 /* Rx/Tx queue */
 
-static inline bool xskq_is_valid_desc(struct xsk_queue *q, struct xdp_desc *d)
+static inline bool xskq_desc_fits(struct xsk_queue *q,
+				  const struct xdp_desc *d)
 {
-	if (!xskq_is_valid_addr(q, d->addr))
-		return false;
+	return d->addr < q->umem_props.size &&
+	       ((d->addr + d->len) & q->umem_props.chunk_mask) ==
+	       (d->addr & q->umem_props.chunk_mask);
+}
 
-	if (((d->addr + d->len) & q->umem_props.chunk_mask) !=
-	    (d->addr & q->umem_props.chunk_mask)) {
+static inline bool xskq_is_valid_desc(struct xsk_queue *q, struct xdp_desc *d)
+{
+	if (!xskq_desc_fits(q, d)) {
 		q->invalid_descs++;
 		return false;
 	}
@@ -218,6 +259,47 @@ static inline void xskq_discard_desc(struct xsk_queue *q)
 	q->cons_tail++;
 }
 
+/* Peek at up to @max descriptors without consuming them. Invalid
+ * descriptors at the head are skipped and accounted as usual. An invalid
+ * one further in ends the batch, so that the returned descriptors map
+ * to consecutive ring entries and can be consumed with
+ * xskq_discard_descs().
+ */
+static inline u32 xskq_peek_descs(struct xsk_queue *q, struct xdp_desc *descs,
+				  u32 max)
+{
+	struct xdp_rxtx_ring *ring = (struct xdp_rxtx_ring *)q->ring;
+	u32 n;
+
+	if (q->cons_head - q->cons_tail < max) {
+		WRITE_ONCE(q->ring->consumer, q->cons_tail);
+		if (q->prod_tail - q->cons_tail < max)
+			q->prod_tail = READ_ONCE(q->ring->producer);
+		q->cons_head = q->cons_tail + xskq_nb_avail(q, max);
+
+		/* Order consumer and data */
+		smp_rmb();
+	}
+
+	if (!xskq_validate_desc(q, &descs[0]))
+		return 0;
+
+	for (n = 1; n < max && q->cons_tail + n != q->cons_head; n++) {
+		unsigned int idx = (q->cons_tail + n) & q->ring_mask;
+
+		descs[n] = READ_ONCE(ring->desc[idx]);
+		if (!xskq_desc_fits(q, &descs[n]))
+			break;
+	}
+
+	return n;
+}
+
+static inline void xskq_discard_descs(struct xsk_queue *q, u32 nb_entries)
+{
+	q->cons_tail += nb_entries;
+}
+
 static inline int xskq_produce_batch_desc(struct xsk_queue *q,
 					  u64 addr, u32 len)
 {
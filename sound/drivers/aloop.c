@@ -30,7 +30,8 @@
  */
 
 #include <linux/init.h>
-#include <linux/jiffies.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
 #include <linux/slab.h>
 #include <linux/time.h>
 #include <linux/wait.h>
@@ -50,6 +51,9 @@ MODULE_SUPPORTED_DEVICE("{{ALSA,Loopback soundcard}}");
 
 #define MAX_PCM_SUBSTREAMS	8
 
+/* resolution of the position clock, ticks per second */
+#define LOOPBACK_HZ		1000
+
 static int index[SNDRV_CARDS] = SNDRV_DEFAULT_IDX;	/* Index 0-MAX */
 static char *id[SNDRV_CARDS] = SNDRV_DEFAULT_STR;	/* ID for this card */
 static bool enable[SNDRV_CARDS] = {1, [1 ... (SNDRV_CARDS - 1)] = 0};
@@ -115,12 +119,14 @@ struct loopback_pcm {
 	unsigned int pcm_rate_shift;	/* rate shift value */
 	/* flags */
 	unsigned int period_update_pending :1;
+	unsigned int no_period :1;	/* wake on avail_min, not periods */
 	/* timer stuff */
 	unsigned int irq_pos;		/* fractional IRQ position */
 	unsigned int period_size_frac;
 	unsigned int last_drift;
-	unsigned long last_jiffies;
-	struct timer_list timer;
+	u64 last_tick;
+	struct hrtimer timer;
+	unsigned long wakeups;		/* timer expirations */
 };
 
 static struct platform_device *devices[SNDRV_CARDS];
@@ -128,10 +134,10 @@ static struct platform_device *devices[SNDRV_CARDS];
 static inline unsigned int byte_pos(struct loopback_pcm *dpcm, unsigned int x)
 {
 	if (dpcm->pcm_rate_shift == NO_PITCH) {
-		x /= HZ;
+		x /= LOOPBACK_HZ;
 	} else {
 		x = div_u64(NO_PITCH * (unsigned long long)x,
-			    HZ * (unsigned long long)dpcm->pcm_rate_shift);
+			    LOOPBACK_HZ * (unsigned long long)dpcm->pcm_rate_shift);
 	}
 	return x - (x % dpcm->pcm_salign);
 }
@@ -139,10 +145,10 @@ static inline unsigned int byte_pos(struct loopback_pcm *dpcm, unsigned int x)
 static inline unsigned int frac_pos(struct loopback_pcm *dpcm, unsigned int x)
 {
 	if (dpcm->pcm_rate_shift == NO_PITCH) {	/* no pitch */
-		return x * HZ;
+		return x * LOOPBACK_HZ;
 	} else {
-		x = div_u64(dpcm->pcm_rate_shift * (unsigned long long)x * HZ,
-			    NO_PITCH);
+		x = div_u64(dpcm->pcm_rate_shift * (unsigned long long)x *
+			    LOOPBACK_HZ, NO_PITCH);
 	}
 	return x;
 }
@@ -166,6 +172,34 @@ static inline unsigned int get_rate_shift(struct loopback_pcm *dpcm)
 	return get_setup(dpcm)->rate_shift;
 }
 
+static inline u64 loopback_ticks(void)
+{
+	return ktime_to_ms(ktime_get());
+}
+
+/*
+ * Without period wakeups, sleep until the application's fill level
+ * threshold (avail_min) is reached instead of until the next period.
+ * Once it is reached, keep checking for xruns at most every half buffer.
+ * Returns the distance in the fractional units of irq_pos.
+ */
+static unsigned int loopback_wakeup_frac(struct loopback_pcm *dpcm)
+{
+	struct snd_pcm_runtime *runtime = dpcm->substream->runtime;
+	snd_pcm_uframes_t avail, frames;
+
+	if (dpcm->substream->stream == SNDRV_PCM_STREAM_PLAYBACK)
+		avail = snd_pcm_playback_avail(runtime);
+	else
+		avail = snd_pcm_capture_avail(runtime);
+	if (avail < runtime->control->avail_min)
+		frames = runtime->control->avail_min - avail;
+	else
+		frames = runtime->period_size;
+	frames = clamp_t(snd_pcm_uframes_t, frames, 1, runtime->buffer_size / 2);
+	return frac_pos(dpcm, frames_to_bytes(runtime, frames));
+}
+
 /* call in cable->lock */
 static void loopback_timer_start(struct loopback_pcm *dpcm)
 {
@@ -180,21 +214,25 @@ static void loopback_timer_start(struct loopback_pcm *dpcm)
 		dpcm->irq_pos %= dpcm->period_size_frac;
 		dpcm->period_update_pending = 1;
 	}
-	tick = dpcm->period_size_frac - dpcm->irq_pos;
+	if (dpcm->no_period)
+		tick = loopback_wakeup_frac(dpcm);
+	else
+		tick = dpcm->period_size_frac - dpcm->irq_pos;
 	tick = (tick + dpcm->pcm_bps - 1) / dpcm->pcm_bps;
-	mod_timer(&dpcm->timer, jiffies + tick);
+	/* irq_pos is the position at last_tick, so expire relative to that */
+	hrtimer_start(&dpcm->timer, ms_to_ktime(dpcm->last_tick + tick),
+		      HRTIMER_MODE_ABS_SOFT);
 }
 
 /* call in cable->lock */
 static inline void loopback_timer_stop(struct loopback_pcm *dpcm)
 {
-	del_timer(&dpcm->timer);
-	dpcm->timer.expires = 0;
+	hrtimer_try_to_cancel(&dpcm->timer);
 }
 
 static inline void loopback_timer_stop_sync(struct loopback_pcm *dpcm)
 {
-	del_timer_sync(&dpcm->timer);
+	hrtimer_cancel(&dpcm->timer);
 }
 
 #define CABLE_VALID_PLAYBACK	(1 << SNDRV_PCM_STREAM_PLAYBACK)
@@ -270,7 +308,7 @@ static int loopback_trigger(struct snd_pcm_substream *substream, int cmd)
 		err = loopback_check_format(cable, substream->stream);
 		if (err < 0)
 			return err;
-		dpcm->last_jiffies = jiffies;
+		dpcm->last_tick = loopback_ticks();
 		dpcm->pcm_rate_shift = 0;
 		dpcm->last_drift = 0;
 		spin_lock(&cable->lock);	
@@ -302,7 +340,7 @@ static int loopback_trigger(struct snd_pcm_substream *substream, int cmd)
 	case SNDRV_PCM_TRIGGER_PAUSE_RELEASE:
 	case SNDRV_PCM_TRIGGER_RESUME:
 		spin_lock(&cable->lock);
-		dpcm->last_jiffies = jiffies;
+		dpcm->last_tick = loopback_ticks();
 		cable->pause &= ~stream;
 		loopback_timer_start(dpcm);
 		spin_unlock(&cable->lock);
@@ -354,6 +392,7 @@ static int loopback_prepare(struct snd_pcm_substream *substream)
 
 	dpcm->irq_pos = 0;
 	dpcm->period_update_pending = 0;
+	dpcm->no_period = runtime->no_period_wakeup;
 	dpcm->pcm_bps = bps;
 	dpcm->pcm_salign = salign;
 	dpcm->pcm_period_size = frames_to_bytes(runtime, runtime->period_size);
@@ -445,13 +484,13 @@ static void copy_play_buf(struct loopback_pcm *play,
 }
 
 static inline unsigned int bytepos_delta(struct loopback_pcm *dpcm,
-					 unsigned int jiffies_delta)
+					 unsigned int tick_delta)
 {
 	unsigned long last_pos;
 	unsigned int delta;
 
 	last_pos = byte_pos(dpcm, dpcm->irq_pos);
-	dpcm->irq_pos += jiffies_delta * dpcm->pcm_bps;
+	dpcm->irq_pos += tick_delta * dpcm->pcm_bps;
 	delta = byte_pos(dpcm, dpcm->irq_pos) - last_pos;
 	if (delta >= dpcm->last_drift)
 		delta -= dpcm->last_drift;
@@ -477,19 +516,20 @@ static unsigned int loopback_pos_update(struct loopback_cable *cable)
 			cable->streams[SNDRV_PCM_STREAM_PLAYBACK];
 	struct loopback_pcm *dpcm_capt =
 			cable->streams[SNDRV_PCM_STREAM_CAPTURE];
-	unsigned long delta_play = 0, delta_capt = 0, cur_jiffies;
+	unsigned long delta_play = 0, delta_capt = 0;
 	unsigned int running, count1, count2;
+	u64 cur_tick;
 
-	cur_jiffies = jiffies;
+	cur_tick = loopback_ticks();
 	running = cable->running ^ cable->pause;
 	if (running & (1 << SNDRV_PCM_STREAM_PLAYBACK)) {
-		delta_play = cur_jiffies - dpcm_play->last_jiffies;
-		dpcm_play->last_jiffies += delta_play;
+		delta_play = cur_tick - dpcm_play->last_tick;
+		dpcm_play->last_tick += delta_play;
 	}
 
 	if (running & (1 << SNDRV_PCM_STREAM_CAPTURE)) {
-		delta_capt = cur_jiffies - dpcm_capt->last_jiffies;
-		dpcm_capt->last_jiffies += delta_capt;
+		delta_capt = cur_tick - dpcm_capt->last_tick;
+		dpcm_capt->last_tick += delta_capt;
 	}
 
 	if (delta_play == 0 && delta_capt == 0)
@@ -525,23 +565,53 @@ static unsigned int loopback_pos_update(struct loopback_cable *cable)
 	return running;
 }
 
-static void loopback_timer_function(struct timer_list *t)
+static enum hrtimer_restart loopback_timer_function(struct hrtimer *t)
 {
-	struct loopback_pcm *dpcm = from_timer(dpcm, t, timer);
+	struct loopback_pcm *dpcm = container_of(t, struct loopback_pcm, timer);
+	struct loopback_cable *cable = dpcm->cable;
+	unsigned int stream = 1 << dpcm->substream->stream;
 	unsigned long flags;
 
-	spin_lock_irqsave(&dpcm->cable->lock, flags);
-	if (loopback_pos_update(dpcm->cable) & (1 << dpcm->substream->stream)) {
-		loopback_timer_start(dpcm);
-		if (dpcm->period_update_pending) {
-			dpcm->period_update_pending = 0;
-			spin_unlock_irqrestore(&dpcm->cable->lock, flags);
-			/* need to unlock before calling below */
-			snd_pcm_period_elapsed(dpcm->substream);
-			return;
-		}
+	spin_lock_irqsave(&cable->lock, flags);
+	if (!(loopback_pos_update(cable) & stream))
+		goto unlock;
+	dpcm->wakeups++;
+	if (dpcm->no_period) {
+		/* update hw_ptr first so that the next expiry is exact */
+		dpcm->period_update_pending = 0;
+		spin_unlock_irqrestore(&cable->lock, flags);
+		snd_pcm_period_elapsed(dpcm->substream);
+		spin_lock_irqsave(&cable->lock, flags);
+		if ((cable->running ^ cable->pause) & stream)
+			loopback_timer_start(dpcm);
+		goto unlock;
 	}
-	spin_unlock_irqrestore(&dpcm->cable->lock, flags);
+	loopback_timer_start(dpcm);
+	if (dpcm->period_update_pending) {
+		dpcm->period_update_pending = 0;
+		spin_unlock_irqrestore(&cable->lock, flags);
+		/* need to unlock before calling below */
+		snd_pcm_period_elapsed(dpcm->substream);
+		return HRTIMER_NORESTART;
+	}
+ unlock:
+	spin_unlock_irqrestore(&cable->lock, flags);
+	return HRTIMER_NORESTART;
+}
+
+/* the application moved appl_ptr, so its wakeup point moved as well */
+static int loopback_ack(struct snd_pcm_substream *substream)
+{
+	struct loopback_pcm *dpcm = substream->runtime->private_data;
+	struct loopback_cable *cable = dpcm->cable;
+
+	if (!dpcm->no_period)
+		return 0;
+	spin_lock(&cable->lock);
+	if ((cable->running ^ cable->pause) & (1 << substream->stream))
+		loopback_timer_start(dpcm);
+	spin_unlock(&cable->lock);
+	return 0;
 }
 
 static snd_pcm_uframes_t loopback_pointer(struct snd_pcm_substream *substream)
@@ -561,7 +631,7 @@ static const struct snd_pcm_hardware loopback_pcm_hardware =
 {
 	.info =		(SNDRV_PCM_INFO_INTERLEAVED | SNDRV_PCM_INFO_MMAP |
 			 SNDRV_PCM_INFO_MMAP_VALID | SNDRV_PCM_INFO_PAUSE |
-			 SNDRV_PCM_INFO_RESUME),
+			 SNDRV_PCM_INFO_RESUME | SNDRV_PCM_INFO_NO_PERIOD_WAKEUP),
 	.formats =	(SNDRV_PCM_FMTBIT_S16_LE | SNDRV_PCM_FMTBIT_S16_BE |
 			 SNDRV_PCM_FMTBIT_S32_LE | SNDRV_PCM_FMTBIT_S32_BE |
 			 SNDRV_PCM_FMTBIT_FLOAT_LE | SNDRV_PCM_FMTBIT_FLOAT_BE),
@@ -698,7 +768,8 @@ static int loopback_open(struct snd_pcm_substream *substream)
 	}
 	dpcm->loopback = loopback;
 	dpcm->substream = substream;
-	timer_setup(&dpcm->timer, loopback_timer_function, 0);
+	hrtimer_init(&dpcm->timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS_SOFT);
+	dpcm->timer.function = loopback_timer_function;
 
 	cable = loopback->cables[substream->number][dev];
 	if (!cable) {
@@ -779,6 +850,7 @@ static const struct snd_pcm_ops loopback_pcm_ops = {
 	.trigger =	loopback_trigger,
 	.pointer =	loopback_pointer,
 	.page =		snd_pcm_lib_get_vmalloc_page,
+	.ack =		loopback_ack,
 };
 
 static int loopback_pcm_new(struct loopback *loopback,
@@ -1098,9 +1170,12 @@ static void print_dpcm_info(struct snd_info_buffer *buffer,
 						dpcm->period_update_pending);
 	snd_iprintf(buffer, "    irq_pos:\t\t%u\n", dpcm->irq_pos);
 	snd_iprintf(buffer, "    period_frac:\t%u\n", dpcm->period_size_frac);
-	snd_iprintf(buffer, "    last_jiffies:\t%lu (%lu)\n",
-					dpcm->last_jiffies, jiffies);
-	snd_iprintf(buffer, "    timer_expires:\t%lu\n", dpcm->timer.expires);
+	snd_iprintf(buffer, "    last_tick:\t\t%llu (%llu)\n",
+					dpcm->last_tick, loopback_ticks());
+	snd_iprintf(buffer, "    timer_expires:\t%lld\n",
+		    ktime_to_ms(hrtimer_get_expires(&dpcm->timer)));
+	snd_iprintf(buffer, "    no_period:\t\t%u\n", dpcm->no_period);
+	snd_iprintf(buffer, "    wakeups:\t\t%lu\n", dpcm->wakeups);
 }
 
 static void print_substream_info(struct snd_info_buffer *buffer,
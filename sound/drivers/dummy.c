@@ -107,6 +107,8 @@ struct dummy_timer_ops {
 	int (*start)(struct snd_pcm_substream *);
 	int (*stop)(struct snd_pcm_substream *);
 	snd_pcm_uframes_t (*pointer)(struct snd_pcm_substream *);
+	/* optional; backends providing it support period-less wakeups */
+	int (*ack)(struct snd_pcm_substream *);
 };
 
 #define get_dummy_ops(substream) \
@@ -374,13 +376,39 @@ struct dummy_hrtimer_pcm {
 	ktime_t base_time;
 	ktime_t period_time;
 	atomic_t running;
+	bool no_period;		/* wake on avail_min, not periods */
 	struct hrtimer timer;
 	struct snd_pcm_substream *substream;
 };
 
+/*
+ * Without period wakeups, sleep until the application's fill level
+ * threshold (avail_min) is reached instead of until the next period.
+ * Once it is reached, keep checking for xruns at most every half buffer.
+ */
+static ktime_t dummy_hrtimer_wakeup_delay(struct snd_pcm_substream *substream)
+{
+	struct snd_pcm_runtime *runtime = substream->runtime;
+	snd_pcm_uframes_t avail, frames;
+
+	if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK)
+		avail = snd_pcm_playback_avail(runtime);
+	else
+		avail = snd_pcm_capture_avail(runtime);
+	if (avail < runtime->control->avail_min)
+		frames = runtime->control->avail_min - avail;
+	else
+		frames = runtime->period_size;
+	frames = clamp_t(snd_pcm_uframes_t, frames, 1, runtime->buffer_size / 2);
+	return ns_to_ktime(div_u64((u64)frames * NSEC_PER_SEC +
+				   runtime->rate - 1, runtime->rate));
+}
+
 static enum hrtimer_restart dummy_hrtimer_callback(struct hrtimer *timer)
 {
 	struct dummy_hrtimer_pcm *dpcm;
+	enum hrtimer_restart ret = HRTIMER_RESTART;
+	unsigned long flags;
 
 	dpcm = container_of(timer, struct dummy_hrtimer_pcm, timer);
 	if (!atomic_read(&dpcm->running))
@@ -393,8 +421,20 @@ static enum hrtimer_restart dummy_hrtimer_callback(struct hrtimer *timer)
 	if (!atomic_read(&dpcm->running))
 		return HRTIMER_NORESTART;
 
-	hrtimer_forward_now(timer, dpcm->period_time);
-	return HRTIMER_RESTART;
+	if (!dpcm->no_period) {
+		hrtimer_forward_now(timer, dpcm->period_time);
+		return HRTIMER_RESTART;
+	}
+
+	/* serialize against .ack, which may have re-armed the timer */
+	snd_pcm_stream_lock_irqsave(dpcm->substream, flags);
+	if (hrtimer_is_queued(timer))
+		ret = HRTIMER_NORESTART;
+	else
+		hrtimer_forward_now(timer,
+				    dummy_hrtimer_wakeup_delay(dpcm->substream));
+	snd_pcm_stream_unlock_irqrestore(dpcm->substream, flags);
+	return ret;
 }
 
 static int dummy_hrtimer_start(struct snd_pcm_substream *substream)
@@ -402,7 +442,9 @@ static int dummy_hrtimer_start(struct snd_pcm_substream *substream)
 	struct dummy_hrtimer_pcm *dpcm = substream->runtime->private_data;
 
 	dpcm->base_time = hrtimer_cb_get_time(&dpcm->timer);
-	hrtimer_start(&dpcm->timer, dpcm->period_time, HRTIMER_MODE_REL_SOFT);
+	hrtimer_start(&dpcm->timer, dpcm->no_period ?
+		      dummy_hrtimer_wakeup_delay(substream) : dpcm->period_time,
+		      HRTIMER_MODE_REL_SOFT);
 	atomic_set(&dpcm->running, 1);
 	return 0;
 }
@@ -452,7 +494,20 @@ static int dummy_hrtimer_prepare(struct snd_pcm_substream *substream)
 	period %= rate;
 	nsecs = div_u64((u64)period * 1000000000UL + rate - 1, rate);
 	dpcm->period_time = ktime_set(sec, nsecs);
+	dpcm->no_period = runtime->no_period_wakeup;
+
+	return 0;
+}
+
+/* called under the stream lock whenever the application moved appl_ptr */
+static int dummy_hrtimer_ack(struct snd_pcm_substream *substream)
+{
+	struct dummy_hrtimer_pcm *dpcm = substream->runtime->private_data;
 
+	if (!dpcm->no_period || !atomic_read(&dpcm->running))
+		return 0;
+	hrtimer_start(&dpcm->timer, dummy_hrtimer_wakeup_delay(substream),
+		      HRTIMER_MODE_REL_SOFT);
 	return 0;
 }
 
@@ -485,6 +540,7 @@ static const struct dummy_timer_ops dummy_hrtimer_ops = {
 	.start =	dummy_hrtimer_start,
 	.stop =		dummy_hrtimer_stop,
 	.pointer =	dummy_hrtimer_pointer,
+	.ack =		dummy_hrtimer_ack,
 };
 
 #endif /* CONFIG_HIGH_RES_TIMERS */
@@ -516,6 +572,13 @@ static snd_pcm_uframes_t dummy_pcm_pointer(struct snd_pcm_substream *substream)
 	return get_dummy_ops(substream)->pointer(substream);
 }
 
+static int dummy_pcm_ack(struct snd_pcm_substream *substream)
+{
+	const struct dummy_timer_ops *ops = get_dummy_ops(substream);
+
+	return ops->ack ? ops->ack(substream) : 0;
+}
+
 static const struct snd_pcm_hardware dummy_pcm_hardware = {
 	.info =			(SNDRV_PCM_INFO_MMAP |
 				 SNDRV_PCM_INFO_INTERLEAVED |
@@ -581,6 +644,8 @@ static int dummy_pcm_open(struct snd_pcm_substream *substream)
 	if (substream->pcm->device & 2)
 		runtime->hw.info &= ~(SNDRV_PCM_INFO_MMAP |
 				      SNDRV_PCM_INFO_MMAP_VALID);
+	if (ops->ack)
+		runtime->hw.info |= SNDRV_PCM_INFO_NO_PERIOD_WAKEUP;
 
 	if (model == NULL)
 		return 0;
@@ -675,6 +740,7 @@ static struct snd_pcm_ops dummy_pcm_ops = {
 	.prepare =	dummy_pcm_prepare,
 	.trigger =	dummy_pcm_trigger,
 	.pointer =	dummy_pcm_pointer,
+	.ack =		dummy_pcm_ack,
 };
 
 static struct snd_pcm_ops dummy_pcm_ops_no_buf = {
@@ -686,6 +752,7 @@ static struct snd_pcm_ops dummy_pcm_ops_no_buf = {
 	.prepare =	dummy_pcm_prepare,
 	.trigger =	dummy_pcm_trigger,
 	.pointer =	dummy_pcm_pointer,
+	.ack =		dummy_pcm_ack,
 	.copy_user =	dummy_pcm_copy,
 	.copy_kernel =	dummy_pcm_copy_kernel,
 	.fill_silence =	dummy_pcm_silence,